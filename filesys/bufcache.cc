@@ -0,0 +1,1105 @@
+// bufcache.cc
+//	Routines to cache disk sectors in memory.  See bufcache.h for
+//	the locking rules and the replacement policy.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "bufcache.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// BufferList::Prepend, Remove
+// 	Put a buffer at the front of a queue, or take it out of one.
+//	The caller holds the list lock.
+//----------------------------------------------------------------------
+
+void
+BufferList::Prepend(Buffer *b)
+{
+    b->prev = NULL;
+    b->next = first;
+    if (first == NULL)
+	last = b;
+    else
+	first->prev = b;
+    first = b;
+    count++;
+}
+
+void
+BufferList::Remove(Buffer *b)
+{
+    if (b->prev == NULL)
+	first = b->next;
+    else
+	b->prev->next = b->next;
+    if (b->next == NULL)
+	last = b->prev;
+    else
+	b->next->prev = b->prev;
+    b->prev = b->next = NULL;
+    count--;
+}
+
+//----------------------------------------------------------------------
+// SortSectors
+// 	Put a list of sector numbers in ascending order.  Insertion sort:
+//	the lists are at most as long as the cache, and mostly sorted.
+//----------------------------------------------------------------------
+
+static void
+SortSectors(int *sectors, int count)
+{
+    for (int i = 1; i < count; i++) {
+	int sector = sectors[i], j;
+
+	for (j = i; j > 0 && sectors[j - 1] > sector; j--)
+	    sectors[j] = sectors[j - 1];
+	sectors[j] = sector;
+    }
+}
+
+//----------------------------------------------------------------------
+// PrefetchRead, PrefetchFinish
+// 	Dummy functions because C++ can't indirectly invoke member
+//	functions.  PrefetchRead is called by the disk interrupt handler
+//	when a run of read-ahead sectors has arrived; since the buffers
+//	can only be handed over under their bucket locks, it leaves that
+//	to PrefetchFinish, on the work queue.
+//
+//	"arg" is the PrefetchRun, cast to an int.
+//----------------------------------------------------------------------
+
+static void
+PrefetchRead(int arg)
+{
+    workQueue->Queue(&((PrefetchRun *) arg)->finish);
+}
+
+static void
+PrefetchFinish(int arg)
+{
+    PrefetchRun *run = (PrefetchRun *) arg;
+
+    run->cache->FinishPrefetch(run);
+}
+
+//----------------------------------------------------------------------
+// PrefetchRun::PrefetchRun
+// 	Initialize an empty run of read-ahead sectors for a cache.
+//----------------------------------------------------------------------
+
+PrefetchRun::PrefetchRun(BufferCache *c) : finish(PrefetchFinish, (int) this)
+{
+    cache = c;
+    count = 0;
+}
+
+//----------------------------------------------------------------------
+// FlusherThread
+// 	Dummy function because C++ can't indirectly invoke member
+//	functions.  Forked as the flusher thread.
+//
+//	"arg" is the BufferCache, cast to an int.
+//----------------------------------------------------------------------
+
+static void
+FlusherThread(int arg)
+{
+    ((BufferCache *) arg)->Flusher();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize an empty buffer cache in front of a disk, and fork
+//	its flusher thread, which sleeps until something is dirty.
+//
+//	"name" -- UNIX file name to be used as storage for the disk data
+//	"size" -- how many sectors to cache
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(char *name, int size) : SynchDisk(name)
+{
+    ASSERT(size >= MinCacheSize);
+    numBuffers = size;
+    buffers = new Buffer[numBuffers];
+    for (int i = 0; i < numBuffers; i++) {
+	Buffer *b = &buffers[i];
+
+	b->sector = -1;
+	b->data = new char[SectorSize];
+	b->dirty = b->busy = FALSE;
+	b->pinCount = 0;
+	b->hashNext = NULL;
+	b->queue = OnFreeList;
+	b->evictor = NULL;
+	freeList.Prepend(b);
+    }
+
+    for (numBuckets = 1; numBuckets < numBuffers; numBuckets *= 2)
+	;
+    buckets = new BufferBucket[numBuckets];
+    for (int i = 0; i < numBuckets; i++) {
+	buckets[i].lock = new Lock("buffer bucket");
+	buckets[i].released = new Condition("buffer released");
+	buckets[i].chain = NULL;
+    }
+
+    listLock = new Lock("buffer lists");
+    bufferUnpinned = new Condition("buffer unpinned");
+    numWaiting = 0;
+    a1inTarget = numBuffers / 4;	// Johnson and Shasha's suggested
+    maxGhosts = numBuffers / 2;		// Kin and Kout
+    ghosts = new int[maxGhosts];
+    numGhosts = ghostNext = 0;
+    numPrefetching = 0;
+    prefetchDone = new Condition("prefetch done");
+
+    numDirty = 0;
+    dirtyHighWater = numBuffers / 2;
+    dirtyLowWater = numBuffers / 4;
+    flusherIdle = flusherNapping = FALSE;
+    flusher = createThread("buffer flusher");
+    ASSERT(flusher != NULL);
+    flusher->Fork(FlusherThread, (int) this);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	De-allocate the cache.  Dirty buffers are thrown away; call Sync
+//	first to keep them.  Nachos is halting, so the flusher thread is
+//	asleep, and stays so.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    for (int i = 0; i < numBuffers; i++)
+	delete [] buffers[i].data;
+    delete [] buffers;
+    for (int i = 0; i < numBuckets; i++) {
+	delete buckets[i].lock;
+	delete buckets[i].released;
+    }
+    delete [] buckets;
+    delete listLock;
+    delete bufferUnpinned;
+    delete prefetchDone;
+    delete [] ghosts;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+// 	Read the contents of a disk sector into a buffer, from the cache
+//	if it is there.
+//
+//	"sectorNumber" -- the disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSector(int sectorNumber, char *data)
+{
+    Buffer *b = Get(sectorNumber, TRUE);
+
+    bcopy(b->data, data, SectorSize);
+    Put(b, FALSE);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+// 	Write the contents of a buffer into a disk sector.  The sector
+//	only goes to the cache; it is written to disk later, by the
+//	flusher, on eviction, or on Sync.  Since the whole sector is
+//	overwritten, a miss does not need to read it first.
+//
+//	"sectorNumber" -- the disk sector to be written
+//	"data" -- the new contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSector(int sectorNumber, char *data)
+{
+    Buffer *b = Get(sectorNumber, FALSE);
+
+    bcopy(data, b->data, SectorSize);
+    Put(b, TRUE);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors, WriteSectors
+// 	Read/write a run of consecutive sectors, through the cache a
+//	sector at a time, so that it sees every one.  Sectors that are
+//	cached cost no disk request at all; those read sequentially have
+//	usually been read ahead already; and written ones go to disk in
+//	runs anyway, when they are written back.
+//
+//	"firstSector" -- the first disk sector to be read/written
+//	"count" -- how many
+//	"data" -- the contents of the sectors, one after the other
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSectors(int firstSector, int count, char *data)
+{
+    for (int i = 0; i < count; i++)
+	ReadSector(firstSector + i, data + i * SectorSize);
+}
+
+void
+BufferCache::WriteSectors(int firstSector, int count, char *data)
+{
+    for (int i = 0; i < count; i++)
+	WriteSector(firstSector + i, data + i * SectorSize);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Sync
+// 	Write every dirty buffer back to disk, in sequential runs where
+//	we can.  Buffers that are busy are waited for, and written back
+//	once their holder is done.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Sync()
+{
+    DEBUG('f', "Syncing the buffer cache\n");
+    Flush(stats->totalTicks, 0);
+    for (int i = 0; i < numBuffers; i++) {
+	int sector = buffers[i].sector;
+
+	if (sector >= 0 && buffers[i].dirty)	// a quick look first, to
+	    WriteBackSector(sector);		// skip clean buffers
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::SyncSectors
+// 	Write back the buffers for the given sectors, if they are cached
+//	and dirty, and wait for them to reach the disk.  This is how a
+//	single file is synced: "sectors" are its header and data sectors.
+//
+//	"sectors" -- the sectors to write back, in any order
+//	"count" -- how many there are
+//----------------------------------------------------------------------
+
+void
+BufferCache::SyncSectors(int *sectors, int count)
+{
+    int *sorted = new int[count];
+
+    for (int i = 0; i < count; i++)
+	sorted[i] = sectors[i];
+    SortSectors(sorted, count);
+    WriteRuns(sorted, count);
+    for (int i = 0; i < count; i++)	// the ones that were busy
+	WriteBackSector(sorted[i]);
+    delete [] sorted;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Read ahead: bring sectors that are about to be read into the
+//	cache, without waiting for anybody.  Those already cached are
+//	left alone; the others are read in sequential runs, one disk
+//	request per run of consecutive sectors on a track.  We do not
+//	wait for the runs either: their buffers stay busy, so that
+//	anyone who wants them waits, until FinishPrefetch fills them in.
+//
+//	Read-ahead sectors go on A1in like any others, so at most A1in's
+//	worth is being fetched at a time -- more would push the first
+//	ones out before they are read.  That also keeps us from pinning
+//	so many buffers that GetFreeBuffer could wait for ever.  Only
+//	clean buffers are evicted to make room, and if there are none,
+//	we read less ahead.
+//
+//	"sectors" -- the sectors to read, in the order they will be used
+//	"count" -- how many there are
+//----------------------------------------------------------------------
+
+void
+BufferCache::Prefetch(int *sectors, int count)
+{
+    PrefetchRun *run = NULL;
+    int maxRun = max(1, min(a1inTarget, SectorsPerTrack));
+    int reserved, used = 0, n;
+
+    listLock->Acquire();		// reserve our share of the buffers
+    reserved = max(0, min(count, max(1, a1inTarget) - numPrefetching));
+    numPrefetching += reserved;
+    listLock->Release();
+
+    for (int i = 0; i < reserved; i += max(n, 1)) {
+	n = 0;
+	if (run == NULL)
+	    run = new PrefetchRun(this);
+	if ((run->buffers[0] = GetNew(sectors[i])) == NULL)
+	    continue;
+	for (n = 1; n < maxRun && i + n < reserved
+		    && sectors[i + n] == sectors[i] + n
+		    && (sectors[i + n] % SectorsPerTrack) != 0; n++)
+	    if ((run->buffers[n] = GetNew(sectors[i + n])) == NULL)
+		break;
+
+	DEBUG('f', "Reading ahead sectors %d to %d\n", sectors[i],
+	    sectors[i] + n - 1);
+	run->count = n;
+	used += n;
+	stats->numReadAheads += n;
+	stats->numReadAheadRuns++;
+	ReadSectorsAsync(sectors[i], n, run->data, PrefetchRead, (int) run);
+	run = NULL;
+    }
+    delete run;
+
+    listLock->Acquire();		// give back what we did not use
+    numPrefetching -= reserved - used;
+    if (numPrefetching == 0)
+	prefetchDone->Broadcast(listLock);
+    listLock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FinishPrefetch
+// 	A run of read-ahead sectors has arrived: copy it into the
+//	buffers waiting for it, and let go of them.  Called on the work
+//	queue.
+//----------------------------------------------------------------------
+
+void
+BufferCache::FinishPrefetch(PrefetchRun *run)
+{
+    for (int j = 0; j < run->count; j++) {
+	bcopy(run->data + j * SectorSize, run->buffers[j]->data, SectorSize);
+	Put(run->buffers[j], FALSE);
+    }
+    listLock->Acquire();
+    numPrefetching -= run->count;
+    if (numPrefetching == 0)
+	prefetchDone->Broadcast(listLock);
+    listLock->Release();
+    delete run;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Invalidate
+// 	Write back every dirty buffer, and then forget every sector that
+//	nobody is using, as well as the A1out ghosts, so that what is
+//	read next comes from the disk.  For benchmarks that want to
+//	start with a cold cache.  Read-ahead still under way is waited
+//	for first.  A buffer on no queue is being evicted by
+//	GetFreeBuffer, and is left to it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Invalidate()
+{
+    listLock->Acquire();
+    while (numPrefetching > 0)
+	prefetchDone->Wait(listLock);
+    listLock->Release();
+    Sync();
+    for (int i = 0; i < numBuffers; i++) {
+	Buffer *b = &buffers[i];
+	int sector = b->sector;
+	BufferBucket *bucket;
+
+	if (sector < 0)
+	    continue;
+	bucket = BucketOf(sector);
+	bucket->lock->Acquire();
+	if (b->sector == sector && b->pinCount == 0 && !b->busy
+		&& !b->dirty) {
+	    listLock->Acquire();
+	    if (b->queue != OnNoQueue) {
+		Dequeue(b);
+		Unhash(bucket, b);
+		b->queue = OnFreeList;
+		b->evictor = NULL;
+		freeList.Prepend(b);
+	    }
+	    listLock->Release();
+	}
+	bucket->lock->Release();
+    }
+    listLock->Acquire();
+    numGhosts = ghostNext = 0;
+    listLock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flusher
+// 	Body of the flusher thread: write back old dirty buffers every
+//	FlushInterval ticks, or at once when too many are dirty, and
+//	sleep while nothing is.  Its state is protected by disabling
+//	interrupts rather than by a lock, so that MarkDirty can wake it
+//	up from under a bucket lock, and the destructor need not worry
+//	about it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flusher()
+{
+    int written = 0;
+
+    for (;;) {
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+	while (numDirty == 0) {
+	    flusherIdle = TRUE;
+	    currentThread->Sleep();
+	}
+	if (numDirty < dirtyHighWater || written == 0) {
+	    flusherNapping = TRUE;	// MarkDirty may cut this short
+	    alarmClock->WaitUntil(FlushInterval);
+	    flusherNapping = FALSE;
+	}
+	(void) interrupt->SetLevel(oldLevel);
+
+	written = Flush(stats->totalTicks - FlushAge, dirtyLowWater);
+	if (written > 0)
+	    stats->numCacheFlushes++;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+// 	Write back every buffer that has been dirty since "dirtiedBefore"
+//	or earlier; then, while more than "keepDirty" buffers are dirty,
+//	the oldest of the rest.  They are written in ascending sector
+//	order, in runs.  Busy buffers are skipped: somebody is about to
+//	change them anyway.  Return how many buffers were written.
+//
+//	Buffers are chosen by a quick look, without their locks;
+//	WriteRuns checks again.
+//----------------------------------------------------------------------
+
+int
+BufferCache::Flush(int dirtiedBefore, int keepDirty)
+{
+    Buffer **oldest = new Buffer*[numBuffers];
+    int *sectors = new int[numBuffers];
+    int n = 0, count, written;
+
+    for (int i = 0; i < numBuffers; i++) {	// oldest first
+	Buffer *b = &buffers[i];
+	int j;
+
+	if (b->sector < 0 || !b->dirty || b->busy)
+	    continue;
+	for (j = n; j > 0 && oldest[j - 1]->dirtySince > b->dirtySince; j--)
+	    oldest[j] = oldest[j - 1];
+	oldest[j] = b;
+	n++;
+    }
+    for (count = 0; count < n; count++) {
+	if (oldest[count]->dirtySince > dirtiedBefore
+		&& numDirty - count <= keepDirty)
+	    break;
+	sectors[count] = oldest[count]->sector;
+    }
+    SortSectors(sectors, count);
+    written = WriteRuns(sectors, count);
+
+    delete [] oldest;
+    delete [] sectors;
+    return written;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteRuns
+// 	Write back the buffers for a list of sectors, if they are still
+//	cached, dirty and not busy.  Buffers for consecutive sectors on
+//	the same track are written with a single disk request.  All the
+//	requests are started before we wait for any, so the disk can
+//	serve them in its own order.  Return how many buffers were
+//	written.
+//
+//	"sectors" -- the sectors to write back, in ascending order
+//	"count" -- how many there are
+//----------------------------------------------------------------------
+
+int
+BufferCache::WriteRuns(int *sectors, int count)
+{
+    Buffer **claimed = new Buffer*[count];
+    DiskRequest **requests = new DiskRequest*[count];
+    char *data = new char[count * SectorSize];
+    int written = 0, numRuns = 0, n;
+
+    for (int i = 0; i < count; i += max(n, 1)) {
+	Buffer **run = &claimed[written];
+
+	n = 0;
+	if (sectors[i] < 0 || (run[0] = Claim(sectors[i])) == NULL)
+	    continue;
+	for (n = 1; i + n < count && sectors[i + n] == sectors[i] + n
+		    && (sectors[i + n] % SectorsPerTrack) != 0; n++)
+	    if ((run[n] = Claim(sectors[i + n])) == NULL)
+		break;
+
+	DEBUG('f', "Flushing sectors %d to %d\n", sectors[i],
+	    sectors[i] + n - 1);
+	for (int j = 0; j < n; j++)
+	    bcopy(run[j]->data, data + (written + j) * SectorSize, SectorSize);
+	requests[numRuns++] = WriteSectorsAsync(sectors[i], n,
+	    data + written * SectorSize);
+	stats->numCacheWriteBacks += n;
+	stats->numCacheWriteRuns++;
+	written += n;
+    }
+
+    for (int r = 0; r < numRuns; r++)
+	WaitRequest(requests[r]);
+    for (int j = 0; j < written; j++) {
+	BufferBucket *bucket = BucketOf(claimed[j]->sector);
+
+	bucket->lock->Acquire();
+	MarkClean(claimed[j]);
+	Release(bucket, claimed[j]);
+	bucket->lock->Release();
+    }
+    delete [] claimed;
+    delete [] requests;
+    delete [] data;
+    return written;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Claim
+// 	Make the buffer for a sector busy, for writing it back -- if it
+//	is cached, dirty, and nobody else has it.  Return NULL if not.
+//----------------------------------------------------------------------
+
+Buffer *
+BufferCache::Claim(int sectorNumber)
+{
+    BufferBucket *bucket = BucketOf(sectorNumber);
+    Buffer *b;
+
+    bucket->lock->Acquire();
+    b = Lookup(bucket, sectorNumber);
+    if (b != NULL && b->dirty && !b->busy) {
+	b->pinCount++;
+	b->busy = TRUE;
+    } else
+	b = NULL;
+    bucket->lock->Release();
+    return b;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Lookup
+// 	Return the buffer holding a sector, or NULL if it is not cached.
+//	The caller holds the bucket's lock.
+//----------------------------------------------------------------------
+
+Buffer *
+BufferCache::Lookup(BufferBucket *bucket, int sectorNumber)
+{
+    Buffer *b;
+
+    for (b = bucket->chain; b != NULL; b = b->hashNext)
+	if (b->sector == sectorNumber)
+	    return b;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Get
+// 	Return the buffer for a sector, busy, so that the caller has it
+//	to itself until it calls Put.  On a miss, a buffer is evicted to
+//	make room, and if "fill" is set, the sector is read in.  If not,
+//	the caller is about to overwrite all of it.
+//
+//	Evicting may mean writing a dirty buffer back, which we do not
+//	want to do while holding our bucket's lock; so we let go of it,
+//	and look again afterwards, in case somebody else brought the
+//	sector in meanwhile.
+//----------------------------------------------------------------------
+
+Buffer *
+BufferCache::Get(int sectorNumber, bool fill)
+{
+    BufferBucket *bucket = BucketOf(sectorNumber);
+    Buffer *b, *fresh;
+
+    bucket->lock->Acquire();
+    b = Lookup(bucket, sectorNumber);
+    if (b == NULL) {
+	bucket->lock->Release();
+	fresh = GetFreeBuffer();
+	bucket->lock->Acquire();
+	b = Lookup(bucket, sectorNumber);
+	if (b == NULL) {
+	    DEBUG('f', "Buffer cache miss on sector %d\n", sectorNumber);
+	    stats->numCacheMisses++;
+	    b = fresh;
+	    Insert(bucket, b, sectorNumber);
+	    bucket->lock->Release();
+	    if (fill)
+		SynchDisk::ReadSector(sectorNumber, b->data);
+	    return b;
+	}
+	listLock->Acquire();		// lost the race; give it back
+	fresh->queue = OnFreeList;
+	freeList.Prepend(fresh);
+	listLock->Release();
+    }
+
+    stats->numCacheHits++;
+    b->pinCount++;
+    while (b->busy)
+	bucket->released->Wait(bucket->lock);
+    b->busy = TRUE;
+    if (b->queue == OnAm || b->queue == OnNoQueue) {	// see Touch
+	listLock->Acquire();
+	Touch(b);
+	listLock->Release();
+    }
+    bucket->lock->Release();
+    return b;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetNew
+// 	Like Get on a miss, for read-ahead: if a sector is not cached,
+//	return a buffer for it, busy and not yet filled in.  If it is
+//	cached already, return NULL -- and do not wait for it, even if it
+//	is busy.  Likewise if there is no clean buffer to spare for it.
+//----------------------------------------------------------------------
+
+Buffer *
+BufferCache::GetNew(int sectorNumber)
+{
+    BufferBucket *bucket = BucketOf(sectorNumber);
+    Buffer *b, *fresh;
+
+    bucket->lock->Acquire();
+    b = Lookup(bucket, sectorNumber);
+    bucket->lock->Release();
+    if (b != NULL)
+	return NULL;
+
+    if ((fresh = GetFreeBuffer(TRUE)) == NULL)
+	return NULL;
+    bucket->lock->Acquire();
+    if (Lookup(bucket, sectorNumber) == NULL) {
+	Insert(bucket, fresh, sectorNumber);
+	bucket->lock->Release();
+	return fresh;
+    }
+    bucket->lock->Release();
+    listLock->Acquire();		// brought in meanwhile; give it back
+    fresh->queue = OnFreeList;
+    freeList.Prepend(fresh);
+    listLock->Release();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Insert
+// 	Put a buffer that holds no sector on the hash chain for a sector,
+//	and on its replacement queue.  It stays busy, and pinned by the
+//	caller, since nobody may look at it until it has been filled in.
+//	The caller holds the bucket's lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Insert(BufferBucket *bucket, Buffer *b, int sectorNumber)
+{
+    b->sector = sectorNumber;
+    b->hashNext = bucket->chain;
+    bucket->chain = b;
+    b->dirty = FALSE;
+    b->busy = TRUE;
+    b->pinCount = 1;
+    listLock->Acquire();
+    Enqueue(b);
+    listLock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Put
+// 	The caller is done with a buffer it got from Get.
+//
+//	"dirtied" -- did the caller change its contents?
+//----------------------------------------------------------------------
+
+void
+BufferCache::Put(Buffer *b, bool dirtied)
+{
+    BufferBucket *bucket = BucketOf(b->sector);
+
+    bucket->lock->Acquire();
+    ASSERT(b->busy);
+    if (dirtied)
+	MarkDirty(b);
+    Release(bucket, b);
+    bucket->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Release
+// 	Make a busy buffer available again, and drop our pin on it.
+//	Wake up whoever is waiting for it; or, if nobody is and it is now
+//	unpinned, anyone waiting for a buffer to evict.  The caller holds
+//	the bucket's lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Release(BufferBucket *bucket, Buffer *b)
+{
+    b->busy = FALSE;
+    b->pinCount--;
+    if (b->pinCount > 0)
+	bucket->released->Broadcast(bucket->lock);
+    else if (numWaiting > 0) {
+	listLock->Acquire();
+	bufferUnpinned->Broadcast(listLock);
+	listLock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetFreeBuffer
+// 	Return a buffer that holds no sector, and is on no queue and no
+//	hash chain, evicting some sector if need be.  If every buffer is
+//	pinned, wait for one to be unpinned.
+//
+//	"forReadAhead" -- only evict a clean buffer, and rather than
+//		wait, return NULL if there is none; read-ahead is not worth
+//		either waiting or writing for
+//
+//	The victim is taken off its queue under the list lock, so that
+//	nobody else picks it too; but somebody may find it through the
+//	hash table, and pin it, before we get its bucket's lock.  Then we
+//	put it back, and try another.  The same goes if it is dirty, and
+//	somebody asks for it while we are writing it back.  A hit may
+//	even have put it back on Am, and unpinned it, by the time we look
+//	-- and someone else may have taken it off again, to evict it
+//	themselves -- so it is only ours to evict if it is still on no
+//	queue, with us as its evictor; otherwise we leave it alone.
+//----------------------------------------------------------------------
+
+Buffer *
+BufferCache::GetFreeBuffer(bool forReadAhead)
+{
+    Buffer *b;
+    BufferBucket *bucket;
+
+    for (;;) {
+	listLock->Acquire();
+	if (forReadAhead) {
+	    if ((b = ChooseVictim(FALSE)) == NULL) {
+		listLock->Release();
+		return NULL;
+	    }
+	} else {
+	    numWaiting++;
+	    while ((b = ChooseVictim(TRUE)) == NULL)
+		bufferUnpinned->Wait(listLock);
+	    numWaiting--;
+	}
+	Dequeue(b);
+	listLock->Release();
+	if (b->sector < 0)		// off the free list
+	    return b;
+
+	bucket = BucketOf(b->sector);
+	bucket->lock->Acquire();
+	if (!StillEvicting(b)) {	// found and put back meanwhile
+	    bucket->lock->Release();
+	    continue;
+	}
+	if (b->pinCount == 0 && b->dirty && !forReadAhead) {
+	    stats->numDirtyEvictions++;
+	    b->pinCount++;
+	    b->busy = TRUE;
+	    WriteBack(bucket, b);
+	    Release(bucket, b);
+	    if (!StillEvicting(b)) {
+		bucket->lock->Release();
+		continue;
+	    }
+	}
+	listLock->Acquire();
+	if (b->pinCount == 0 && !b->dirty) {
+	    b->evictor = NULL;
+	    listLock->Release();
+	    Unhash(bucket, b);
+	    stats->numCacheEvictions++;
+	    bucket->lock->Release();
+	    return b;
+	}
+	Touch(b);			// in use, or dirty, after all
+	listLock->Release();
+	bucket->lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StillEvicting
+// 	Is "b", which we took off its queue to evict, still ours to
+//	evict?  Not if a hit has put it back on Am since -- even if
+//	someone else has taken it off again.  The caller holds b's
+//	bucket lock, so the answer stays true until it lets go: a buffer
+//	on no queue only goes back on one through a hit, under that lock.
+//----------------------------------------------------------------------
+
+bool
+BufferCache::StillEvicting(Buffer *b)
+{
+    bool ours;
+
+    listLock->Acquire();
+    ours = (b->queue == OnNoQueue && b->evictor == currentThread);
+    listLock->Release();
+    return ours;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ChooseVictim
+// 	Pick the buffer to evict next: a free one if there is any; else
+//	the oldest unpinned buffer on A1in, if A1in has grown past its
+//	target size; else the least recently used unpinned buffer on Am.
+//	If the preferred queue has only pinned buffers, try the other.
+//	Clean buffers go first, though, on either queue: evicting a
+//	dirty one means writing it back while our caller waits.  Return
+//	NULL if every buffer is pinned -- or, unless "dirtyOk", if every
+//	unpinned one is dirty.
+//
+//	The caller holds the list lock, but not the buffers' bucket
+//	locks, so "pinned" is only a hint here; GetFreeBuffer checks
+//	again.
+//----------------------------------------------------------------------
+
+Buffer *
+BufferCache::ChooseVictim(bool dirtyOk)
+{
+    BufferList *lists[2];
+    Buffer *b;
+
+    if (freeList.first != NULL)
+	return freeList.first;
+    if (a1in.count > a1inTarget || am.count == 0) {
+	lists[0] = &a1in;
+	lists[1] = &am;
+    } else {
+	lists[0] = &am;
+	lists[1] = &a1in;
+    }
+    for (int dirtyToo = 0; dirtyToo < (dirtyOk ? 2 : 1); dirtyToo++)
+	for (int i = 0; i < 2; i++)
+	    for (b = lists[i]->last; b != NULL; b = b->prev)
+		if (b->pinCount == 0 && !b->busy && (dirtyToo || !b->dirty))
+		    return b;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Touch
+// 	Note a hit on a buffer.  On Am, that moves it to the front.  On
+//	A1in, nothing happens: a sector that is used several times in
+//	quick succession has not earned a place on Am yet.  A buffer that
+//	is on no queue was about to be evicted, until somebody found it;
+//	it goes on Am.  The caller holds the list lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Touch(Buffer *b)
+{
+    if (b->queue == OnAm)
+	am.Remove(b);
+    else if (b->queue != OnNoQueue)
+	return;
+    b->queue = OnAm;
+    am.Prepend(b);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Enqueue
+// 	Put a newly loaded buffer on its queue: Am if its sector was
+//	evicted from A1in recently, since it is being used again; A1in
+//	otherwise.  The caller holds the list lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Enqueue(Buffer *b)
+{
+    if (RemoveGhost(b->sector)) {
+	b->queue = OnAm;
+	am.Prepend(b);
+    } else {
+	b->queue = OnA1in;
+	a1in.Prepend(b);
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Dequeue
+// 	Take a buffer that is about to be evicted off its queue.  A
+//	sector leaving A1in is remembered on A1out.  The caller holds the
+//	list lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Dequeue(Buffer *b)
+{
+    switch (b->queue) {
+      case OnFreeList:
+	freeList.Remove(b);
+	break;
+      case OnA1in:
+	a1in.Remove(b);
+	AddGhost(b->sector);
+	break;
+      case OnAm:
+	am.Remove(b);
+	break;
+      default:
+	ASSERT(FALSE);
+    }
+    b->queue = OnNoQueue;
+    b->evictor = currentThread;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Unhash
+// 	Take an unpinned buffer off its hash chain, so it no longer holds
+//	any sector.  The caller holds the bucket's lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Unhash(BufferBucket *bucket, Buffer *b)
+{
+    Buffer **ptr;
+
+    ASSERT(b->pinCount == 0 && !b->busy && !b->dirty);
+    for (ptr = &bucket->chain; *ptr != b; ptr = &(*ptr)->hashNext)
+	ASSERT(*ptr != NULL);
+    *ptr = b->hashNext;
+    b->hashNext = NULL;
+    b->sector = -1;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBack
+// 	Write a dirty buffer to disk.  The caller holds the bucket's
+//	lock, and has made the buffer busy, so nobody can change it
+//	while we let go of the lock for the disk write.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBack(BufferBucket *bucket, Buffer *b)
+{
+    ASSERT(b->busy && b->dirty);
+    bucket->lock->Release();
+    DEBUG('f', "Writing back sector %d\n", b->sector);
+    SynchDisk::WriteSector(b->sector, b->data);
+    stats->numCacheWriteBacks++;
+    stats->numCacheWriteRuns++;
+    bucket->lock->Acquire();
+    MarkClean(b);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBackSector
+// 	Write the buffer for a sector to disk, if it is cached and dirty;
+//	if somebody has it busy, wait until they are done.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBackSector(int sectorNumber)
+{
+    BufferBucket *bucket = BucketOf(sectorNumber);
+    Buffer *b;
+
+    bucket->lock->Acquire();
+    b = Lookup(bucket, sectorNumber);
+    if (b != NULL && b->dirty) {
+	b->pinCount++;
+	while (b->busy)
+	    bucket->released->Wait(bucket->lock);
+	b->busy = TRUE;
+	if (b->dirty)
+	    WriteBack(bucket, b);
+	Release(bucket, b);
+    }
+    bucket->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::MarkDirty, MarkClean
+// 	Note that a busy buffer has been modified, or written back, and
+//	keep count of the dirty ones.  A buffer becoming dirty wakes the
+//	flusher up if it was idle, or if it is napping and too much of
+//	the cache is now dirty.  The caller holds the bucket's lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::MarkDirty(Buffer *b)
+{
+    IntStatus oldLevel;
+
+    ASSERT(b->busy);
+    if (b->dirty)
+	return;
+    b->dirty = TRUE;
+    b->dirtySince = stats->totalTicks;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    numDirty++;
+    if (flusherIdle) {
+	flusherIdle = FALSE;
+	scheduler->ReadyToRun(flusher);
+    } else if (flusherNapping && numDirty >= dirtyHighWater) {
+	flusherNapping = FALSE;
+	alarmClock->Cancel(flusher);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+void
+BufferCache::MarkClean(Buffer *b)
+{
+    IntStatus oldLevel;
+
+    ASSERT(b->busy && b->dirty);
+    b->dirty = FALSE;
+    oldLevel = interrupt->SetLevel(IntOff);
+    numDirty--;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::RemoveGhost, AddGhost
+// 	Look up, and remember, sectors recently evicted from A1in.  A1out
+//	is a ring of the last Kout of them; it is only searched on a
+//	miss, which costs a disk read anyway, so a linear search will do.
+//	The caller holds the list lock.
+//----------------------------------------------------------------------
+
+bool
+BufferCache::RemoveGhost(int sectorNumber)
+{
+    for (int i = 0; i < numGhosts; i++)
+	if (ghosts[i] == sectorNumber) {
+	    ghosts[i] = -1;
+	    return TRUE;
+	}
+    return FALSE;
+}
+
+void
+BufferCache::AddGhost(int sectorNumber)
+{
+    if (maxGhosts == 0)
+	return;
+    ghosts[ghostNext] = sectorNumber;
+    ghostNext = (ghostNext + 1) % maxGhosts;
+    if (numGhosts < maxGhosts)
+	numGhosts++;
+}
@@ -0,0 +1,218 @@
+// bufcache.h
+//	Data structures for a write-back cache of disk sectors.
+//
+//	The buffer cache sits between the file system and the disk: it
+//	has the same ReadSector/WriteSector interface as SynchDisk, but
+//	keeps recently used sectors in memory, and writes modified
+//	sectors back to disk later.
+//
+//	Writing back is mostly left to a flusher thread, so that a
+//	thread that misses in the cache seldom has to write somebody
+//	else's sector before it can read its own.  The flusher wakes up
+//	every FlushInterval ticks while anything is dirty, and writes
+//	back the buffers that have been dirty for FlushAge ticks or more;
+//	and, once more than half the cache is dirty, the oldest dirty
+//	buffers until only a quarter is.  It writes in ascending sector
+//	order, and buffers for consecutive sectors on the same track go
+//	to the disk as a single request.  It starts all of its requests
+//	before waiting for any, so the disk scheduler sees them all at
+//	once.  Sync and SyncSectors write back everything, or a given
+//	file's sectors, at once.
+//
+//	Prefetch reads sectors in ahead of time, for OpenFile's
+//	read-ahead; it fetches runs of consecutive sectors with a single
+//	disk request, like the flusher writes them.  It does not wait for
+//	them: when a run arrives, the disk interrupt queues a work item
+//	that copies it into its buffers.
+//
+//	Buffers are found through a hash table keyed by sector number.
+//	Each bucket has its own lock, so threads working on different
+//	sectors do not get in each other's way; a single list lock
+//	protects the replacement queues, and is only held for a few
+//	pointer updates at a time.  Lock order: a bucket lock, then the
+//	list lock -- never the other way around.
+//
+//	A buffer in use is "busy": its holder has it to itself until it
+//	calls Put, and anyone else who wants the same sector waits.  A
+//	buffer is pinned while it is busy or anyone is waiting for it,
+//	and pinned buffers are never evicted.
+//
+//	Replacement uses the 2Q policy (Johnson and Shasha), which keeps
+//	a single sequential scan from flushing the cache: a sector seen
+//	for the first time goes on the short FIFO queue "A1in"; only a
+//	sector that is asked for again after leaving A1in -- we remember
+//	the last few in the "A1out" ghost queue, without their data --
+//	earns a place on the main LRU queue "Am".
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BUFCACHE_H
+#define BUFCACHE_H
+
+#include "copyright.h"
+#include "synchdisk.h"
+#include "workqueue.h"
+
+#define DefaultCacheSize 64		// buffers, unless -cacheSize says
+#define MinCacheSize	4		// fewest buffers 2Q can work with
+#define FlushInterval	5000		// ticks between flusher passes
+#define FlushAge	20000		// a buffer dirty for this long is
+					// written back at the next pass
+
+// Which replacement queue a buffer is on.
+
+enum BufferQueue { OnNoQueue, OnFreeList, OnA1in, OnAm };
+
+// One buffer: the contents of one disk sector, and its bookkeeping.
+
+class Buffer {
+  public:
+    int sector;				// sector cached here, -1 if none
+    char *data;				// its contents
+    bool dirty;				// modified since last written back?
+    int dirtySince;			// if so, when it was first modified
+    bool busy;				// in use by some thread?
+    int pinCount;			// threads using it or waiting for it
+    BufferQueue queue;			// replacement queue it is on
+    Thread *evictor;			// if on none, who took it off its
+					// queue to evict it
+    Buffer *hashNext;			// next in the same hash bucket
+    Buffer *prev, *next;		// neighbours on the queue
+};
+
+// A hash bucket: the buffers whose sectors hash here.
+
+class BufferBucket {
+  public:
+    Lock *lock;				// protects the chain, and the
+					// sector, busy, dirty and pinCount
+					// of the buffers on it
+    Condition *released;		// signalled when a busy buffer on
+					// the chain stops being busy
+    Buffer *chain;
+};
+
+// A doubly linked queue of buffers, most recently used first.
+
+class BufferList {
+  public:
+    BufferList() { first = last = NULL; count = 0; }
+
+    void Prepend(Buffer *b);		// put b at the front
+    void Remove(Buffer *b);		// take b out, from anywhere
+
+    Buffer *first, *last;
+    int count;
+};
+
+class BufferCache;
+
+// A run of sectors being read ahead: the buffers waiting for it, and
+// where the disk puts it meanwhile.
+
+class PrefetchRun {
+  public:
+    PrefetchRun(BufferCache *c);
+
+    BufferCache *cache;
+    Buffer *buffers[SectorsPerTrack];	// busy until the run arrives
+    int count;
+    char data[SectorsPerTrack * SectorSize];
+    WorkItem finish;			// copies data into the buffers
+};
+
+// The following class defines the buffer cache itself.
+
+class BufferCache : public SynchDisk {
+  public:
+    BufferCache(char *name, int numBuffers);
+					// a cache of numBuffers sectors
+					// in front of disk "name"
+    ~BufferCache();			// does not write anything back;
+					// call Sync first
+
+    void ReadSector(int sectorNumber, char *data);
+    void WriteSector(int sectorNumber, char *data);
+    void ReadSectors(int firstSector, int count, char *data);
+    void WriteSectors(int firstSector, int count, char *data);
+					// a sector at a time, through the
+					// buffers
+    void Sync();			// write back every dirty buffer
+    void SyncSectors(int *sectors, int count);
+					// ... or just those for some sectors
+    void Prefetch(int *sectors, int count);
+					// read sectors in, if not cached
+    void FinishPrefetch(PrefetchRun *run);
+					// ... once they have arrived
+    void Invalidate();			// sync, then empty the cache
+    void Flusher();			// body of the flusher thread
+
+  private:
+    BufferBucket *BucketOf(int sectorNumber)
+	{ return &buckets[sectorNumber & (numBuckets - 1)]; }
+    Buffer *Lookup(BufferBucket *bucket, int sectorNumber);
+    Buffer *Get(int sectorNumber, bool fill);
+					// find or load a sector, and make
+					// its buffer busy
+    Buffer *GetNew(int sectorNumber);	// ... only if it is not cached
+    void Insert(BufferBucket *bucket, Buffer *b, int sectorNumber);
+					// hash a free buffer in, busy
+    void Put(Buffer *b, bool dirtied);	// done with a busy buffer
+    void Release(BufferBucket *bucket, Buffer *b);
+					// b is no longer busy, nor pinned
+					// by us
+    Buffer *GetFreeBuffer(bool forReadAhead = FALSE);
+					// evict a buffer, if need be
+    Buffer *ChooseVictim(bool dirtyOk);	// ... and which one
+    bool StillEvicting(Buffer *b);	// ... and is it still ours?
+    void Touch(Buffer *b);		// a hit on b: update the queues
+    void Enqueue(Buffer *b);		// a newly loaded b: ... likewise
+    void Dequeue(Buffer *b);		// take b off its queue
+    void Unhash(BufferBucket *bucket, Buffer *b);
+    void WriteBack(BufferBucket *bucket, Buffer *b);
+					// write a busy, dirty buffer to disk
+    void WriteBackSector(int sectorNumber);
+					// ... a sector's buffer, if dirty
+    void MarkDirty(Buffer *b);		// a busy buffer was modified
+    void MarkClean(Buffer *b);		// ... or written back
+    int Flush(int dirtiedBefore, int keepDirty);
+					// write back old dirty buffers
+    int WriteRuns(int *sectors, int count);
+					// write back buffers in sequential
+					// runs, skipping busy ones
+    Buffer *Claim(int sectorNumber);	// make a sector's buffer busy, if
+					// it is dirty and nobody has it
+
+    bool RemoveGhost(int sectorNumber);	// was it on A1out? (if so, it
+					// no longer is)
+    void AddGhost(int sectorNumber);	// put it on A1out
+
+    int numBuffers;
+    Buffer *buffers;			// all of them
+    int numBuckets;			// a power of two
+    BufferBucket *buckets;
+
+    Lock *listLock;			// protects everything below
+    Condition *bufferUnpinned;		// signalled when a buffer that was
+					// pinned no longer is, if...
+    int numWaiting;			// ... anyone is looking for a buffer
+					// to evict
+    BufferList freeList, a1in, am;	// the replacement queues
+    int a1inTarget;			// 2Q's Kin: how long A1in may grow
+    int *ghosts;			// A1out: the sectors most recently
+    int numGhosts, ghostNext;		// evicted from A1in, in a ring
+    int maxGhosts;			// 2Q's Kout
+    int numPrefetching;			// buffers waiting for read-ahead
+    Condition *prefetchDone;		// signalled when that drops to 0
+
+    Thread *flusher;			// the flusher thread; these are
+    bool flusherIdle;			// protected by disabling interrupts,
+    bool flusherNapping;		// since it waits outside any lock
+    int numDirty;			// buffers dirty right now
+    int dirtyHighWater;			// when to start flushing early...
+    int dirtyLowWater;			// ... and when to stop
+};
+
+#endif // BUFCACHE_H
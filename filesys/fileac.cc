@@ -1,14 +1,72 @@
 #include "fileac.h"
+#include "filehdr.h"
 
 FileACEntry::FileACEntry(int headerSector_){
-    readWriteLock = new ReadWriteLock("File AC entry");
+    // phase-fair: a file that is read all the time must still get
+    // written, and the other way around
+    readWriteLock = new ReadWriteLock("File AC entry", RWPhaseFair);
     numLock = new Lock("FileACEntry numLock");
     headerSector = headerSector_;
     numThreads = 0;
+    blockMap = NULL;
+    numBlocks = 0;
+    hdr = NULL;
+    hdrDirty = FALSE;
+    diskAccessTime = 0;
 }
 FileACEntry::~FileACEntry(){
     delete readWriteLock;
     delete numLock;
+    delete [] blockMap;
+    delete hdr;
+}
+
+// The map is decoded from the shared header the first time it is
+// needed, and again whenever the file grows or shrinks.
+int FileACEntry::SectorOf(int index){
+    if (blockMap == NULL){
+        numLock->Acquire();
+        if (blockMap == NULL)
+            SetBlockMap();
+        numLock->Release();
+    }
+    ASSERT(index < numBlocks);
+    return blockMap[index];
+}
+void FileACEntry::SetBlockMap(){
+    int *map = new int[divRoundUp(hdr->FileLength(), SectorSize) + 1];
+    int count = hdr->DataSectors(map);
+
+    delete [] blockMap;
+    numBlocks = count;
+    blockMap = map;
+}
+void FileACEntry::DropBlockMap(){
+    delete [] blockMap;
+    blockMap = NULL;
+    numBlocks = 0;
+}
+
+// relatime, more or less: an access time a little out of date on disk
+// is not worth a disk write for every read
+void FileACEntry::Accessed(){
+    hdr->updateLastAccessTime();
+    hdrDirty = TRUE;
+    if (hdr->getLastAccessTime() - diskAccessTime >= AtimeSlack)
+        WriteBackHeader();
+}
+void FileACEntry::Modified(){
+    hdr->updateLastAccessTime();
+    hdr->updateLastModifyTime();
+    hdrDirty = TRUE;
+}
+void FileACEntry::WriteBackHeader(){
+    if (!hdrDirty)
+        return;
+    hdrDirty = FALSE;           // before the write: a change made while
+                                // we wait for the disk makes it dirty again
+    diskAccessTime = hdr->getLastAccessTime();
+    hdr->WriteBack(headerSector);
 }
 
 static int headerSectorToFind;
@@ -22,18 +80,27 @@ static void FindACEntry(int acEntry){
 FileACList::FileACList(){
 	list = new SynchList;
 	superLock = new Lock("FileACList");
+	findLock = new Lock("FileACList find");
 	foundACEntry = NULL;
 }
 FileACList::~FileACList(){
 	delete list;
 	delete superLock;
+	delete findLock;
 }
 
+// not every caller holds superLock, and Mapcar may wait for the list,
+// so the statics are guarded by a lock of their own
 void *FileACList::getACEntry(int headerSector){
+    FileACEntry * found;
+
+    findLock->Acquire();
     headerSectorToFind = headerSector;
     foundACEntry = NULL;
     list->Mapcar(FindACEntry);
-    return foundACEntry;
+    found = foundACEntry;
+    findLock->Release();
+    return found;
 };
 // invoked by OpenFile::OpenFile()
 void FileACList::UpdateFileACListWhenOpenFile(int headerSector){
@@ -45,6 +112,12 @@ void FileACList::UpdateFileACListWhenOpenFile(int headerSector){
     }
     entry->numLock->Acquire();
     entry->numThreads += 1;
+    if (entry->hdr == NULL){        // the first to open it
+        entry->hdr = new FileHeader;
+        entry->hdr->FetchFrom(headerSector);
+        entry->hdrDirty = FALSE;
+        entry->diskAccessTime = entry->hdr->getLastAccessTime();
+    }
     entry->numLock->Release();
     superLock->Release();
 };
@@ -57,7 +130,26 @@ void FileACList::UpdateFileACListWhenCloseFile(int headerSector){
     entry->numLock->Acquire();
     entry->numThreads -= 1;
     ASSERT(entry->numThreads >= 0);
+    if (entry->numThreads == 0){    // the header sector may be reused
+        entry->WriteBackHeader();   // for another file
+        delete entry->hdr;
+        entry->hdr = NULL;
+        entry->DropBlockMap();
+    }
     entry->numLock->Release();
     superLock->Release();
     DEBUG('f', "Leave UpdateFileACListWhenCloseFile\n");
-};
\ No newline at end of file
+};
+
+static void WriteBackACEntryHeader(int acEntry){
+    FileACEntry * entry = (FileACEntry *)acEntry;
+    if (entry->hdr != NULL)
+        entry->WriteBackHeader();
+}
+// invoked on Sync: the headers of open files are only written back
+// lazily, see FileACEntry::Accessed
+void FileACList::WriteBackHeaders(){
+    superLock->Acquire();
+    list->Mapcar(WriteBackACEntryHeader);
+    superLock->Release();
+}
@@ -3,6 +3,11 @@
 #define FILEAC_H
 #include "synch.h"
 #include "synchlist.h"
+class FileHeader;
+
+#define AtimeSlack 60           // seconds the access time on disk may
+                                // fall behind, before a read writes
+                                // the header back anyway
 // file access control entry
 class FileACEntry
 {
@@ -13,6 +18,29 @@ public:
   int numThreads;
   Lock * numLock;
   ReadWriteLock * readWriteLock;
+
+  // The file's block map -- which disk sector holds each sector of the
+  // file -- decoded once, and shared by every OpenFile of the file, so
+  // that finding a data sector never means reading the index again.
+  int SectorOf(int index);      // disk sector holding sector "index"
+                                // of the file
+  void SetBlockMap();
+                                // the file's sectors have changed;
+                                // called with the write lock held
+  void DropBlockMap();          // nobody has the file open any more
+  int *blockMap;                // NULL until somebody needs it
+  int numBlocks;
+
+  // The in-memory file header (the "inode"), shared likewise while the
+  // file is open.  Reads and writes only change its times in memory;
+  // it goes back to disk when the last OpenFile closes, on Sync, or
+  // when a read finds the access time on disk AtimeSlack out of date.
+  void Accessed();              // the file was read
+  void Modified();              // the file was written
+  void WriteBackHeader();       // write the header back, if dirty
+  FileHeader *hdr;              // NULL while nobody has the file open
+  bool hdrDirty;                // changed since it was last written?
+  int diskAccessTime;           // the access time on disk
 };
 
 class FileACList
@@ -23,10 +51,12 @@ public:
 	void * getACEntry(int headerSector);
 	void UpdateFileACListWhenOpenFile(int headerSector);
 	void UpdateFileACListWhenCloseFile(int headerSector);
+	void WriteBackHeaders();        // of every open file
 
 private:
 	SynchList * list;
 	Lock * superLock;
+	Lock * findLock;        // getACEntry searches through statics
 	/* data */
 };
 //..
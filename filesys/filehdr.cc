@@ -5,10 +5,12 @@
 //	The file header is used to locate where on disk the 
 //	file's data is stored.  We implement this as a fixed size
 //	table of pointers -- each entry in the table points to the 
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect 
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector, 
+//	disk sector containing that portion of the file data, except
+//	for the last three, which point to single, double and triple
+//	indirect blocks for the rest.  The table size is chosen so that
+//	the file header will be just big enough to fit in one disk
+//	sector.  (Or, on a disk formatted with extents, the table holds
+//	the root of an extent tree instead; see filehdr.h.)
 //
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
@@ -27,6 +29,213 @@
 #include "system.h"
 #include "filehdr.h"
 
+bool FileHeader::allocateNear = TRUE;
+bool FileHeader::useExtents = FALSE;
+
+//----------------------------------------------------------------------
+// The indirect block cache
+// 	The last few index blocks used, decoded, so that walking down the
+//	index tree of a big file seldom goes to the disk, even without a
+//	buffer cache.  Extent tree blocks are kept here too, as a sector's
+//	worth of pointers like any other.  Changes stay in the cache until FlushIndirect, at
+//	the end of the operation that made them, or until the block is
+//	evicted; a block that is freed is forgotten, so it is never
+//	written back over whatever the sector is used for next.
+//
+//	The cache lock is not held across disk reads: a block read by
+//	two threads at once is cached only once, and a copy changed
+//	meanwhile is newer than what came off the disk, so it stays.
+//----------------------------------------------------------------------
+
+class IndirectBlock {
+  public:
+    int sector;                         // -1 if the slot is empty
+    bool dirty;
+    int lastUsed;                       // for LRU replacement
+    int pointers[NumFirstLevel];
+};
+
+static IndirectBlock indirectCache[IndirectCacheSize];
+static int indirectClock = 0;
+static Lock indirectLock("indirect cache");
+
+// Find a block in the cache, or a slot to put it in (evicting the
+// least recently used block, and writing it back if it is dirty).
+// The caller holds the lock.
+static IndirectBlock *
+IndirectSlot(int sector, bool *found)
+{
+    IndirectBlock *b, *victim = NULL;
+
+    for (int i = 0; i < IndirectCacheSize; i++) {
+        b = &indirectCache[i];
+        if (b->sector == sector && sector >= 0) {
+            *found = TRUE;
+            b->lastUsed = ++indirectClock;
+            return b;
+        }
+        if (victim == NULL || b->sector < 0
+                || (victim->sector >= 0 && b->lastUsed < victim->lastUsed))
+            victim = b;
+    }
+    if (victim->sector >= 0 && victim->dirty)
+        synchDisk->WriteSector(victim->sector, (char *) victim->pointers);
+    *found = FALSE;
+    victim->sector = -1;
+    victim->dirty = FALSE;
+    victim->lastUsed = ++indirectClock;
+    return victim;
+}
+
+// Copy an index block's sector numbers into "pointers".
+static void
+ReadIndirect(int sector, int *pointers)
+{
+    IndirectBlock *b;
+    bool found;
+
+    indirectLock.Acquire();
+    b = IndirectSlot(sector, &found);
+    if (found) {
+        stats->numIndirectHits++;
+        bcopy((char *) b->pointers, (char *) pointers, SectorSize);
+        indirectLock.Release();
+        return;
+    }
+    indirectLock.Release();
+    stats->numIndirectMisses++;
+    synchDisk->ReadSector(sector, (char *) pointers);
+    indirectLock.Acquire();
+    b = IndirectSlot(sector, &found);
+    if (!found) {
+        b->sector = sector;
+        bcopy((char *) pointers, (char *) b->pointers, SectorSize);
+    }
+    indirectLock.Release();
+}
+
+// Change an index block's sector numbers, in the cache.
+static void
+WriteIndirect(int sector, int *pointers)
+{
+    IndirectBlock *b;
+    bool found;
+
+    indirectLock.Acquire();
+    b = IndirectSlot(sector, &found);
+    b->sector = sector;
+    b->dirty = TRUE;
+    bcopy((char *) pointers, (char *) b->pointers, SectorSize);
+    indirectLock.Release();
+}
+
+// An index block has been freed: drop it from the cache, unwritten.
+static void
+ForgetIndirect(int sector)
+{
+    indirectLock.Acquire();
+    for (int i = 0; i < IndirectCacheSize; i++)
+        if (indirectCache[i].sector == sector) {
+            indirectCache[i].sector = -1;
+            indirectCache[i].dirty = FALSE;
+        }
+    indirectLock.Release();
+}
+
+// Write every changed index block to disk.
+static void
+FlushIndirect()
+{
+    indirectLock.Acquire();
+    for (int i = 0; i < IndirectCacheSize; i++)
+        if (indirectCache[i].sector >= 0 && indirectCache[i].dirty) {
+            indirectCache[i].dirty = FALSE;
+            synchDisk->WriteSector(indirectCache[i].sector,
+                                   (char *) indirectCache[i].pointers);
+        }
+    indirectLock.Release();
+}
+
+// An empty cache, before anything else runs.
+static class IndirectCacheInit {
+  public:
+    IndirectCacheInit() {
+        for (int i = 0; i < IndirectCacheSize; i++) {
+            indirectCache[i].sector = -1;
+            indirectCache[i].dirty = FALSE;
+        }
+    }
+} indirectCacheInit;
+
+//----------------------------------------------------------------------
+// FileHeader::IndexBlocks
+// 	Return how many index blocks a file with the given number of data
+//	sectors needs: the single indirect block, then the double
+//	indirect one and the blocks under it, then the triple indirect
+//	one and its two levels.
+//----------------------------------------------------------------------
+
+int
+FileHeader::IndexBlocks(int numDataSectors)
+{
+    int n = numDataSectors - RealNumDirect, blocks = 0, m;
+
+    if (n <= 0)
+        return 0;
+    blocks = 1;                                 // single
+    n -= NumFirstLevel;
+    if (n <= 0)
+        return blocks;
+    m = min(n, NumFirstLevel * NumFirstLevel);  // double
+    blocks += 1 + divRoundUp(m, NumFirstLevel);
+    n -= m;
+    if (n <= 0)
+        return blocks;
+    blocks += 1 + divRoundUp(n, NumFirstLevel * NumFirstLevel)
+              + divRoundUp(n, NumFirstLevel);   // triple
+    return blocks;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SectorsFor
+// 	Return how many sectors a file of the given size needs, besides
+//	its header: its data, and its index blocks.
+//----------------------------------------------------------------------
+
+int
+FileHeader::SectorsFor(int fileSize)
+{
+    int count = divRoundUp(fileSize, SectorSize);
+
+    return count + IndexBlocks(count);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateSector
+// 	Allocate a sector from the free map, as close after "goal" as we
+//	can.  If "runLength" is more than one, the caller is about to
+//	allocate that many sectors in a row, so we look for a run of
+//	them that are free, and take the first; the caller then asks for
+//	the others with goal = the previous one + 1.  Sequential reads
+//	and writes of the file then seldom need to seek.  Returns -1 if
+//	the disk is full.
+//
+//	With allocateNear off, this is just first fit, which is how
+//	sectors were allocated before.
+//----------------------------------------------------------------------
+
+int
+FileHeader::AllocateSector(BitMap *freeMap, int goal, int runLength)
+{
+    int start;
+
+    if (!allocateNear)
+        return freeMap->Find();
+    if (runLength > 1 && (start = freeMap->FindRun(goal, runLength)) >= 0)
+        goal = start;
+    return freeMap->FindNear(goal);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -34,69 +243,42 @@
 //	Return FALSE if there are not enough free blocks to accomodate
 //	the new file.
 //
+//	The index and data sectors are allocated in one run, if there is
+//	one free, near "goal" -- normally, right after the file header.
+//
 //	"freeMap" is the bit map of free disk sectors
 //	"fileSize" is the bit map of free disk sectors
+//	"goal" is where to start looking for free sectors
 //----------------------------------------------------------------------
 
 bool
-FileHeader::Allocate(BitMap *freeMap, int fileSize)
+FileHeader::Allocate(BitMap *freeMap, int fileSize, int goal)
 { 
     DEBUG('a', "FileHeader::Allocate request fileSize %d\n", fileSize);
     ASSERT(fileSize <= MaxFileSize);
     numBytes = fileSize;
     numSectors  = divRoundUp(fileSize, SectorSize);
-    if (freeMap->NumClear() < numSectors)
-	return FALSE;		// not enough space
-//.
- //   for (int i = 0; i < numSectors; i++)
-//	dataSectors[i] = freeMap->Find();
-    DEBUG('a', "FileHeader::Allocate enough bit map\n");
-    int * firstLevelSector = NULL;
-    if (numSectors > RealNumDirect){
-        firstLevelSector = new int[NumFirstLevel];
-        dataSectors[RealNumDirect] = freeMap->Find();
-        DEBUG('a', "dataSectors[RealNumDirect] %d\n", dataSectors[RealNumDirect]);
-        // set next unused pointer as invalid.
-        if (numSectors < MaxFileSectors)
-            firstLevelSector[numSectors - RealNumDirect] = INVALID_POINTER;
-    }else{
-        dataSectors[numSectors] = INVALID_POINTER;
-    }
-    for (int i = 0; i < numSectors; ++i){
-        int * location = IndexToLocation(i, firstLevelSector);
-        *location = freeMap->Find();
-        DEBUG('a', "%d %d %d\n", i, (int)location, *location);
-    }
-    if (numSectors > RealNumDirect){
-        synchDisk->WriteSector(dataSectors[RealNumDirect], (char *)firstLevelSector);
-        DEBUG('a', "firstLevelSector %d\n", firstLevelSector[0]);
-        delete firstLevelSector;
+    int runLength = SectorsFor(fileSize);
+    type = useExtents ? EXTENT_LAYOUT : REGULAR_FILE;  // see initialize
+    if (UsesExtents()){
+        int count = numSectors;
+
+        numSectors = 0;
+        ext.depth = 0;
+        for (int i = 0; i < NumRootExtents; i++)
+            ext.extents[i].start = ext.extents[i].length = 0;
+        return extendExtents(count, freeMap, goal);
     }
+    int count = numSectors;
 
-/*    if (numSectors <= RealNumDirect){
-        DEBUG('a', "FileHeader::Allocate enough direct sectors\n");
-        for (int i = 0; i < numSectors; i++)
-            dataSectors[i] = freeMap->Find();
-        for (int i = numSectors; i < RealNumDirect; ++i)
-            dataSectors[i] = INVALID_POINTER;
-        dataSectors[RealNumDirect] = INVALID_POINTER;
-    } else {
-        DEBUG('a', "FileHeader::Allocate not enough direct sectors\n");
-        for (int i = 0; i < RealNumDirect; i++)
-            dataSectors[i] = freeMap->Find();
-        dataSectors[RealNumDirect] = freeMap->Find();
-        int remain = numSectors - RealNumDirect;
-        int sector_data[NumFirstLevel];
-        for (int i = 0; i < remain; ++i)
-            sector_data[i] = freeMap->Find();
-        for (int i = remain; i < NumFirstLevel; ++i)
-            sector_data[i] = INVALID_POINTER;
-        synchDisk->WriteSector(dataSectors[RealNumDirect], (char *)sector_data);
-    }*/
-//..
-    return TRUE;
+    numSectors = 0;
+    for (int i = 0; i < NumDirect; i++)
+        dataSectors[i] = INVALID_POINTER;
+    DEBUG('a', "FileHeader::Allocate %d sectors, %d in all\n", count, runLength);
+    return extendSector(count, freeMap, goal);
 }
 
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
 // 	De-allocate all the space allocated for data blocks for this file.
@@ -108,23 +290,11 @@ void
 FileHeader::Deallocate(BitMap *freeMap)
 {
     //.
-//    for (int i = 0; i < numSectors; i++) {
-//	ASSERT(freeMap->Test((int) dataSectors[i]));  // ought to be marked!
-//	freeMap->Clear((int) dataSectors[i]);
-//    }
-    int * firstLevelSector = getFirstLevelSector();
-    for(int i = 0; i < numSectors; ++i){
-        int sector = IndexToSector(i, firstLevelSector);
-        ASSERT(freeMap->Test((int) sector));
-        freeMap->Clear((int)sector);
-    }
-    if (numSectors > RealNumDirect){
-        ASSERT(freeMap->Test((int)dataSectors[RealNumDirect]));
-        freeMap->Clear((int)dataSectors[RealNumDirect]);
+    if (UsesExtents()){
+        shrinkExtents(numSectors, freeMap);
+        return;
     }
-    dataSectors[0] = INVALID_POINTER;
-    numSectors = 0;
-    deleteFirstLevelSector(firstLevelSector);
+    shrinkSector(numSectors, freeMap);
     //..
 }
 
@@ -170,12 +340,24 @@ int
 FileHeader::ByteToSector(int offset)
 {
     //.return(dataSectors[offset / SectorSize]);
-    if (offset < RealDirectMaxSize)
-        return (dataSectors[offset / SectorSize]);
-    int remain = offset - RealDirectMaxSize;
-    int firstLevelSector[NumFirstLevel];
-    synchDisk->ReadSector(dataSectors[RealNumDirect], (char *) firstLevelSector);
-    return (firstLevelSector[remain / SectorSize]);
+    if (UsesExtents()){
+        Extent node[ExtentsPerBlock];
+        Extent *entries = ext.extents;
+        int index = offset / SectorSize, n = NumRootExtents, i;
+
+        for (int depth = ext.depth; ; depth--){
+            for (i = 0; i < n && entries[i].length > 0
+                        && index >= entries[i].length; i++)
+                index -= entries[i].length;
+            ASSERT(i < n && entries[i].length > 0);
+            if (depth == 0)
+                return entries[i].start + index;
+            ReadIndirect(entries[i].start, (int *) node);
+            entries = node;
+            n = ExtentsPerBlock;
+        }
+    }
+    return IndexToSector(offset / SectorSize);
     //..
 }
 
@@ -203,25 +385,28 @@ FileHeader::Print(bool printContent)
     char *data = new char[SectorSize];
     //.
     printf("\n***** File meta info ******\n");
-    printf("Type: %s\n", (type == REGULAR_FILE)?"file":"dir");
+    printf("Type: %s\n", (getFileType() == REGULAR_FILE)?"file":"dir");
     printf("Created at: %d\n", creatTime);
     printf("Last Accessed at: %d\n", lastAccessTime);
     printf("Last Modified at: %d\n", lastModifyTime);
     printf("Path sector: %d\n", pathSector);
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
-    int * firstLevelSector = getFirstLevelSector();
+    int * sectors = new int[numSectors + 1];
+    DataSectors(sectors);
     for (i = 0; i < numSectors; ++i){
-        printf("%d ", IndexToSector(i, firstLevelSector));
+        printf("%d ", sectors[i]);
     }
     printf("\n");
+    if (UsesExtents())
+        printf("Mapped by extents, tree depth %d\n", ext.depth);
     if (!printContent){
         delete [] data;
-        deleteFirstLevelSector(firstLevelSector);
+        delete [] sectors;
         return;
     }
     printf("File contents:\n");
     for (i = k = 0; i < numSectors; i++) {
-        synchDisk->ReadSector(IndexToSector(i, firstLevelSector), data);
+        synchDisk->ReadSector(sectors[i], data);
         for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
     	    if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
     	       printf("%c", data[j]);
@@ -231,36 +416,191 @@ FileHeader::Print(bool printContent)
         printf("\n"); 
     }
     delete [] data;
-    deleteFirstLevelSector(firstLevelSector);
+    delete [] sectors;
 }
 
 //.
+// the layout bit was set by Allocate, and stays
 void FileHeader::initialize(int fileType, int filePathSector){
-    type = fileType;
+    type = fileType | (type & EXTENT_LAYOUT);
     creatTime = lastAccessTime = lastModifyTime = time(NULL);
     pathSector = filePathSector;
 }
 
-// idx:0, 1, 2, ...., numSectors - 1
-int FileHeader::IndexToSector(int idx, int * firstLevelSector){
-    if (idx < RealNumDirect)
-        return dataSectors[idx];
-    ASSERT(firstLevelSector != NULL);
-    int remain = idx - RealNumDirect;
-    DEBUG('a', "\n%d FileHeader::IndexToSector %d %d %d\n", dataSectors[RealNumDirect], idx, remain,firstLevelSector[remain]);
-    return firstLevelSector[remain]; 
+//----------------------------------------------------------------------
+// Span
+// 	Return how many data sectors one entry of an index block at the
+//	given depth maps: 1 just above the data, NumFirstLevel a level
+//	up, and so on.
+//----------------------------------------------------------------------
+
+static int
+Span(int depth)
+{
+    int span = 1;
+
+    for (int i = 1; i < depth; i++)
+        span *= NumFirstLevel;
+    return span;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Locate
+// 	Return the entry of the header's table under which the idx'th data
+//	sector of the file is mapped, and set "depth" to how many levels
+//	of index blocks there are below that entry (0 for a direct
+//	sector), and "offset" to where in that index tree the sector is.
+//----------------------------------------------------------------------
+
+int *
+FileHeader::Locate(int idx, int *depth, int *offset)
+{
+    ASSERT(idx >= 0 && idx < MaxFileSectors);
+    if (idx < RealNumDirect) {
+        *depth = *offset = 0;
+        return &dataSectors[idx];
+    }
+    idx -= RealNumDirect;
+    if (idx < NumFirstLevel) {
+        *depth = 1;
+        *offset = idx;
+        return &dataSectors[SingleIndirect];
+    }
+    idx -= NumFirstLevel;
+    if (idx < NumFirstLevel * NumFirstLevel) {
+        *depth = 2;
+        *offset = idx;
+        return &dataSectors[DoubleIndirect];
+    }
+    *depth = 3;
+    *offset = idx - NumFirstLevel * NumFirstLevel;
+    return &dataSectors[TripleIndirect];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::IndexToSector
+// 	Return the disk sector holding the idx'th data sector of the file
+//	(idx: 0, 1, ..., numSectors - 1), walking down the index blocks
+//	if need be.
+//----------------------------------------------------------------------
+
+int
+FileHeader::IndexToSector(int idx)
+{
+    int pointers[NumFirstLevel];
+    int depth, offset, span, sector;
+
+    ASSERT(idx < numSectors);
+    sector = *Locate(idx, &depth, &offset);
+    for (span = Span(depth); depth > 0; depth--, span /= NumFirstLevel) {
+        ReadIndirect(sector, pointers);
+        sector = pointers[offset / span];
+        offset %= span;
+    }
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AppendSector
+// 	Allocate the idx'th data sector of the file, which is one past
+//	its end, and the index blocks on the way to it that do not exist
+//	yet -- which is those for which it is the first sector mapped.
+//	Index blocks go before the data they map, from "goal" on; "goal"
+//	is left just past the data sector.  The first sector allocated
+//	starts a run of "runLength", if there is one.
+//----------------------------------------------------------------------
+
+void
+FileHeader::AppendSector(int idx, BitMap *freeMap, int *goal, int runLength)
+{
+    int pointers[NumFirstLevel];
+    int depth, offset, span, sector;
+    int *slot = Locate(idx, &depth, &offset);
+    int parent = -1, parentSlot = 0;
+
+    for (span = Span(depth); ; depth--, span /= NumFirstLevel) {
+        if (offset == 0) {              // nothing under here yet
+            sector = AllocateSector(freeMap, *goal, runLength);
+            ASSERT(sector >= 0);
+            runLength = 1;
+            *goal = sector + 1;
+            if (parent < 0)
+                *slot = sector;
+            else {
+                pointers[parentSlot] = sector;
+                WriteIndirect(parent, pointers);
+            }
+            if (depth > 0) {
+                for (int i = 0; i < NumFirstLevel; i++)
+                    pointers[i] = INVALID_POINTER;
+                WriteIndirect(sector, pointers);
+            }
+        } else {
+            sector = (parent < 0) ? *slot : pointers[parentSlot];
+            if (depth > 0)
+                ReadIndirect(sector, pointers);
+        }
+        if (depth == 0)
+            return;
+        parent = sector;
+        parentSlot = offset / span;
+        offset %= span;
+    }
 }
 
-// get where the idx sector id is stored.
-int * FileHeader::IndexToLocation(int idx, int * firstLevelSector){
-    if (idx < RealNumDirect)
-        return (dataSectors + idx);
-    ASSERT(firstLevelSector != NULL);
-    int remain = idx - RealNumDirect;
-    return (firstLevelSector + remain);
+//----------------------------------------------------------------------
+// FileHeader::RemoveSector
+// 	Free the idx'th data sector of the file, which is its last, and
+//	the index blocks that map nothing else.
+//----------------------------------------------------------------------
+
+void
+FileHeader::RemoveSector(int idx, BitMap *freeMap)
+{
+    int pointers[NumFirstLevel];
+    int blocks[3], slots[3], offsets[3];  // per level, from the top
+    int depth, offset, span, sector, level;
+    int *slot = Locate(idx, &depth, &offset);
+
+    sector = *slot;
+    span = Span(depth);
+    for (level = 0; level < depth; level++, span /= NumFirstLevel) {
+        blocks[level] = sector;
+        offsets[level] = offset;
+        slots[level] = offset / span;
+        ReadIndirect(sector, pointers);
+        sector = pointers[slots[level]];
+        offset %= span;
+    }
+    ASSERT(freeMap->Test(sector));
+    freeMap->Clear(sector);
+
+    for (level = depth - 1; level >= 0; level--) {
+        if (offsets[level] > 0) {       // the block maps more: keep it
+            ReadIndirect(blocks[level], pointers);
+            pointers[slots[level]] = INVALID_POINTER;
+            WriteIndirect(blocks[level], pointers);
+            return;
+        }
+        ForgetIndirect(blocks[level]);
+        ASSERT(freeMap->Test(blocks[level]));
+        freeMap->Clear(blocks[level]);
+    }
+    *slot = INVALID_POINTER;
 }
 
-bool FileHeader::extendSector(int numExtendSectors, int * firstLevelSector, BitMap *freeMap){
+//----------------------------------------------------------------------
+// FileHeader::extendSector
+// 	Add numExtendSectors data sectors to the end of the file, and the
+//	index blocks it now needs.  They are allocated in a run, if we
+//	can, right after the file's last data sector -- or, for an empty
+//	file, near "goal" -- so that a file that grows sequentially stays
+//	sequential on disk.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::extendSector(int numExtendSectors, BitMap *freeMap, int goal)
+{
     if (numExtendSectors < 0)
         return FALSE;
     if (numExtendSectors == 0)
@@ -268,27 +608,28 @@ bool FileHeader::extendSector(int numExtendSectors, int * firstLevelSector, BitM
     int newNumSectors = numSectors + numExtendSectors;
     if (newNumSectors > MaxFileSectors)
         return FALSE;
-    if (numSectors <= RealNumDirect && newNumSectors > RealNumDirect){
-        firstLevelSector = new int[NumFirstLevel];
-        dataSectors[RealNumDirect] = freeMap->Find();
-        if (newNumSectors < MaxFileSectors)
-            firstLevelSector[newNumSectors - RealNumDirect] = INVALID_POINTER;
-    } else {
-        dataSectors[newNumSectors] = INVALID_POINTER;
-    }
-    for (int i = numSectors; i < newNumSectors; ++i){
-        int * location = IndexToLocation(i, firstLevelSector);
-        *location = freeMap->Find();
-    }
-    if (newNumSectors > RealNumDirect){
-        synchDisk->WriteSector(dataSectors[RealNumDirect], (char *)firstLevelSector);
-        //delete firstLevelSector;
-    }
+    int runLength = numExtendSectors + IndexBlocks(newNumSectors)
+                    - IndexBlocks(numSectors);
+    if (freeMap->NumClear() < runLength)
+        return FALSE;           // not enough space
+    if (numSectors > 0)
+        goal = IndexToSector(numSectors - 1) + 1;
+    for (int i = numSectors; i < newNumSectors; i++)
+        AppendSector(i, freeMap, &goal, (i == numSectors) ? runLength : 1);
     numSectors = newNumSectors;
+    FlushIndirect();
     return TRUE;
 }
 
-bool FileHeader::shrinkSector(int numShrinkSectors, int * firstLevelSector, BitMap *freeMap){
+//----------------------------------------------------------------------
+// FileHeader::shrinkSector
+// 	Free the last numShrinkSectors data sectors of the file, and the
+//	index blocks that no longer map anything.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::shrinkSector(int numShrinkSectors, BitMap *freeMap)
+{
     if (numShrinkSectors < 0)
         return FALSE;
     if (numShrinkSectors == 0)
@@ -296,38 +637,340 @@ bool FileHeader::shrinkSector(int numShrinkSectors, int * firstLevelSector, BitM
     int newNumSectors = numSectors - numShrinkSectors;
     if (newNumSectors < 0)
         return FALSE;
-    for (int i = newNumSectors; i < numSectors; ++i){
-        int sector = IndexToSector(i, firstLevelSector);
-        ASSERT(freeMap->Test((int)sector));
-        freeMap->Clear((int)sector);
+    for (int i = numSectors - 1; i >= newNumSectors; i--)
+        RemoveSector(i, freeMap);
+    numSectors = newNumSectors;
+    FlushIndirect();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// WalkIndex
+// 	Append the first "count" data sectors mapped by the index block
+//	"sector", "depth" levels above the data, to "data", and the index
+//	blocks on the way to them to "index", if it is not NULL.
+//----------------------------------------------------------------------
+
+static void
+WalkIndex(int sector, int depth, int count, int *data, int *numData,
+          int *index, int *numIndex)
+{
+    int pointers[NumFirstLevel];
+    int span = Span(depth);
+
+    if (index != NULL)
+        index[(*numIndex)++] = sector;
+    ReadIndirect(sector, pointers);
+    for (int i = 0; count > 0; i++) {
+        int n = min(count, span);
+
+        if (depth == 1)
+            data[(*numData)++] = pointers[i];
+        else
+            WalkIndex(pointers[i], depth - 1, n, data, numData,
+                      index, numIndex);
+        count -= n;
     }
-    if (newNumSectors < MaxFileSectors){//must be true
-        int * location = IndexToLocation(newNumSectors, firstLevelSector);
-        *location = INVALID_POINTER;
+}
+
+//----------------------------------------------------------------------
+// BlockMap
+// 	Decode the block map of a file with "numSectors" data sectors,
+//	whose header table is "table", into "data", and its index blocks
+//	into "index" (if it is not NULL).  Return the number of data
+//	sectors.
+//----------------------------------------------------------------------
+
+static int
+BlockMap(int *table, int numSectors, int *data, int *index, int *numIndex)
+{
+    int n = 0, count = numSectors - RealNumDirect;
+
+    for (int i = 0; i < numSectors && i < RealNumDirect; i++)
+        data[n++] = table[i];
+    for (int depth = 1; count > 0; depth++) {
+        int m = min(count, Span(depth + 1));
+
+        WalkIndex(table[SingleIndirect + depth - 1], depth, m, data, &n,
+                  index, numIndex);
+        count -= m;
     }
-    if (numSectors > RealNumDirect){
-        if (newNumSectors <= RealNumDirect){
-            ASSERT(freeMap->Test((int)dataSectors[RealNumDirect]));
-            freeMap->Clear((int)dataSectors[RealNumDirect]);
-        } else {
-            synchDisk->WriteSector(dataSectors[RealNumDirect], (char *)firstLevelSector);
+    return n;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DataSectors
+// 	Fill in the numbers of the sectors holding the file's data, in
+//	order, and return how many there are.  This is the whole block
+//	map, decoded with a single read of each index block.
+//
+//	"sectors" must have room for an entry per data sector
+//----------------------------------------------------------------------
+
+int
+FileHeader::DataSectors(int *sectors)
+{
+    if (UsesExtents()){
+        Extent *extents = new Extent[numSectors + 1];
+        int count = LoadExtents(extents, NULL, NULL), n = 0;
+
+        for (int i = 0; i < count; i++)
+            for (int j = 0; j < extents[i].length; j++)
+                sectors[n++] = extents[i].start + j;
+        ASSERT(n == numSectors);
+        delete [] extents;
+        return n;
+    }
+    return BlockMap(dataSectors, numSectors, sectors, NULL, NULL);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DiskSectors
+// 	Like DataSectors, but also include the index blocks, if the file
+//	has any -- or the extent tree blocks -- after the data.  The
+//	header's own sector is not included.
+//
+//	"sectors" must have room for an entry per data sector, and
+//	IndexBlocks of that many more for the index -- or, with extents,
+//	TreeBlocks of that many more
+//----------------------------------------------------------------------
+
+int
+FileHeader::DiskSectors(int *sectors)
+{
+    if (UsesExtents()){
+        int count = DataSectors(sectors), numTree;
+
+        LoadExtents(NULL, sectors + count, &numTree);
+        return count + numTree;
+    }
+    int numIndex = 0;
+
+    BlockMap(dataSectors, numSectors, sectors, sectors + numSectors,
+             &numIndex);
+    return numSectors + numIndex;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TreeBlocks
+// 	Return how many tree blocks it takes to map "numExtents" extents,
+//	and set "*depth" to how many levels of them there are: none, if
+//	the header has room for them all.
+//----------------------------------------------------------------------
+
+int
+FileHeader::TreeBlocks(int numExtents, int *depth)
+{
+    int blocks = 0, n = numExtents, levels = 0;
+
+    while (n > NumRootExtents){
+        n = divRoundUp(n, ExtentsPerBlock);
+        blocks += n;
+        levels++;
+    }
+    if (depth != NULL)
+        *depth = levels;
+    return blocks;
+}
+
+//----------------------------------------------------------------------
+// LoadNode
+// 	Append the extents under some entries of the extent tree to
+//	"extents", and the tree blocks among them to "tree", reading the
+//	tree blocks "depth" levels down.  Either list may be NULL.
+//----------------------------------------------------------------------
+
+static void
+LoadNode(Extent *entries, int n, int depth, Extent *extents, int *count,
+         int *tree, int *numTree)
+{
+    Extent node[ExtentsPerBlock];
+
+    for (int i = 0; i < n && entries[i].length > 0; i++){
+        if (depth == 0){
+            if (extents != NULL)
+                extents[*count] = entries[i];
+            (*count)++;
+            continue;
         }
+        if (tree != NULL)
+            tree[*numTree] = entries[i].start;
+        (*numTree)++;
+        ReadIndirect(entries[i].start, (int *) node);
+        LoadNode(node, ExtentsPerBlock, depth - 1, extents, count, tree,
+                 numTree);
     }
-    numSectors = newNumSectors;    
-    return TRUE;
 }
 
-int *FileHeader::getFirstLevelSector(){
-    if (numSectors > RealNumDirect){
-        int * firstLevelSector = new int[NumFirstLevel];
-        synchDisk->ReadSector(dataSectors[RealNumDirect], (char *)firstLevelSector);
-        return firstLevelSector;
+//----------------------------------------------------------------------
+// FileHeader::LoadExtents
+// 	Read the whole extent tree: fill in the file's extents, in order,
+//	and the tree blocks, and return how many extents there are.
+//
+//	"extents" -- room for numSectors extents, or NULL
+//	"tree", "numTree" -- room for TreeBlocks(numSectors) sectors,
+//		and where to put how many there are; or NULL
+//----------------------------------------------------------------------
+
+int
+FileHeader::LoadExtents(Extent *extents, int *tree, int *numTree)
+{
+    int count = 0, blocks = 0;
+
+    LoadNode(ext.extents, NumRootExtents, ext.depth, extents, &count, tree,
+             &blocks);
+    if (numTree != NULL)
+        *numTree = blocks;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::StoreExtents
+// 	Build the extent tree for a list of extents, from the bottom up,
+//	and write it out, through the indirect block cache.  Tree blocks the file had already are used
+//	again, in the same order; any left over are freed, and if more
+//	are needed they are allocated near "goal".  The caller has made
+//	sure there is room for them.
+//
+//	"extents", "count" -- the file's extents, in order
+//	"tree", "numTree" -- the tree blocks it had, from LoadExtents
+//----------------------------------------------------------------------
+
+void
+FileHeader::StoreExtents(Extent *extents, int count, int *tree, int numTree,
+                         BitMap *freeMap, int goal)
+{
+    Extent node[ExtentsPerBlock];
+    Extent *level = extents, *above;
+    int depth, used = 0, n = count;
+
+    TreeBlocks(count, &depth);
+    for (int d = 0; d < depth; d++){
+        int blocks = divRoundUp(n, ExtentsPerBlock);
+
+        above = new Extent[blocks];
+        for (int b = 0; b < blocks; b++){
+            int sector = (used < numTree) ? tree[used]
+                                          : AllocateSector(freeMap, goal);
+
+            ASSERT(sector >= 0);
+            used++;
+            goal = sector + 1;
+            above[b].start = sector;
+            above[b].length = 0;
+            for (int i = 0; i < ExtentsPerBlock; i++){
+                int k = b * ExtentsPerBlock + i;
+
+                node[i].start = node[i].length = 0;
+                if (k < n){
+                    node[i] = level[k];
+                    above[b].length += level[k].length;
+                }
+            }
+            WriteIndirect(sector, (int *) node);
+        }
+        if (level != extents)
+            delete [] level;
+        level = above;
+        n = blocks;
+    }
+    ASSERT(n <= NumRootExtents);
+    for (int i = 0; i < NumRootExtents; i++){
+        ext.extents[i].start = ext.extents[i].length = 0;
+        if (i < n)
+            ext.extents[i] = level[i];
+    }
+    if (level != extents)
+        delete [] level;
+    ext.depth = depth;
+
+    for (; used < numTree; used++){
+        ASSERT(freeMap->Test(tree[used]));
+        freeMap->Clear(tree[used]);
+        ForgetIndirect(tree[used]);
+    }
+    FlushIndirect();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::extendExtents
+// 	Add numExtendSectors data sectors to the end of a file mapped by
+//	extents, allocated in a run if we can, right after its last
+//	sector -- or, for an empty file, near "goal".  A new sector that
+//	follows the last one on disk just makes the last extent longer.
+//	Return FALSE, and change nothing, if the disk is too full.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::extendExtents(int numExtendSectors, BitMap *freeMap, int goal)
+{
+    if (numExtendSectors < 0 || numSectors + numExtendSectors > MaxFileSectors)
+        return FALSE;
+    if (numExtendSectors == 0)
+        return TRUE;
+
+    Extent *extents = new Extent[numSectors + numExtendSectors];
+    int *tree = new int[TreeBlocks(numSectors) + 1];
+    int numTree, count = LoadExtents(extents, tree, &numTree);
+    int moreTree = TreeBlocks(count + numExtendSectors) - numTree;
+                                        // at worst, one extent per sector
+    bool success = (freeMap->NumClear() >= numExtendSectors + max(moreTree, 0));
+
+    if (success){
+        if (count > 0)
+            goal = extents[count - 1].start + extents[count - 1].length;
+        for (int i = 0; i < numExtendSectors; i++){
+            int sector = AllocateSector(freeMap, goal,
+                                        (i == 0) ? numExtendSectors : 1);
+
+            goal = sector + 1;
+            if (count > 0
+                    && extents[count - 1].start + extents[count - 1].length == sector)
+                extents[count - 1].length++;
+            else {
+                extents[count].start = sector;
+                extents[count].length = 1;
+                count++;
+            }
+        }
+        StoreExtents(extents, count, tree, numTree, freeMap, goal);
+        numSectors += numExtendSectors;
     }
-    return NULL;
+    delete [] extents;
+    delete [] tree;
+    return success;
 }
-bool FileHeader::deleteFirstLevelSector(int * firstLevelSector){
-    if (numSectors > RealNumDirect)
-        delete firstLevelSector;
+
+//----------------------------------------------------------------------
+// FileHeader::shrinkExtents
+// 	Free the last numShrinkSectors data sectors of a file mapped by
+//	extents, and the tree blocks it no longer needs.
+//----------------------------------------------------------------------
+
+void
+FileHeader::shrinkExtents(int numShrinkSectors, BitMap *freeMap)
+{
+    ASSERT(numShrinkSectors >= 0 && numShrinkSectors <= numSectors);
+    if (numShrinkSectors == 0)
+        return;
+
+    Extent *extents = new Extent[numSectors];
+    int *tree = new int[TreeBlocks(numSectors) + 1];
+    int numTree, count = LoadExtents(extents, tree, &numTree);
+
+    for (int i = 0; i < numShrinkSectors; i++){
+        Extent *last = &extents[count - 1];
+        int sector = last->start + last->length - 1;
+
+        ASSERT(freeMap->Test(sector));
+        freeMap->Clear(sector);
+        if (--last->length == 0)
+            count--;
+    }
+    StoreExtents(extents, count, tree, numTree, freeMap, 0);
+    numSectors -= numShrinkSectors;
+    delete [] extents;
+    delete [] tree;
 }
 
 bool FileHeader::extendSize(int numextendBytes, BitMap * freeMap){
@@ -339,11 +982,15 @@ bool FileHeader::extendSize(int numextendBytes, BitMap * freeMap){
     if (newNumBytes > MaxFileSize)
         return FALSE;
     int numExtendSectors = divRoundUp(newNumBytes, SectorSize) - numSectors;
-    int * firstLevelSector = getFirstLevelSector();
-    if (!extendSector(numExtendSectors, firstLevelSector, freeMap))
+    if (UsesExtents()){
+        if (!extendExtents(numExtendSectors, freeMap, pathSector))
+            return FALSE;
+        numBytes = newNumBytes;
+        return TRUE;
+    }
+    if (!extendSector(numExtendSectors, freeMap, pathSector))
         return FALSE;
     numBytes = newNumBytes;
-    deleteFirstLevelSector(firstLevelSector);
     return TRUE;
 }
 
@@ -356,10 +1003,13 @@ bool FileHeader::shrinkSize(int numShrinkBytes, BitMap * freeMap){
     if (newNumBytes < 0)
         return FALSE;
     int numShrinkSectors = numSectors - divRoundUp(newNumBytes, SectorSize);
-    int * firstLevelSector = getFirstLevelSector();
-    if (!shrinkSector(numShrinkSectors, firstLevelSector, freeMap))
+    if (UsesExtents()){
+        shrinkExtents(numShrinkSectors, freeMap);
+        numBytes = newNumBytes;
+        return TRUE;
+    }
+    if (!shrinkSector(numShrinkSectors, freeMap))
         return FALSE;
     numBytes = newNumBytes;
-    deleteFirstLevelSector(firstLevelSector);
     return TRUE;
 }
\ No newline at end of file
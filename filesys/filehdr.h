@@ -18,17 +18,32 @@
 #include "bitmap.h"
 //.
 #include <time.h>
-//. last entry as fisrt level index
-#define NumFirstLevel (SectorSize / sizeof(int))
+//. last three entries as single, double and triple indirect blocks
+#define NumFirstLevel ((int) (SectorSize / sizeof(int)))
+                                // sector numbers in an index block
 #define FisrtLevelMaxSize   (NumFirstLevel * SectorSize)
 #define NumDirect 	((SectorSize  / sizeof(int)) - 7)
-#define RealNumDirect (NumDirect - 1)
+#define RealNumDirect (NumDirect - 3)
+#define SingleIndirect  RealNumDirect           // where in dataSectors
+#define DoubleIndirect  (RealNumDirect + 1)     // the roots of the
+#define TripleIndirect  (RealNumDirect + 2)     // index trees are
 #define RealDirectMaxSize  (RealNumDirect * SectorSize)
-#define MaxFileSectors   (RealNumDirect + NumFirstLevel)
+#define MaxFileSectors   (RealNumDirect + NumFirstLevel \
+                          + NumFirstLevel * NumFirstLevel \
+                          + NumFirstLevel * NumFirstLevel * NumFirstLevel)
 #define MaxFileSize 	(MaxFileSectors * SectorSize)
+#define IndirectCacheSize 16    // index blocks kept in memory
+//. sectors are allocated by track group: a file's header, index and
+// data go in the same group as its parent directory, if there is room.
+// The last group is short if -diskTracks is not a multiple of the group.
+#define TracksPerGroup	4
+#define SectorsPerGroup	(TracksPerGroup * SectorsPerTrack)
+#define NumGroups	divRoundUp(NumSectors, SectorsPerGroup)
 //.
 #define REGULAR_FILE 0
 #define DIRECTORY 1
+#define EXTENT_LAYOUT 0x10      // or'ed into the type: the header maps
+                                // the file by extents (see below)
 #define NO_PATH_SECTOR (-1)
 #define INVALID_POINTER 0       // sector 0 is header of bitmap
 //..
@@ -40,18 +55,48 @@
 // The file header data structure can be stored in memory or on disk.
 // When it is on disk, it is stored in a single sector -- this means
 // that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// as one disk sector.  The table only has room for the first
+// RealNumDirect data sectors; the rest are found through a single
+// indirect block (an index block of sector numbers), then a double
+// indirect one (an index block of index blocks), then a triple
+// indirect one, for files of up to MaxFileSize -- a little over 4MB.
+// Index blocks are read through a small cache of their own, so
+// that looking up a sector of a big file seldom costs a disk read
+// per level.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
 // reading it from disk.
+//
+// A file system formatted with extents (-extents) maps its files the
+// other way: by runs of consecutive sectors, "extents", each a start
+// sector and a length, so that a contiguous file needs only a single
+// entry.  The header has room for NumRootExtents of them.  A file
+// with more has an extent tree: the header's entries then point to
+// tree blocks, each holding ExtentsPerBlock entries for the level
+// below -- with the number of data sectors under each, so that a
+// lookup reads one block per level, through the index block cache --
+// and the bottom level holds the extents themselves.  Files only grow and shrink at the end, so the
+// tree is kept full from the left, and rebuilt when the file changes
+// size.
+
+class Extent {
+  public:
+    int start;                  // first sector (of data, or of a tree
+                                // block)
+    int length;                 // how many data sectors; 0 if unused
+};
+
+#define NumRootExtents  ((NumDirect - 1) / 2)
+#define ExtentsPerBlock ((int) (SectorSize / sizeof(Extent)))
 
 class FileHeader {
   public:
-    bool Allocate(BitMap *bitMap, int fileSize);// Initialize a file header, 
+    bool Allocate(BitMap *bitMap, int fileSize, int goal = 0);
+						// Initialize a file header, 
 						//  including allocating space 
-						//  on disk for the file data
+						//  on disk for the file data,
+						//  starting near sector "goal"
     void Deallocate(BitMap *bitMap);  		// De-allocate this file's 
 						//  data blocks
 
@@ -69,7 +114,8 @@ class FileHeader {
     void Print(bool printContent);			// Print the contents of the file.
     //.
     void initialize(int fileType, int filePathSector);
-    int getFileType(){return type;}
+    int getFileType(){return type & ~EXTENT_LAYOUT;}
+    bool UsesExtents(){return (type & EXTENT_LAYOUT) != 0;}
     int getCreatTime(){return creatTime;}
     int getLastAccessTime(){return lastAccessTime;}
     void setLastAccessTime(int time){lastAccessTime = time;}
@@ -79,26 +125,53 @@ class FileHeader {
     void updateLastModifyTime(){lastModifyTime = time(NULL);}
     int getPathSector(){return pathSector;}
     void setPathSector(int filePathSector){pathSector = filePathSector;}
-    int IndexToSector(int idx, int * firstLevelSector);
-    int *IndexToLocation(int idx, int * firstLevelSector);
-    int *getFirstLevelSector();
-    bool deleteFirstLevelSector(int * firstLevelSector);
+    int IndexToSector(int idx);         // the idx'th data sector
+    int DataSectors(int *sectors);      // the block map, decoded
+    int DiskSectors(int *sectors);      // the data and index sectors
     bool extendSize(int numextendBytes, BitMap * freeMap);
     bool shrinkSize(int numShrinkBytes, BitMap * freeMap);
+    static int SectorsFor(int fileSize);        // data and index sectors
+    static int IndexBlocks(int numDataSectors); // ... the index ones
+    static int AllocateSector(BitMap *freeMap, int goal, int runLength = 1);
+                                        // a free sector near "goal",
+                                        // starting a run of runLength
+                                        // free ones, if there is one
+    static bool allocateNear;           // FALSE: plain first fit, as
+                                        // before track groups (for
+                                        // benchmarks)
+    static bool useExtents;             // new files are mapped by extents;
+                                        // chosen when the disk is formatted
+    static int TreeBlocks(int numExtents, int *depth = NULL);
+                                        // extent tree blocks it takes
     //..
   private:
     int numBytes;			// Number of bytes in the file
     int numSectors;			// Number of data sectors in the file
-    int dataSectors[NumDirect];		// Disk sector numbers for each data 
+    union {
+        int dataSectors[NumDirect];	// Disk sector numbers for each data 
 					// block in the file
+        struct {
+            int depth;                  // levels of tree blocks
+            Extent extents[NumRootExtents];
+        } ext;                          // ... or, with EXTENT_LAYOUT, the
+                                        // root of the extent tree
+    };
     //.
     int type;       //REGULAR_FILE or DIRECTORY
     int creatTime;
     int lastAccessTime;
     int lastModifyTime;
     int pathSector; //father directory's header sector // can be NO_PATH_SECTOR
-    bool extendSector(int numExtendSectors, int * firstLevelSector, BitMap * freeMap);
-    bool shrinkSector(int numShrinkSectors, int * firstLevelSector, BitMap * freeMap);
+    bool extendSector(int numExtendSectors, BitMap * freeMap, int goal);
+    bool shrinkSector(int numShrinkSectors, BitMap * freeMap);
+    int *Locate(int idx, int *depth, int *offset);
+    void AppendSector(int idx, BitMap *freeMap, int *goal, int runLength);
+    void RemoveSector(int idx, BitMap *freeMap);
+    int LoadExtents(Extent *extents, int *tree, int *numTree);
+    void StoreExtents(Extent *extents, int count, int *tree, int numTree,
+                      BitMap *freeMap, int goal);
+    bool extendExtents(int numExtendSectors, BitMap *freeMap, int goal);
+    void shrinkExtents(int numShrinkSectors, BitMap *freeMap);
     
     //..
 };
@@ -66,7 +66,7 @@
 #define NumDirEntries 		10
 #define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
 
-static Lock sectorAllocateLock("super lock");
+static Lock sectorAllocateLock("sector allocate lock");
 //static Lock dirAllocateLock;
 
 //----------------------------------------------------------------------
@@ -80,12 +80,15 @@ static Lock sectorAllocateLock("super lock");
 //	representing the bitmap and the directory.
 //
 //	"format" -- should we initialize the disk?
+//	"extents" -- if so, should its files be mapped by extents?  If
+//		not, the root directory's header says whether they are
 //----------------------------------------------------------------------
 
-FileSystem::FileSystem(bool format)
+FileSystem::FileSystem(bool format, bool extents)
 { 
     DEBUG('f', "Initializing the file system.\n");
     if (format) {
+        FileHeader::useExtents = extents;
         BitMap *freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
 	FileHeader *mapHdr = new FileHeader;
@@ -148,10 +151,21 @@ FileSystem::FileSystem(bool format)
     } else {
     // if we are not formatting the disk, just open the files representing
     // the bitmap and directory; these are left open while Nachos is running
+        FileHeader *rootHdr = new FileHeader;
+        rootHdr->FetchFrom(DirectorySector);
+        FileHeader::useExtents = rootHdr->UsesExtents();
+        delete rootHdr;
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        if (freeMapFile->Length() != FreeMapFileSize) {
+            fprintf(stderr, "The file system maps %d sectors, but the "
+                "disk has %d: format it again with -f\n",
+                freeMapFile->Length() * BitsInByte, NumSectors);
+            ASSERT(freeMapFile->Length() == FreeMapFileSize);
+        }
     }
     currentDirHeaderSector = DirectorySector;
+    fragmentMarks = NULL;
 }
 
 FileSystem::~FileSystem(){
@@ -421,6 +435,30 @@ void FileSystem::testMaxFileSize(void *freeMap_, void * directory_){
     delete fileHdr;
 }
 
+//----------------------------------------------------------------------
+// EmptiestGroup
+// 	Return the track group with the most free sectors, where a new
+//	directory should go.  When the disk is not a whole number of
+//	groups, the last one is short; NumClearIn stops at the end of
+//	the map, so only its own sectors count.
+//----------------------------------------------------------------------
+
+static int
+EmptiestGroup(BitMap *freeMap)
+{
+    int best = 0, bestClear = -1;
+
+    for (int g = 0; g < NumGroups; g++) {
+        int clear = freeMap->NumClearIn(g * SectorsPerGroup, SectorsPerGroup);
+
+        if (clear > bestClear) {
+            best = g;
+            bestClear = clear;
+        }
+    }
+    return best;
+}
+
 //mkdir at current dir
 bool FileSystem::mkdir(char * name){
     DEBUG('t', "Enter FileSystem::mkdir.\n");
@@ -444,14 +482,21 @@ bool FileSystem::CreateFileOrDir(char * name, int initialSize, int fileType){
 
     bool success = TRUE;
 
-    int headerSector = freeMap->Find();
+    // the header goes at the start of a run long enough for the whole
+    // file, in the parent's group -- or, for a directory, in the
+    // emptiest group, so that directories, and the files that will go
+    // in them, spread out over the disk
+    int goal = (fileType == DIRECTORY) ? EmptiestGroup(freeMap) * SectorsPerGroup
+                                       : currentDirHeaderSector;
+    int headerSector = FileHeader::AllocateSector(freeMap, goal,
+                                    1 + FileHeader::SectorsFor(initialSize));
     if (headerSector < 0){
         success = FALSE;
     } else if (!currentDir->Add(name, headerSector)){
         success = FALSE;
     } else {
         FileHeader *hdr = new FileHeader;
-        if (!hdr->Allocate(freeMap, initialSize)){
+        if (!hdr->Allocate(freeMap, initialSize, headerSector + 1)){
             success = FALSE;
             currentDir->Remove(name);
         } else {
@@ -501,6 +546,9 @@ bool FileSystem::rmdir(char * name){
             dstHdr->FetchFrom(dstHeaderSector);
             dstHdr->Deallocate(freeMap);
             freeMap->Clear(dstHeaderSector);
+            // the header sector is free now; closing dstDirFile must
+            // not write the in-memory header back to it
+            ((FileACEntry *) fileACList->getACEntry(dstHeaderSector))->hdrDirty = FALSE;
             currentDir->Remove(name);
 
             freeMap->WriteBack(freeMapFile);
@@ -636,8 +684,6 @@ bool FileSystem::ExtendSize(char * name, int numExtendBytes){
         sectorAllocateLock.Release();
        return FALSE;             // file not found 
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
     // although we don't want to read or write the file, 
     // open the file when try to extend size. the reason is
     // extending size is also some kind of writing.
@@ -645,6 +691,8 @@ bool FileSystem::ExtendSize(char * name, int numExtendBytes){
     //. check if any thread is using this file
     FileACEntry * entry = (FileACEntry *) fileACList->getACEntry(sector);
     ASSERT(entry != NULL);
+    fileHdr = entry->hdr;       // the in-memory header every OpenFile
+                                // of the file shares
     entry->readWriteLock->BeforeWrite();
 
     freeMap = new BitMap(NumSectors);
@@ -654,7 +702,10 @@ bool FileSystem::ExtendSize(char * name, int numExtendBytes){
     bool success = fileHdr->extendSize(numExtendBytes, freeMap);
 
     if (success){
-        freeMap->WriteBack(freeMapFile);        // flush to disk
+        entry->Modified();                      // the new sectors are
+        entry->WriteBackHeader();               // no use unless the
+        freeMap->WriteBack(freeMapFile);        // header lists them
+        entry->SetBlockMap();
         printf("File '%s' size extension succeeded.\n", name);
     } else {
         printf("File '%s' extended failed.\n", name);
@@ -666,7 +717,6 @@ bool FileSystem::ExtendSize(char * name, int numExtendBytes){
 
     delete freeMap;
     delete dstFile;
-    delete fileHdr;
     delete directory;
     delete currentDirFile;
     DEBUG('t', "Leave FileSystem::ExtendSize.\n");
@@ -691,8 +741,6 @@ bool FileSystem::ShrinkSize(char * name, int numShrinkBytes){
         sectorAllocateLock.Release();
        return FALSE;             // file not found 
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
     // although we don't want to read or write the file, 
     // open the file when try to shrink size. the reason is
     // shrinking size is also some kind of writing.
@@ -700,6 +748,8 @@ bool FileSystem::ShrinkSize(char * name, int numShrinkBytes){
     //. check if any thread is using this file
     FileACEntry * entry = (FileACEntry *) fileACList->getACEntry(sector);
     ASSERT(entry != NULL);
+    fileHdr = entry->hdr;       // the in-memory header every OpenFile
+                                // of the file shares
     entry->readWriteLock->BeforeWrite();
 
     freeMap = new BitMap(NumSectors);
@@ -709,7 +759,10 @@ bool FileSystem::ShrinkSize(char * name, int numShrinkBytes){
     bool success = fileHdr->shrinkSize(numShrinkBytes, freeMap);
 
     if (success){
-        freeMap->WriteBack(freeMapFile);        // flush to disk
+        entry->Modified();                      // flush to disk
+        entry->WriteBackHeader();
+        freeMap->WriteBack(freeMapFile);
+        entry->SetBlockMap();
         printf("File '%s' size shrinking succeeded.\n", name);
     } else {
         printf("File '%s' shrinking failed.\n", name);
@@ -720,13 +773,63 @@ bool FileSystem::ShrinkSize(char * name, int numShrinkBytes){
 
     delete freeMap;
     delete dstFile;
-    delete fileHdr;
     delete directory;
     delete currentDirFile;
     DEBUG('t', "Leave FileSystem::ShrinkSize.\n");
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::testNumFree
+// 	Return how many sectors are free, so that tests can check that
+//	removing or shrinking a file gives back everything it had.
+//----------------------------------------------------------------------
+
+int FileSystem::testNumFree(){
+    BitMap *freeMap = new BitMap(NumSectors);
+    int numFree;
+
+    sectorAllocateLock.Acquire();
+    freeMap->FetchFrom(freeMapFile);
+    numFree = freeMap->NumClear();
+    sectorAllocateLock.Release();
+    delete freeMap;
+    return numFree;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::testFragment
+// 	Make the disk look fragmented, for allocation benchmarks: mark
+//	three out of every four free sectors in the first half of the
+//	disk as in use, so that what is left there is scattered single
+//	sectors.  With "fragment" FALSE, free them again.
+//----------------------------------------------------------------------
+
+void FileSystem::testFragment(bool fragment){
+    sectorAllocateLock.Acquire();
+    BitMap *freeMap = new BitMap(NumSectors);
+    BitMap *marks = (BitMap *) fragmentMarks;
+    freeMap->FetchFrom(freeMapFile);
+    if (fragment && marks == NULL){
+        marks = new BitMap(NumSectors);
+        for (int i = 0, n = 0; i < NumSectors / 2; i++)
+            if (!freeMap->Test(i) && (n++ % 4) != 0){
+                freeMap->Mark(i);
+                marks->Mark(i);
+            }
+    } else if (!fragment && marks != NULL){
+        for (int i = 0; i < NumSectors; i++)
+            if (marks->Test(i))
+                freeMap->Clear(i);
+        delete marks;
+        marks = NULL;
+    }
+    fragmentMarks = marks;
+    freeMap->WriteBack(freeMapFile);
+    sectorAllocateLock.Release();
+    delete freeMap;
+}
+
 // asynchronous
 // concurrent op is not surpported.
 void FileSystem::testExtensibleFileSize(){
@@ -43,7 +43,7 @@
 				// implementation is available
 class FileSystem {
   public:
-    FileSystem(bool format) {}
+    FileSystem(bool format, bool extents = FALSE) {}
 
     bool Create(char *name, int initialSize) { 
 	int fileDescriptor = OpenForWrite(name);
@@ -80,12 +80,15 @@ class FileSystem {
 #else // FILESYS
 class FileSystem {
   public:
-    FileSystem(bool format);		// Initialize the file system.
+    FileSystem(bool format, bool extents = FALSE);
+					// Initialize the file system.
 					// Must be called *after* "synchDisk" 
 					// has been initialized.
     					// If "format", there is nothing on
 					// the disk, so initialize the directory
     					// and the bitmap of free blocks.
+					// If "extents" too, files will be
+					// mapped by extents (see filehdr.h)
     ~FileSystem();
     bool Create(char *name, int initialSize);  	
 					// Create a file (UNIX creat)
@@ -121,6 +124,10 @@ class FileSystem {
     void testDirOps();
     void testExtensibleFileSize();
     void testConcurrentReadWrite();
+    void testFragment(bool fragment);   // take most free sectors in the
+                                        // first half of the disk, or
+                                        // give them back
+    int testNumFree();                  // how many sectors are free
     bool isReal;
 
     bool Copy(char * src, int size, char * dst);
@@ -132,6 +139,7 @@ class FileSystem {
 					// file names, represented as a file
    //.
    int currentDirHeaderSector;    // current directory's header sector
+   void *fragmentMarks;           // BitMap of the sectors testFragment took
    //..
 };
 
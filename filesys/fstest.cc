@@ -6,7 +6,8 @@
 //	   Print -- cat the contents of a Nachos file 
 //	   Perftest -- a stress test for the Nachos file system
 //		read and write a really large file in tiny chunks
-//		(won't work on baseline system!)
+//		(won't work on baseline system!), and time sequential
+//		reads in chunks of several sizes
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -19,6 +20,8 @@
 #include "system.h"
 #include "thread.h"
 #include "disk.h"
+#include "synch.h"
+#include "filehdr.h"
 #include "stats.h"
 
 #define TransferSize 	10 	// make it small, just to be difficult
@@ -169,6 +172,314 @@ FileRead()
     delete openFile;	// close file
 }
 
+//----------------------------------------------------------------------
+// ChunkedRead
+// 	Read a file sequentially in chunks of a given size, starting with
+//	an empty buffer cache, and print how long it took per KB.  Small
+//	chunks mean many reads per sector; read-ahead should keep them
+//	from costing a disk request each.
+//----------------------------------------------------------------------
+
+#define ReadTestName	"ReadTest"
+#define ReadTestSize	min((int) MaxFileSize, 32 * 1024)
+
+static void
+ChunkedRead(int chunkSize)
+{
+    OpenFile *openFile;
+    char *buffer = new char[chunkSize];
+    int i, numBytes, start, ticks;
+
+    if ((openFile = fileSystem->Open(ReadTestName)) == NULL) {
+	printf("Perf test: unable to open file %s\n", ReadTestName);
+	delete [] buffer;
+	return;
+    }
+    synchDisk->Invalidate();
+    start = stats->totalTicks;
+    for (i = 0; i < ReadTestSize; i += numBytes) {
+	numBytes = openFile->Read(buffer, chunkSize);
+	if (numBytes <= 0 || buffer[0] != Contents[(i % SectorSize) % ContentSize]) {
+	    printf("Perf test: unable to read %s\n", ReadTestName);
+	    break;
+	}
+    }
+    ticks = stats->totalTicks - start;
+    printf("Sequential read of %d bytes in %d byte chunks: %d ticks, "
+	"%.1f ticks/KB\n", i, chunkSize, ticks,
+	ticks * 1024.0 / max(i, 1));
+    delete [] buffer;
+    delete openFile;	// close file
+}
+
+//----------------------------------------------------------------------
+// ReadTest
+// 	Write a file, a sector at a time, each sector holding Contents
+//	over and over; then read it back in chunks of several sizes.
+//	Writes do not extend a file, so it is created full size.
+//----------------------------------------------------------------------
+
+static void
+ReadTest()
+{
+    static int chunkSizes[] = { 16, 128, 512, 2048 };
+    OpenFile *openFile;
+    char sector[SectorSize];
+    int i;
+
+    for (i = 0; i < SectorSize; i++)
+	sector[i] = Contents[i % ContentSize];
+    if (!fileSystem->Create(ReadTestName, ReadTestSize)) {
+	printf("Perf test: can't create %s\n", ReadTestName);
+	return;
+    }
+    if ((openFile = fileSystem->Open(ReadTestName)) == NULL) {
+	printf("Perf test: unable to open %s\n", ReadTestName);
+	return;
+    }
+    for (i = 0; i < ReadTestSize; i += SectorSize)
+	if (openFile->Write(sector, SectorSize) < SectorSize) {
+	    printf("Perf test: unable to write %s\n", ReadTestName);
+	    break;
+	}
+    delete openFile;
+
+    for (i = 0; i < (int) (sizeof(chunkSizes) / sizeof(int)); i++)
+	ChunkedRead(chunkSizes[i]);
+    if (!fileSystem->Remove(ReadTestName))
+	printf("Perf test: unable to remove %s\n", ReadTestName);
+}
+
+//----------------------------------------------------------------------
+// FragmentedTest
+// 	Measure sector allocation on a fragmented disk: take most of the
+//	free sectors in the first half of the disk (see
+//	FileSystem::testFragment), then write a file a sector at a time,
+//	sync it, and read it back with a cold cache.  Done with plain
+//	first fit, which scatters the file over what is left in the first
+//	half, and then with track group allocation, which finds it a run
+//	of free sectors.
+//----------------------------------------------------------------------
+
+#define FragTestName	"FragTest"
+#define FragTestSize	min((int) MaxFileSize, 7 * 1024)
+
+static void
+FragmentedTest()
+{
+    static char *policyNames[] = { "first fit", "track groups" };
+    OpenFile *openFile;
+    char sector[SectorSize];
+    int i, p, start, writeTicks, readTicks;
+
+    for (i = 0; i < SectorSize; i++)
+	sector[i] = Contents[i % ContentSize];
+    for (p = 0; p < 2; p++) {
+	FileHeader::allocateNear = (p == 1);
+	fileSystem->testFragment(TRUE);
+	if (!fileSystem->Create(FragTestName, FragTestSize)
+		|| (openFile = fileSystem->Open(FragTestName)) == NULL) {
+	    printf("Perf test: can't create %s\n", FragTestName);
+	    fileSystem->testFragment(FALSE);
+	    break;
+	}
+	start = stats->totalTicks;
+	for (i = 0; i < FragTestSize; i += SectorSize)
+	    openFile->Write(sector, SectorSize);
+	openFile->Sync();
+	writeTicks = stats->totalTicks - start;
+
+	synchDisk->Invalidate();
+	openFile->Seek(0);
+	start = stats->totalTicks;
+	for (i = 0; i < FragTestSize; i += SectorSize)
+	    if (openFile->Read(sector, SectorSize) < SectorSize) {
+		printf("Perf test: unable to read %s\n", FragTestName);
+		break;
+	    }
+	readTicks = stats->totalTicks - start;
+	delete openFile;
+
+	fileSystem->testFragment(FALSE);
+	if (!fileSystem->Remove(FragTestName))
+	    printf("Perf test: unable to remove %s\n", FragTestName);
+	printf("Fragmented disk, %s: %d byte file written in %d ticks, "
+	    "read in %d ticks\n", policyNames[p], FragTestSize, writeTicks,
+	    readTicks);
+    }
+    FileHeader::allocateNear = TRUE;
+}
+
+//----------------------------------------------------------------------
+// LargeFileTest
+// 	Write a file that needs the double -- and, on a disk of 68 tracks
+//	or more (-diskTracks), the triple -- indirect blocks, a sector at
+//	a time, each sector stamped with its number; then read random
+//	sectors of it back with a cold buffer cache, and check them.
+//	Print how long it took, and how often looking up a sector had to
+//	read an index block from disk.
+//
+//	Then cut the file short, to partway into the blocks under the
+//	double indirect one, read what is left back, and remove it;
+//	check that each step gives back exactly the data and index
+//	sectors the file no longer needs.
+//----------------------------------------------------------------------
+
+#define LargeTestName	"LargeTest"
+#define LargeTestSize	min((int) MaxFileSize, (NumSectors / 2) * SectorSize)
+#define LargeTestReads	200
+#define LargeTestCut	(RealNumDirect + NumFirstLevel + 3 * NumFirstLevel + 5)
+					// sectors left after the cut
+
+static bool
+LargeFileCheck(OpenFile *openFile, int numSectors)
+{
+    char sector[SectorSize];
+
+    for (int i = 0; i < numSectors; i++)
+	if (openFile->ReadAt(sector, SectorSize, i * SectorSize) < SectorSize
+		|| *(int *) sector != i)
+	    return FALSE;
+    return (openFile->ReadAt(sector, SectorSize, numSectors * SectorSize)
+		== 0);
+}
+
+static void
+LargeFileTest()
+{
+    OpenFile *openFile;
+    char sector[SectorSize];
+    int i, which, start, writeTicks, readTicks, misses, numFree, freed;
+    int numSectors = LargeTestSize / SectorSize;
+    int cut = min(numSectors, (int) LargeTestCut);
+
+    for (i = 0; i < SectorSize; i++)
+	sector[i] = Contents[i % ContentSize];
+    numFree = fileSystem->testNumFree();
+    if (!fileSystem->Create(LargeTestName, LargeTestSize)
+	    || (openFile = fileSystem->Open(LargeTestName)) == NULL) {
+	printf("Perf test: can't create %s\n", LargeTestName);
+	return;
+    }
+    start = stats->totalTicks;
+    for (i = 0; i < numSectors; i++) {
+	*(int *) sector = i;
+	if (openFile->Write(sector, SectorSize) < SectorSize) {
+	    printf("Perf test: unable to write %s\n", LargeTestName);
+	    break;
+	}
+    }
+    openFile->Sync();
+    writeTicks = stats->totalTicks - start;
+
+    synchDisk->Invalidate();
+    misses = stats->numIndirectMisses;
+    start = stats->totalTicks;
+    for (i = 0; i < LargeTestReads; i++) {
+	which = Random() % numSectors;
+	if (openFile->ReadAt(sector, SectorSize, which * SectorSize)
+		< SectorSize || *(int *) sector != which) {
+	    printf("Perf test: unable to read %s\n", LargeTestName);
+	    break;
+	}
+    }
+    readTicks = stats->totalTicks - start;
+    misses = stats->numIndirectMisses - misses;
+    printf("Large file, %d bytes with %d index blocks: written in %d ticks; "
+	"%d random sector reads in %d ticks, %d index block misses\n",
+	LargeTestSize, FileHeader::IndexBlocks(numSectors), writeTicks,
+	LargeTestReads, readTicks, misses);
+
+    freed = fileSystem->testNumFree();
+    if (!fileSystem->ShrinkSize(LargeTestName, (numSectors - cut) * SectorSize)
+	    || !LargeFileCheck(openFile, cut))
+	printf("Perf test: unable to cut %s short\n", LargeTestName);
+    freed = fileSystem->testNumFree() - freed;
+    if (freed != numSectors - cut + FileHeader::IndexBlocks(numSectors)
+		- FileHeader::IndexBlocks(cut))
+	printf("Perf test: cutting %s short freed %d sectors\n",
+	    LargeTestName, freed);
+    delete openFile;
+
+    if (!fileSystem->Remove(LargeTestName))
+	printf("Perf test: unable to remove %s\n", LargeTestName);
+    if (fileSystem->testNumFree() != numFree)
+	printf("Perf test: removing %s left %d sectors in use\n",
+	    LargeTestName, numFree - fileSystem->testNumFree());
+}
+
+//----------------------------------------------------------------------
+// SchedTest
+// 	Measure the disk scheduler: SchedThreads threads each read
+//	SchedReads random sectors, one at a time, straight from the disk
+//	(around the buffer cache, if any), so up to SchedThreads requests
+//	are outstanding at once.  Done under FIFO and then under C-LOOK,
+//	with the same sectors; print the mean and 99th percentile time
+//	from asking for a sector to getting it.
+//
+//	Implemented as two routines:
+//	  RandomReader -- the body of each thread
+//	  SchedTest -- overall control
+//----------------------------------------------------------------------
+
+#define SchedThreads	8
+#define SchedReads	40
+#define SchedTotal	(SchedThreads * SchedReads)
+
+static int schedSectors[SchedTotal];	// what each read asks for
+static int schedLatency[SchedTotal];	// ... and how long it took
+static Semaphore *schedDone;		// V'ed by each reader as it ends
+
+static void
+RandomReader(int which)
+{
+    char data[SectorSize];
+    int i, start;
+
+    for (i = which * SchedReads; i < (which + 1) * SchedReads; i++) {
+	start = stats->totalTicks;
+	synchDisk->SynchDisk::ReadSector(schedSectors[i], data);
+	schedLatency[i] = stats->totalTicks - start;
+    }
+    schedDone->V();
+}
+
+static void
+SchedTest()
+{
+    static DiskPolicy policies[] = { DiskFIFO, DiskCLOOK };
+    static char *policyNames[] = { "FIFO", "C-LOOK" };
+    int i, j, p, latency, total;
+
+    for (i = 0; i < SchedTotal; i++)
+	schedSectors[i] = Random() % NumSectors;
+    schedDone = new Semaphore("sched test", 0);
+    for (p = 0; p < 2; p++) {
+	synchDisk->SetPolicy(policies[p]);
+	for (i = 0; i < SchedThreads; i++) {
+	    Thread *t = createThread("random reader");
+	    ASSERT(t != NULL);
+	    t->Fork(RandomReader, i);
+	}
+	for (i = 0; i < SchedThreads; i++)
+	    schedDone->P();
+
+	total = 0;			// insertion sort, for the percentile
+	for (i = 1; i < SchedTotal; i++) {
+	    latency = schedLatency[i];
+	    for (j = i; j > 0 && schedLatency[j - 1] > latency; j--)
+		schedLatency[j] = schedLatency[j - 1];
+	    schedLatency[j] = latency;
+	}
+	for (i = 0; i < SchedTotal; i++)
+	    total += schedLatency[i];
+	printf("%d random reads by %d threads, %s: mean %d ticks, "
+	    "p99 %d ticks\n", SchedTotal, SchedThreads, policyNames[p],
+	    total / SchedTotal, schedLatency[(SchedTotal * 99) / 100]);
+    }
+    delete schedDone;			// C-LOOK, the default, stays on
+}
+
 void
 PerformanceTest()
 {
@@ -180,6 +491,10 @@ PerformanceTest()
       printf("Perf test: unable to remove %s\n", FileName);
       return;
     }
+    ReadTest();
+    FragmentedTest();
+    LargeFileTest();
+    SchedTest();
     stats->Print();
 }
 
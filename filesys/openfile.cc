@@ -19,6 +19,20 @@
 #include <strings.h>
 #endif
 
+//----------------------------------------------------------------------
+// ReadAheadWork
+// 	Dummy function because C++ can't indirectly invoke member
+//	functions.  Run by the work queue.
+//
+//	"arg" is the OpenFile, cast to an int.
+//----------------------------------------------------------------------
+
+static void
+ReadAheadWork(int arg)
+{
+    ((OpenFile *) arg)->ReadAhead();
+}
+
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
@@ -30,23 +44,34 @@
 OpenFile::OpenFile(int sector)
 { 
     DEBUG('f', "Enter OpenFile::OpenFile %d\n", sector);
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
     seekPosition = 0;
     headerSector = sector;
+    lastReadSector = -1;		// reading from the start is sequential
+    raWindow = raEnd = 0;
+    raCount = 0;
+    raWork = new WorkItem(ReadAheadWork, (int) this);
+    raUsed = FALSE;
     fileACList->UpdateFileACListWhenOpenFile(headerSector);
+    acEntry = (FileACEntry *) fileACList->getACEntry(headerSector);
+    hdr = acEntry->hdr;			// shared with the file's other
+					// OpenFiles
     DEBUG('f', "Leave OpenFile::OpenFile\n");
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	A read-ahead that is queued or running still uses this object, so
+//	wait for it first.  The header is shared; the last one to close
+//	the file writes it back, if need be.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
+    if (raUsed)
+	workQueue->Flush();
+    delete raWork;
     fileACList->UpdateFileACListWhenCloseFile(headerSector);
-    delete hdr;
 }
 
 //----------------------------------------------------------------------
@@ -111,6 +136,10 @@ OpenFile::Write(char *into, int numBytes)
 //	   in the data that will be modified, and write back all the full
 //	   or partial sectors that are part of the request.
 //
+//	Sectors that are consecutive on disk -- an extent, or a run
+//	allocated in one go -- are read or written with a single request
+//	per track (see RunLength).
+//
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
 //	"numBytes" -- the number of bytes to transfer
@@ -122,7 +151,7 @@ int
 OpenFile::ReadAt(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int i, n, firstSector, lastSector, numSectors;
     char *buf;
 
     if ((numBytes <= 0) || (position >= fileLength))
@@ -139,18 +168,18 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 
     // read in all the full and partial sectors that we need
     fileSystem->beforeRead(headerSector);
-    //.Only one sector will be writen. Sector synchronization is provided by synchDisk
-    hdr->updateLastAccessTime();    // problematic, because it is "write"
-    hdr->WriteBack(headerSector);
-    //..
+    acEntry->Accessed();		// the header is written back later
     buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	{
-        synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
+    for (i = firstSector; i <= lastSector; i += n) {
+        n = RunLength(i, lastSector);
+        synchDisk->ReadSectors(acEntry->SectorOf(i), n,
 					&buf[(i - firstSector) * SectorSize]);
         //for test concur RW
         //currentThread->Yield();
         //printf("askdaksdasdjalsdjalsdjlasjdlkasjdl\n");
     }
+    if (cacheSize > 0)			// nowhere to read ahead into, if not
+	StartReadAhead(firstSector, lastSector);
     fileSystem->afterRead(headerSector);
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
@@ -162,7 +191,7 @@ int
 OpenFile::WriteAt(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int i, n, firstSector, lastSector, numSectors;
     bool firstAligned, lastAligned;
     char *buf;
 
@@ -196,13 +225,10 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 
 // write modified sectors back
     fileSystem->beforeWrite(headerSector);//..
-    //. Only one sector will be writen. 
-    hdr->updateLastAccessTime();
-    hdr->updateLastModifyTime();
-    hdr->WriteBack(headerSector);
-    //..
-    for (i = firstSector; i <= lastSector; i++)	{
-        synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
+    acEntry->Modified();		// likewise
+    for (i = firstSector; i <= lastSector; i += n) {
+        n = RunLength(i, lastSector);
+        synchDisk->WriteSectors(acEntry->SectorOf(i), n,
 					&buf[(i - firstSector) * SectorSize]);
         // for test concur io
         currentThread->Yield();
@@ -212,6 +238,131 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::RunLength
+// 	Return how many of the file's sectors, starting at "first" and
+//	going no further than "last", follow one another on disk without
+//	crossing a track boundary, so that ReadAt and WriteAt can move
+//	them with a single disk request.
+//----------------------------------------------------------------------
+
+int
+OpenFile::RunLength(int first, int last)
+{
+    int sector = acEntry->SectorOf(first), n;
+
+    for (n = 1; first + n <= last && (sector + n) % SectorsPerTrack != 0
+		&& acEntry->SectorOf(first + n) == sector + n; n++)
+	;
+    return n;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::StartReadAhead
+// 	Called after every read, with the sectors it covered (counting
+//	from the start of the file).  If it carried on where the last one
+//	left off, the file is being read sequentially: queue the next
+//	window of sectors to be read into the cache in the background,
+//	so that they are there by the time they are asked for.
+//
+//	The window starts at MinReadAhead sectors, and doubles, up to
+//	MaxReadAhead, each time the reader gets within half a window of
+//	its end -- by then it is reading fast enough to use more.  A
+//	read anywhere else turns read-ahead off, until reading is
+//	sequential again.
+//
+//	The disk sectors to fetch are looked up here, while the caller
+//	still has the file locked for reading, so that the work item
+//	never needs the block map.
+//----------------------------------------------------------------------
+
+void
+OpenFile::StartReadAhead(int firstSector, int lastSector)
+{
+    int fileSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    bool sequential = (firstSector == lastReadSector
+			|| firstSector == lastReadSector + 1);
+    int sectors[MaxReadAhead];
+    int from, to;
+    IntStatus oldLevel;
+
+    lastReadSector = lastSector;
+    if (!sequential) {
+	raWindow = 0;
+	return;
+    }
+    if (raWindow == 0) {
+	raWindow = MinReadAhead;
+	raEnd = lastSector + 1;
+    } else if (raEnd - (lastSector + 1) > raWindow / 2)
+	return;				// still far enough ahead
+    else
+	raWindow = min(2 * raWindow, MaxReadAhead);
+
+    from = max(raEnd, lastSector + 1);
+    to = min(lastSector + 1 + raWindow, fileSectors);
+    if (from >= to)
+	return;
+    raEnd = to;
+    DEBUG('f', "Read-ahead of sectors %d to %d of file %d, window %d\n",
+	from, to - 1, headerSector, raWindow);
+
+    for (int i = from; i < to; i++)
+	sectors[i - from] = acEntry->SectorOf(i);
+
+    oldLevel = interrupt->SetLevel(IntOff);	// the worker reads these
+    if (!raWork->IsPending())
+	raCount = 0;			// else it has not started; add to it
+    for (int i = 0; i < to - from && raCount < 2 * MaxReadAhead; i++)
+	raSectors[raCount++] = sectors[i];
+    workQueue->Queue(raWork);
+    raUsed = TRUE;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Read the sectors StartReadAhead asked for into the cache.  Runs
+//	on the work queue, so the reader does not wait for it; and
+//	Prefetch only starts the disk requests, so the work queue does
+//	not wait for them either.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int sectors[2 * MaxReadAhead];
+    int count = raCount;
+
+    for (int i = 0; i < count; i++)
+	sectors[i] = raSectors[i];
+    raCount = 0;
+    (void) interrupt->SetLevel(oldLevel);
+    synchDisk->Prefetch(sectors, count);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Sync
+// 	Make sure everything written to the file, and its header, has
+//	reached the disk, rather than just the buffer cache.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Sync()
+{
+    int n = divRoundUp(hdr->FileLength(), SectorSize);
+    int *sectors = new int[n + max(FileHeader::IndexBlocks(n),
+                                   FileHeader::TreeBlocks(n)) + 1];
+    int count;
+
+    acEntry->WriteBackHeader();
+    count = hdr->DiskSectors(sectors);
+    sectors[count++] = headerSector;
+    synchDisk->SyncSectors(sectors, count);
+    delete [] sectors;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -52,6 +52,7 @@ class OpenFile {
 		}
 
     int Length() { Lseek(file, 0, 2); return Tell(file); }
+    void Sync() {}			// the UNIX file system's business
     
   private:
     int file;
@@ -60,6 +61,11 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class FileACEntry;
+class WorkItem;
+
+#define MinReadAhead	4		// read-ahead window, in sectors, when
+#define MaxReadAhead	32		// sequential reading starts, and at most
 
 class OpenFile {
   public:
@@ -85,6 +91,10 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+    void Sync();			// Write the file's modified sectors
+					// back to disk, and wait until they
+					// are there -- UNIX fsync
+    void ReadAhead();			// Body of the read-ahead work item
     //.
     int getHeaderSector(){return headerSector;}
     //..
@@ -94,6 +104,23 @@ class OpenFile {
     //.
     int headerSector;
     //..
+    FileACEntry *acEntry;		// Shared with the file's other
+					// OpenFiles; has the block map
+
+    int RunLength(int first, int last);	// How many of the file's sectors,
+					// from "first" to at most "last",
+					// are one run on a track of the disk
+    void StartReadAhead(int firstSector, int lastSector);
+					// Called after each read
+    int lastReadSector;			// Last sector of the previous read
+    int raWindow;			// Sectors to read ahead, 0 while
+					// reading is not sequential
+    int raEnd;				// Sectors before this have been read
+					// ahead, or are being
+    int raSectors[2 * MaxReadAhead];	// Disk sectors for the read-ahead
+    int raCount;			// work item to fetch next
+    WorkItem *raWork;			// Reads them in, on the work queue
+    bool raUsed;			// Has it ever been queued?
 };
 
 #endif // FILESYS
@@ -5,10 +5,16 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Each request records whether it is over, and who is waiting for
+//	it, to synchronize the interrupt handler with that thread; or,
+//	for an asynchronous request, what to call when it is over.  The
+//	physical disk can only handle one operation at a time, so the
+//	others wait in a queue, and the interrupt handler starts the
+//	next one as soon as the disk is done.  The queue is ordered by
+//	the disk scheduling policy: FIFO, or C-LOOK -- the head sweeps
+//	from the lowest sector asked for to the highest, serving
+//	requests on the way, then goes straight back to the lowest, so
+//	seeks are short and no request waits for more than one sweep.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -42,8 +48,10 @@ DiskRequestDone (int arg)
 
 SynchDisk::SynchDisk(char* name)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
+    policy = DiskCLOOK;
+    queue = batch = NULL;
+    headSector = 0;
+    transfer = new char[SectorsPerTrack * SectorSize];
     disk = new Disk(name, DiskRequestDone, (int) this);
 }
 
@@ -57,8 +65,7 @@ SynchDisk::~SynchDisk()
 {
     DEBUG('f', "Thread %d enter SynchDisk::~SynchDisk.\n", currentThread->getTid());
     delete disk;
-    delete lock;
-    delete semaphore;
+    delete [] transfer;
     DEBUG('f', "Thread %d leave SynchDisk::~SynchDisk.\n", currentThread->getTid());
 }
 
@@ -74,12 +81,7 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    DEBUG('f', "Thread %d enter SynchDisk::ReadSector.\n", currentThread->getTid());
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    DEBUG('f', "Thread %d leave SynchDisk::ReadSector.\n", currentThread->getTid());
-    lock->Release();
+    Submit(sectorNumber, 1, data, FALSE);
 }
 
 //----------------------------------------------------------------------
@@ -94,135 +96,307 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    DEBUG('f', "Thread %d enter SynchDisk::WriteSector.\n", currentThread->getTid());
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    DEBUG('f', "Thread %d leave SynchDisk::WriteSector.\n", currentThread->getTid());
-    lock->Release();
+    Submit(sectorNumber, 1, data, TRUE);
 }
 
 //----------------------------------------------------------------------
-// SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// SynchDisk::ReadSectors, WriteSectors
+// 	Read/write a run of consecutive sectors with a single disk
+//	request, so that they cost one seek and one rotational delay
+//	between them.  Return only after all of them have been
+//	transferred.
+//
+//	"firstSector" -- the first disk sector to be read/written
+//	"count" -- how many; the run must not cross a track boundary
+//	"data" -- the contents of the sectors, one after the other
 //----------------------------------------------------------------------
 
 void
-SynchDisk::RequestDone()
-{ 
-    semaphore->V();
+SynchDisk::ReadSectors(int firstSector, int count, char* data)
+{
+    Submit(firstSector, count, data, FALSE);
 }
 
-DiskCacheEntry::DiskCacheEntry(){
-    data = new char[SectorSize];
-    timeStamp = 0;
-    inUse = FALSE;
-    dirty = FALSE;
+void
+SynchDisk::WriteSectors(int firstSector, int count, char* data)
+{
+    Submit(firstSector, count, data, TRUE);
 }
-DiskCacheEntry::~DiskCacheEntry(){
-    delete data;
 
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectorsAsync, WriteSectorsAsync
+// 	Start reading/writing a run of consecutive sectors, and return
+//	without waiting for the disk.  The caller gets a handle for the
+//	request, which it must eventually pass to WaitRequest -- unless
+//	it gave a callback, in which case the handle is freed once the
+//	callback has been called, at the end of the transfer, by the disk
+//	interrupt handler.
+//
+//	"firstSector" -- the first disk sector to be read/written
+//	"count" -- how many; the run must not cross a track boundary
+//	"data" -- the contents of the sectors, one after the other; must
+//		not be touched until the transfer is over
+//	"callback" -- if not NULL, called as (*callback)(arg) when the
+//		transfer is over, with interrupts disabled; it must not
+//		wait, though it may start other requests
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::ReadSectorsAsync(int firstSector, int count, char* data,
+			    VoidFunctionPtr callback, int arg)
+{
+    return SubmitAsync(firstSector, count, data, FALSE, callback, arg);
 }
 
-CacheSynchDisk::CacheSynchDisk(char * name):SynchDisk(name){
-    readWriteLock = new ReadWriteLock("CacheSynchDisk");
+DiskRequest *
+SynchDisk::WriteSectorsAsync(int firstSector, int count, char* data,
+			     VoidFunctionPtr callback, int arg)
+{
+    return SubmitAsync(firstSector, count, data, TRUE, callback, arg);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WaitRequest
+// 	Wait until a request started by ReadSectorsAsync or
+//	WriteSectorsAsync, without a callback, is done; then free its
+//	handle.  Only one thread may wait for a given request.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WaitRequest(DiskRequest *request)
+{
+    ASSERT(request->callback == NULL);
+    Wait(request);
+    delete request;
 }
-CacheSynchDisk::~CacheSynchDisk(){
-    DEBUG('f', "Thread %d enter CacheSynchDisk::~CacheSynchDisk.\n", currentThread->getTid());
-    delete readWriteLock;
-    DEBUG('f', "Thread %d leave CacheSynchDisk::~CacheSynchDisk.\n", currentThread->getTid());
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Queue a request and wait until it is done.  The request is on
+//	our stack, since we are here until it is over.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Submit(int sectorNumber, int count, char* data, bool writing)
+{
+    DiskRequest request;
+
+    request.sector = sectorNumber;
+    request.count = count;
+    request.data = data;
+    request.writing = writing;
+    request.callback = NULL;
+    Enqueue(&request);
+    Wait(&request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SubmitAsync
+// 	Queue a new request, and return it without waiting.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::SubmitAsync(int sectorNumber, int count, char* data,
+		       bool writing, VoidFunctionPtr callback, int arg)
+{
+    DiskRequest *request = new DiskRequest;
+
+    request->sector = sectorNumber;
+    request->count = count;
+    request->data = data;
+    request->writing = writing;
+    request->callback = callback;
+    request->arg = arg;
+    Enqueue(request);
+    return request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Enqueue
+// 	Put a request at the end of the queue, and start the disk on it
+//	if the disk is idle.  Can be called from a request's callback,
+//	in the interrupt handler.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Enqueue(DiskRequest *request)
+{
+    DiskRequest **ptr;
+    IntStatus oldLevel;
+
+    ASSERT(request->count >= 1 && (request->sector % SectorsPerTrack)
+	+ request->count <= SectorsPerTrack);
+    request->finished = FALSE;
+    request->waiter = NULL;
+    request->next = NULL;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    DEBUG('f', "Queueing a %s of sectors %d to %d.\n",
+	request->writing ? "write" : "read", request->sector,
+	request->sector + request->count - 1);
+    for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next)
+	;
+    *ptr = request;
+    if (batch == NULL)
+	StartNext();
+    (void) interrupt->SetLevel(oldLevel);
 }
-void CacheSynchDisk::WriteAllBack(){
-    DEBUG('f', "Thread %d enter CacheSynchDisk::WriteAllBack.\n", currentThread->getTid());
-    for (int i = 0; i < DISK_CACHE_SIZE; ++i){
-        if (cache[i].inUse && cache[i].dirty)
-            SynchDisk::WriteSector(cache[i].sectorNumber, cache[i].data);
+
+//----------------------------------------------------------------------
+// SynchDisk::Wait
+// 	Sleep until a request is over.  Interrupts are disabled while we
+//	look, so RequestDone cannot finish it between our look and our
+//	going to sleep.  Once Nachos is halting, there is no sleeping:
+//	the clock is moved on to the disk's interrupt instead.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Wait(DiskRequest *request)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(request->waiter == NULL);
+    while (!request->finished) {
+	if (interrupt->IsHalting()) {
+	    interrupt->WaitForInterrupt();
+	    continue;
+	}
+	request->waiter = currentThread;
+	currentThread->Sleep();
     }
-    DEBUG('f', "Thread %d leave CacheSynchDisk::WriteAllBack.\n", currentThread->getTid());
+    (void) interrupt->SetLevel(oldLevel);
 }
-//private 
-int CacheSynchDisk::GetDstIndex(){
-    for (int i = 0; i < DISK_CACHE_SIZE; ++i){
-        if (!cache[i].inUse)
-            return i;
+
+//----------------------------------------------------------------------
+// SynchDisk::TakeNext
+// 	Take the request to serve next off the queue: the oldest, under
+//	FIFO; under C-LOOK, the first one past the head, or if there is
+//	none, the lowest one, to start a new sweep.  Interrupts are off.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::TakeNext()
+{
+    DiskRequest **ptr, **best = NULL, **lowest = NULL;
+    DiskRequest *request;
+
+    if (queue == NULL)
+	return NULL;
+    if (policy == DiskFIFO)
+	best = &queue;
+    else {
+	for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next) {
+	    if (lowest == NULL || (*ptr)->sector < (*lowest)->sector)
+		lowest = ptr;
+	    if ((*ptr)->sector > headSector
+		    && (best == NULL || (*ptr)->sector < (*best)->sector))
+		best = ptr;
+	}
+	if (best == NULL)
+	    best = lowest;
     }
-    int dstIndex = GetDstIndexByLRU();
-    if (cache[dstIndex].dirty)
-        WriteBack(dstIndex);
-    return dstIndex;
-}
-int CacheSynchDisk::GetDstIndexByLRU(){
-    int dstTime = cache[0].timeStamp;
-    int dstIndex = 0;
-    for (int i = 1; i < DISK_CACHE_SIZE; ++i){
-        if (cache[i].timeStamp < dstTime){
-            dstTime = cache[i].timeStamp;
-            dstIndex = i;
-        }
+    request = *best;
+    *best = request->next;
+    request->next = NULL;
+    return request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::TakeAt
+// 	Take a queued request of the given kind that starts at the given
+//	sector off the queue, if there is one.  Interrupts are off.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::TakeAt(int sectorNumber, bool writing)
+{
+    DiskRequest **ptr, *request;
+
+    for (ptr = &queue; *ptr != NULL; ptr = &(*ptr)->next)
+	if ((*ptr)->sector == sectorNumber && (*ptr)->writing == writing) {
+	    request = *ptr;
+	    *ptr = request->next;
+	    request->next = NULL;
+	    return request;
+	}
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartNext
+// 	The disk is idle: start it on the next batch of requests, if any
+//	are waiting.  Under C-LOOK, requests of the same kind for the
+//	sectors that follow, on the same track, join the batch, and the
+//	whole batch is a single transfer, staged through "transfer".
+//	Interrupts are off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartNext()
+{
+    DiskRequest *first, *last, *request;
+    int end;
+    char *data;
+
+    ASSERT(batch == NULL);
+    if ((first = TakeNext()) == NULL)
+	return;
+    batch = last = first;
+    end = first->sector + first->count;
+    while (policy == DiskCLOOK && (end % SectorsPerTrack) != 0
+	   && (request = TakeAt(end, first->writing)) != NULL) {
+	last->next = request;
+	last = request;
+	end += request->count;
+	stats->numDiskMerges++;
     }
-    return dstIndex;
-}
-//private 
-void CacheSynchDisk::WriteBack(int index){
-    SynchDisk::WriteSector(cache[index].sectorNumber, cache[index].data);
-    cache[index].inUse = FALSE;
-}
-//public
-void CacheSynchDisk::ReadSector(int sectorNumber, char * data){
-    readWriteLock->BeforeRead();            // a bit problematic, 
-                    //because updating timestamp is some kind of writing
-    DEBUG('f', "Thread %d enter CacheSynchDisk::ReadSector.\n", currentThread->getTid());
-    for (int i = 0; i < DISK_CACHE_SIZE; ++i){
-        if (cache[i].inUse && cache[i].sectorNumber == sectorNumber){
-            DEBUG('f', "Thread %d hits sector %d in CacheSynchDisk::ReadSector.\n",
-                currentThread->getTid(), sectorNumber);
-            bcopy(cache[i].data, data, SectorSize);//.  read entry
-            cache[i].timeStamp = stats->totalTicks;//   write entry
-            readWriteLock->AfterRead();
-            return;
-        }
+    headSector = end - 1;
+
+    if (first->next == NULL)		// nothing merged; no need to copy
+	data = first->data;
+    else {
+	data = transfer;
+	if (first->writing)
+	    for (request = first; request != NULL; request = request->next)
+		bcopy(request->data,
+		    &transfer[(request->sector - first->sector) * SectorSize],
+		    request->count * SectorSize);
     }
-    DEBUG('f', "Thread %d misses sector %d in CacheSynchDisk::ReadSector.\n", 
-        currentThread->getTid(), sectorNumber);
-    readWriteLock->AfterRead();
-    readWriteLock->BeforeWrite();
-    int dstIndex = GetDstIndex();                   //write cache
-    SynchDisk::ReadSector(cache[dstIndex].sectorNumber, cache[dstIndex].data);//write
-    bcopy(cache[dstIndex].data, data, SectorSize);  //read 
-    cache[dstIndex].dirty = FALSE;                  //write cache
-    cache[dstIndex].inUse = TRUE;                   //write cache
-    cache[dstIndex].sectorNumber = sectorNumber;    //write
-    cache[dstIndex].timeStamp = stats->totalTicks;  //write
-    DEBUG('f', "Thread %d leave CacheSynchDisk::ReadSector.\n", currentThread->getTid());
-    readWriteLock->AfterWrite();
-}
-
-//public
-void CacheSynchDisk::WriteSector(int sectorNumber, char * data){
-    readWriteLock->BeforeWrite();
-    DEBUG('f', "Thread %d enter CacheSynchDisk::WriteSector.\n", currentThread->getTid());
-    for (int i = 0; i < DISK_CACHE_SIZE; ++i){
-        if (cache[i].inUse && cache[i].sectorNumber == sectorNumber){
-            DEBUG('f', "Thread %d hits sector %d in CacheSynchDisk::WriteSector.\n", 
-                currentThread->getTid(), sectorNumber);
-            bcopy(data, cache[i].data, SectorSize); //write
-            cache[i].dirty = TRUE;                  //write
-            cache[i].timeStamp = stats->totalTicks; //write
-            readWriteLock->AfterWrite();
-            return;
-        }
+    if (first->writing)
+	disk->WriteRequest(first->sector, data, end - first->sector);
+    else
+	disk->ReadRequest(first->sector, data, end - first->sector);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::RequestDone
+// 	Disk interrupt handler.  Finish the requests the disk has just
+//	served -- copying the data out first, if the batch was a merged
+//	read -- by waking up whoever waits for them, or calling their
+//	callbacks; then start on the next batch, unless a callback has
+//	already started one.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::RequestDone()
+{ 
+    DiskRequest *request, *next;
+    DiskRequest *done = batch;
+
+    batch = NULL;
+    if (done->next != NULL && !done->writing)
+	for (request = done; request != NULL; request = request->next)
+	    bcopy(&transfer[(request->sector - done->sector) * SectorSize],
+		request->data, request->count * SectorSize);
+    for (request = done; request != NULL; request = next) {
+	next = request->next;		// request may be gone after this
+	request->finished = TRUE;
+	if (request->callback != NULL) {
+	    (*request->callback)(request->arg);
+	    delete request;
+	} else if (request->waiter != NULL)
+	    scheduler->ReadyToRun(request->waiter);
     }
-    DEBUG('f', "Thread %d misses sector %d in CacheSynchDisk::WriteSector.\n", 
-        currentThread->getTid(), sectorNumber);
-
-    int dstIndex = GetDstIndex();                   //write
-    //SynchDisk::ReadSector(cache[dstIndex].sectorNumber, cache[dstIndex].data);
-    bcopy(data, cache[dstIndex].data, SectorSize);  //write
-    cache[dstIndex].dirty = TRUE;                   //write
-    cache[dstIndex].inUse = TRUE;                   //write
-    cache[dstIndex].sectorNumber = sectorNumber;    //write
-    cache[dstIndex].timeStamp = stats->totalTicks;  //write
-    DEBUG('f', "Thread %d leave CacheSynchDisk::WriteSector.\n", currentThread->getTid());
-    readWriteLock->AfterWrite();
+    if (batch == NULL)
+	StartNext();
 }
@@ -13,7 +13,30 @@
 
 #include "disk.h"
 #include "synch.h"
-#define DISK_CACHE_SIZE 8
+
+// Disk scheduling policies: serve requests in the order they arrive,
+// or sweep the head across the disk in one direction (C-LOOK).
+
+enum DiskPolicy { DiskFIFO, DiskCLOOK };
+
+// A request waiting for the disk, or being served by it.  A blocking
+// request lives on the stack of the thread that made it; an
+// asynchronous one is allocated by ReadSectorsAsync/WriteSectorsAsync,
+// and is the handle their caller gets back.
+
+class DiskRequest {
+  public:
+    int sector;				// first sector to transfer
+    int count;				// how many, all on one track
+    char *data;				// where to, or from
+    bool writing;
+    VoidFunctionPtr callback;		// if not NULL, call (*callback)(arg)
+    int arg;				// when the transfer is over
+    bool finished;			// is it over?
+    Thread *waiter;			// the thread waiting for it, if any
+    DiskRequest *next;			// next on the queue, or in the batch
+};
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -23,7 +46,21 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  A thread that has other things to do can instead start a
+// request with ReadSectorsAsync or WriteSectorsAsync, and later either
+// wait for it with WaitRequest, or -- by passing a callback -- have the
+// disk interrupt handler tell it when it is done; either way, one
+// thread can have many requests outstanding.  Any number of threads can
+// have a request outstanding at once; the requests wait in a queue, and
+// each time the disk finishes one, the next is chosen by the disk
+// scheduling policy.  Under C-LOOK, queued requests for the sectors
+// right after the chosen one, on the same track, are merged with it
+// into a single transfer.
+//
+// Requests for the same sector are not ordered against each other, so
+// callers must not have a read and a write of one sector outstanding
+// at the same time.  The file system never does: the buffer cache has
+// one buffer per sector, and only its holder does I/O on it.
 class SynchDisk {
   public:
     SynchDisk(char* name);    		// Initialize a synchronous disk,
@@ -33,49 +70,83 @@ class SynchDisk {
     virtual void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
     					// only once the data is actually read 
-					// or written.  These call
-    					// Disk::ReadRequest/WriteRequest and
-					// then wait until the request is done.
+					// or written.  These queue a request
+					// for Disk::ReadRequest/WriteRequest
+					// and then wait until it is done.
     virtual void WriteSector(int sectorNumber, char* data);
+    virtual void ReadSectors(int firstSector, int count, char* data);
+    virtual void WriteSectors(int firstSector, int count, char* data);
+					// Read/write a run of consecutive
+					// sectors, on one track, in a single
+					// request
+
+    DiskRequest *ReadSectorsAsync(int firstSector, int count, char* data,
+				  VoidFunctionPtr callback = NULL,
+				  int arg = 0);
+    DiskRequest *WriteSectorsAsync(int firstSector, int count, char* data,
+				   VoidFunctionPtr callback = NULL,
+				   int arg = 0);
+    DiskRequest *ReadSectorAsync(int sectorNumber, char* data,
+				 VoidFunctionPtr callback = NULL, int arg = 0)
+	{ return ReadSectorsAsync(sectorNumber, 1, data, callback, arg); }
+    DiskRequest *WriteSectorAsync(int sectorNumber, char* data,
+				  VoidFunctionPtr callback = NULL, int arg = 0)
+	{ return WriteSectorsAsync(sectorNumber, 1, data, callback, arg); }
+					// Start reading/writing, and return
+					// at once.  "data" must stay put until
+					// the transfer is over.  Without a
+					// callback, the caller must pass the
+					// handle returned to WaitRequest.
+					// With one, the callback is called by
+					// the interrupt handler, so it must
+					// not wait; the handle goes away after
+					// it returns, and must not be waited for
+    void WaitRequest(DiskRequest *request);
+					// Wait until a request is done, and
+					// free its handle
+    virtual void Sync() {}		// Make sure everything written has
+					// reached the disk; there is nothing
+					// to do unless we cache (see
+					// bufcache.h)
+    virtual void SyncSectors(int *sectors, int count) {}
+					// Likewise, for the given sectors only
+    virtual void Prefetch(int *sectors, int count) {}
+					// Read sectors that will be needed
+					// soon into the cache, if any
+    virtual void Invalidate() {}	// Sync, and empty the cache
+
+    void SetPolicy(DiskPolicy newPolicy) { policy = newPolicy; }
+					// FIFO or C-LOOK, for requests
+					// queued from now on
     
     void RequestDone();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
     //.
   private:
-    Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
-};
-class DiskCacheEntry
-{
-public:
-    DiskCacheEntry();
-    ~DiskCacheEntry();
+    void Submit(int sectorNumber, int count, char* data, bool writing);
+					// queue a request and wait for it
+    DiskRequest *SubmitAsync(int sectorNumber, int count, char* data,
+			     bool writing, VoidFunctionPtr callback, int arg);
+					// ... or do not wait
+    void Enqueue(DiskRequest *request);	// queue a request, filled in
+    void Wait(DiskRequest *request);	// wait until it is over
+    void StartNext();			// give the disk its next batch
+    DiskRequest *TakeNext();		// ... which begins with this one
+    DiskRequest *TakeAt(int sectorNumber, bool writing);
+					// ... and may go on with this one
 
-    int timeStamp;
-    int sectorNumber;
-    char * data;
-    bool inUse;
-    bool dirty;
-};
-class CacheSynchDisk:public SynchDisk
-{
-public:
-    CacheSynchDisk(char * name);
-    ~CacheSynchDisk();
-    void WriteSector(int sectorNumber, char * data);
-    void ReadSector(int sectorNumber, char * data);
-    void WriteAllBack();
-
-private:
-    DiskCacheEntry cache[DISK_CACHE_SIZE];
-    ReadWriteLock * readWriteLock;
-
-    int GetDstIndex();
-    void WriteBack(int index);
-    int GetDstIndexByLRU();
+    Disk *disk;		  		// Raw disk device
+    DiskPolicy policy;
+    DiskRequest *queue;			// Requests not started yet, oldest
+					// first; these three fields are
+					// protected by disabling interrupts,
+					// since the disk interrupt handler
+					// uses them
+    DiskRequest *batch;			// Requests the disk is serving now,
+					// in sector order; NULL if idle
+    int headSector;			// Last sector of the current, or
+					// previous, batch
+    char *transfer;			// Staging area for a merged batch
 };
 #endif // SYNCHDISK_H
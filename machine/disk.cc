@@ -32,7 +32,8 @@ static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
 //	if it doesn't exist), and check the magic number to make sure it's 
-// 	ok to treat it as Nachos disk storage.
+// 	ok to treat it as Nachos disk storage -- and its size, to make
+//	sure it has the number of tracks we were asked for.
 //
 //	"name" -- text name of the file simulating the Nachos disk
 //	"callWhenDone" -- interrupt handler to be called when disk read/write
@@ -42,7 +43,7 @@ static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
 
 Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
 {
-    int magicNum;
+    int magicNum, tracks;
     int tmp = 0;
 
     DEBUG('d', "Initializing the disk, 0x%x 0x%x\n", callWhenDone, callArg);
@@ -55,6 +56,15 @@ Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
     if (fileno >= 0) {		 	// file exists, check magic number 
 	Read(fileno, (char *) &magicNum, MagicSize);
 	ASSERT(magicNum == MagicNumber);
+	Lseek(fileno, 0, 2);		// and its size
+	tracks = (Tell(fileno) - (int) MagicSize)
+			/ (SectorsPerTrack * SectorSize);
+	if (tracks != NumTracks) {
+	    fprintf(stderr, "Disk \"%s\" has %d tracks, not %d: run with "
+		"-diskTracks %d, or remove it to make a new disk\n", name,
+		tracks, NumTracks, tracks);
+	    ASSERT(tracks == NumTracks);
+	}
     } else {				// file doesn't exist, create it
         fileno = OpenForWrite(name);
 	magicNum = MagicNumber;  
@@ -99,55 +109,68 @@ PrintSector (bool writing, int sector, char *data)
 
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
-// 	Simulate a request to read/write a single disk sector
+// 	Simulate a request to read/write a run of disk sectors
 //	   Do the read/write immediately to the UNIX file
 //	   Set up an interrupt handler to be called later,
 //	      that will notify the caller when the simulator says
 //	      the operation has completed.
 //
-//	Note that a disk only allows an entire sector to be read/written,
-//	not part of a sector.
+//	Note that a disk only allows entire sectors to be read/written,
+//	not part of a sector.  The sectors of a run must all be on the
+//	same track; once the head is over the first one, the rest
+//	follow at one per RotationTime.
 //
-//	"sectorNumber" -- the disk sector to read/write
+//	"sectorNumber" -- the first disk sector to read/write
 //	"data" -- the bytes to be written, the buffer to hold the incoming bytes
+//	"count" -- how many consecutive sectors
 //----------------------------------------------------------------------
 
 void
-Disk::ReadRequest(int sectorNumber, char* data)
+Disk::ReadRequest(int sectorNumber, char* data, int count)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    int ticks = ComputeLatency(sectorNumber, FALSE)
+		+ (count - 1) * RotationTime;
 
     ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (count >= 1)
+	&& (sectorNumber % SectorsPerTrack) + count <= SectorsPerTrack
+	&& (sectorNumber + count <= NumSectors));
     
-    DEBUG('d', "Reading from sector %d\n", sectorNumber);
+    DEBUG('d', "Reading from sectors %d to %d\n", sectorNumber,
+	sectorNumber + count - 1);
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    Read(fileno, data, SectorSize * count);
     if (DebugIsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
+	for (int i = 0; i < count; i++)
+	    PrintSector(FALSE, sectorNumber + i, data + i * SectorSize);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber + count - 1);
     stats->numDiskReads++;
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
 
 void
-Disk::WriteRequest(int sectorNumber, char* data)
+Disk::WriteRequest(int sectorNumber, char* data, int count)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    int ticks = ComputeLatency(sectorNumber, TRUE)
+		+ (count - 1) * RotationTime;
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (count >= 1)
+	&& (sectorNumber % SectorsPerTrack) + count <= SectorsPerTrack
+	&& (sectorNumber + count <= NumSectors));
     
-    DEBUG('d', "Writing to sector %d\n", sectorNumber);
+    DEBUG('d', "Writing to sectors %d to %d\n", sectorNumber,
+	sectorNumber + count - 1);
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    WriteFile(fileno, data, SectorSize * count);
     if (DebugIsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+	for (int i = 0; i < count; i++)
+	    PrintSector(TRUE, sectorNumber + i, data + i * SectorSize);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber + count - 1);
     stats->numDiskWrites++;
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
@@ -45,10 +45,23 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// A request can also cover a run of consecutive sectors on one track,
+// which then pass under the head one after the other: the run costs a
+// single seek and rotational delay, rather than one per sector.
+//
+// The number of tracks is set at startup, so that the disk can be
+// made big enough for multi-megabyte files.  It is fixed when the disk
+// file is made: an existing disk must be used with the number of
+// tracks it has, and is never grown or cut short.  To change it, remove
+// the disk file, and format the new one.
 
 #define SectorSize 		128	// number of bytes per disk sector
 #define SectorsPerTrack 	32	// number of sectors per disk track 
-#define NumTracks 		32	// number of tracks per disk
+#define DefaultNumTracks	32	// number of tracks per disk, unless
+					// -diskTracks says otherwise
+#define NumTracks 		diskTracks
+extern int diskTracks;
 #define NumSectors 		(SectorsPerTrack * NumTracks)
 					// total # of sectors per disk
 
@@ -60,12 +73,13 @@ class Disk {
 					// every time a request completes.
     ~Disk();				// Deallocate the disk.
     
-    void ReadRequest(int sectorNumber, char* data);
-    					// Read/write an single disk sector.
+    void ReadRequest(int sectorNumber, char* data, int count = 1);
+    					// Read/write "count" consecutive disk
+					// sectors, all on the same track.
 					// These routines send a request to 
     					// the disk and return immediately.
     					// Only one request allowed at a time!
-    void WriteRequest(int sectorNumber, char* data);
+    void WriteRequest(int sectorNumber, char* data, int count = 1);
 
     void HandleInterrupt();		// Interrupt handler, invoked when
 					// disk request finishes.
@@ -14,6 +14,10 @@
 //		a user instruction is executed
 //		there is nothing in the ready queue
 //
+//	With several CPUs, each of those only uses up some of the
+//	current CPU's share of the round; the clock itself moves when
+//	the round ends (see EndRound).
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -48,6 +52,134 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
     arg = param;
     when = time;
     type = kind;
+    seq = 0;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::PendingQueue
+// 	Initialize an empty heap of pending interrupts.  The array grows
+//	by doubling if more interrupts are outstanding than it can hold.
+//----------------------------------------------------------------------
+
+PendingQueue::PendingQueue()
+{
+    capacity = 16;
+    size = 0;
+    nextSeq = 0;
+    heap = new PendingInterrupt*[capacity];
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::~PendingQueue
+// 	De-allocate the heap, and any interrupts still on it.
+//----------------------------------------------------------------------
+
+PendingQueue::~PendingQueue()
+{
+    for (int i = 0; i < size; i++)
+	delete heap[i];
+    delete [] heap;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Before
+// 	Heap order: earlier "when" first; among interrupts due at the
+//	same time, the one scheduled first.
+//----------------------------------------------------------------------
+
+bool
+PendingQueue::Before(PendingInterrupt *a, PendingInterrupt *b)
+{
+    if (a->when != b->when)
+	return (a->when < b->when);
+    return ((int) (a->seq - b->seq) < 0);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::SiftUp, SiftDown
+// 	Restore the heap property after heap[i] moved in or out.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::SiftUp(int i)
+{
+    PendingInterrupt *item = heap[i];
+
+    while (i > 0 && Before(item, heap[(i - 1) / 2])) {
+	heap[i] = heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    heap[i] = item;
+}
+
+void
+PendingQueue::SiftDown(int i)
+{
+    PendingInterrupt *item = heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < size) {
+	if (child + 1 < size && Before(heap[child + 1], heap[child]))
+	    child++;
+	if (!Before(heap[child], item))
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = item;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Insert
+// 	Add an interrupt to the heap.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Insert(PendingInterrupt *toOccur)
+{
+    if (size == capacity) {
+	PendingInterrupt **bigger = new PendingInterrupt*[capacity * 2];
+	for (int i = 0; i < size; i++)
+	    bigger[i] = heap[i];
+	delete [] heap;
+	heap = bigger;
+	capacity *= 2;
+    }
+    toOccur->seq = nextSeq++;
+    heap[size] = toOccur;
+    SiftUp(size++);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::RemoveMin
+// 	Take the earliest interrupt off the heap.  Return NULL if there
+//	are no pending interrupts.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+PendingQueue::RemoveMin()
+{
+    if (size == 0)
+	return NULL;
+
+    PendingInterrupt *first = heap[0];
+    heap[0] = heap[--size];
+    if (size > 0)
+	SiftDown(0);
+    return first;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Mapcar
+// 	Apply "func" to every pending interrupt, by walking the heap
+//	array: the earliest comes first, but the rest are not sorted.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Mapcar(VoidFunctionPtr func)
+{
+    for (int i = 0; i < size; i++)
+	(*func)((int) heap[i]);
 }
 
 //----------------------------------------------------------------------
@@ -59,11 +191,12 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 
 Interrupt::Interrupt()
 {
-    level = IntOff;
-    pending = new List();
-    inHandler = FALSE;
-    yieldOnReturn = FALSE;
-    status = SystemMode;
+    pending = new PendingQueue();
+    pendingLock = intLock = 0;
+    roundMonitor = NewHostMonitor();
+    numArrived = roundNumber = 0;
+    roundLeader = NULL;
+    haltRequested = halting = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -73,15 +206,8 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
-    delete pending;
-}
-
-//----------------------------------------------------------------------
-// Interrupt::ChangeLevel
-// 	Change interrupts to be enabled or disabled, without advancing 
-//	the simulated time (normally, enabling interrupts advances the time).
+    delete pending;			// (the other CPUs may still be
+}					// waiting in roundMonitor)
 
 //----------------------------------------------------------------------
 // Interrupt::ChangeLevel
@@ -96,7 +222,7 @@ Interrupt::~Interrupt()
 void
 Interrupt::ChangeLevel(IntStatus old, IntStatus now)
 {
-    level = now;
+    currentCpu->level = now;
     DEBUG('i',"\tinterrupts: %s -> %s\n",intLevelNames[old],intLevelNames[now]);
 }
 
@@ -105,6 +231,14 @@ Interrupt::ChangeLevel(IntStatus old, IntStatus now)
 // 	Change interrupts to be enabled or disabled, and if interrupts
 //	are being enabled, advance simulated time by calling OneTick().
 //
+//	With several CPUs, disabling interrupts disables them on every
+//	CPU: we take the machine-wide interrupt lock, unless this CPU
+//	already holds it, and keep it until interrupts are enabled
+//	again.  That is so even if they were only off on this CPU (see
+//	DisableLocal) -- but not while this CPU holds a spin lock, which
+//	would deadlock against a CPU holding the interrupt lock and
+//	wanting the spin lock.
+//
 // Returns:
 //	The old interrupt status.
 // Parameters:
@@ -114,18 +248,46 @@ Interrupt::ChangeLevel(IntStatus old, IntStatus now)
 IntStatus
 Interrupt::SetLevel(IntStatus now)
 {
-    IntStatus old = level;
+    IntStatus old = currentCpu->level;
     
-    ASSERT((now == IntOff) || (inHandler == FALSE));// interrupt handlers are 
+    ASSERT((now == IntOff) || (currentCpu->inHandler == FALSE));
+						// interrupt handlers are 
 						// prohibited from enabling 
 						// interrupts
 
+    if (halting)				// they stay off (see Halt)
+	now = IntOff;
+    if (now == IntOff && numCpus > 1 && !currentCpu->holdsIntLock)
+	TakeIntLock();
     ChangeLevel(old, now);			// change to new state
+    if (now == IntOn && currentCpu->holdsIntLock)
+	DropIntLock();
     if ((now == IntOn) && (old == IntOff))
 	OneTick();				// advance simulated time
     return old;
 }
 
+//----------------------------------------------------------------------
+// Interrupt::DisableLocal
+// 	Disable interrupts on the current CPU only, and return the
+//	previous setting.  Used by spin locks (see synch.h), which keep
+//	the other CPUs out by themselves.  On a uniprocessor, the same as
+//	SetLevel(IntOff).
+//
+//	Re-enable with SetLevel(IntOn); but if the previous setting was
+//	IntOff, leave the level alone rather than calling SetLevel(IntOff),
+//	which would take the interrupt lock.
+//----------------------------------------------------------------------
+
+IntStatus
+Interrupt::DisableLocal()
+{
+    IntStatus old = currentCpu->level;
+
+    ChangeLevel(old, IntOff);
+    return old;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Enable
 // 	Turn interrupts on.  Who cares what they used to be? 
@@ -138,6 +300,77 @@ Interrupt::Enable()
     (void) SetLevel(IntOn); 
 }
 
+//----------------------------------------------------------------------
+// Interrupt::getLevel, getStatus, setStatus
+// 	The interrupt level and machine status of the current CPU.
+//----------------------------------------------------------------------
+
+IntStatus
+Interrupt::getLevel()
+{
+    return currentCpu->level;
+}
+
+MachineStatus
+Interrupt::getStatus()
+{
+    return currentCpu->status;
+}
+
+void
+Interrupt::setStatus(MachineStatus st)
+{
+    currentCpu->status = st;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::TakeIntLock, DropIntLock
+// 	Multiprocessor only.  Take and let go of the machine-wide
+//	interrupt lock, which the CPU that has interrupts off for
+//	everyone holds.
+//----------------------------------------------------------------------
+
+void
+Interrupt::TakeIntLock()
+{
+    ASSERT(!currentCpu->holdsIntLock);
+    ASSERT(currentCpu->spinDepth == 0);		// see SetLevel
+    while (TestAndSet(&intLock))
+	SpinDelay();
+    currentCpu->holdsIntLock = TRUE;
+}
+
+void
+Interrupt::DropIntLock()
+{
+    ASSERT(currentCpu->holdsIntLock);
+    currentCpu->holdsIntLock = FALSE;
+    ClearWord(&intLock);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HoldsIntLock, RestoreIntLock
+// 	Whether the current CPU holds the interrupt lock; and take it or
+//	let go of it, to make that "held".  The lock belongs to the CPU,
+//	not to a thread: Scheduler::Run uses these to give each thread
+//	back the lock it had (or not) when it last switched out.
+//----------------------------------------------------------------------
+
+bool
+Interrupt::HoldsIntLock()
+{
+    return currentCpu->holdsIntLock;
+}
+
+void
+Interrupt::RestoreIntLock(bool held)
+{
+    if (held && !currentCpu->holdsIntLock)
+	TakeIntLock();
+    else if (!held && currentCpu->holdsIntLock)
+	DropIntLock();
+}
+
 //----------------------------------------------------------------------
 // Interrupt::OneTick
 // 	Advance simulated time and check if there are any pending 
@@ -146,36 +379,175 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	With several CPUs, the tick is charged to the current CPU, and
+//	the global clock only moves once every CPU has used up its share
+//	of the round (see EndRound).  Interrupts only fire then.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
 {
-    MachineStatus old = status;
+    Cpu *cpu = currentCpu;
+    MachineStatus old = cpu->status;
+    int ticks;
 
 // advance simulated time
-    if (status == SystemMode) {
-        stats->totalTicks += SystemTick;
-	stats->systemTicks += SystemTick;
-    } else {					// USER_PROGRAM
-	stats->totalTicks += UserTick;
-	stats->userTicks += UserTick;
-    }
-    DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
+    if (numCpus > 1) {
+	ticks = (old == SystemMode) ? SystemTick : UserTick;
+	if (old == SystemMode)
+	    cpu->roundSystemTicks += ticks;
+	else
+	    cpu->roundUserTicks += ticks;
+	cpu->busyTicks += ticks;
+	cpu->roundTicks += ticks;
+	if (cpu->roundTicks >= CpuQuantum) {
+	    ChangeLevel(IntOn, IntOff);
+	    cpu->status = SystemMode;
+	    EndRound();				// returns once the round
+	    cpu->status = old;			// is over, and whatever
+	    ChangeLevel(IntOff, IntOn);		// interrupts were due
+	}					// have fired
+    } else {
+	if (old == SystemMode) {
+	    ticks = SystemTick;
+	    stats->systemTicks += SystemTick;
+	} else {				// USER_PROGRAM
+	    ticks = UserTick;
+	    stats->userTicks += UserTick;
+	}
+	stats->totalTicks += ticks;
+	DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
+
+// nothing is due yet -- the common case, so don't bother with the rest
+	PendingInterrupt *next = pending->Min();
+	if ((next == NULL || next->when > stats->totalTicks)
+					&& !cpu->yieldOnReturn)
+	    return;
 
 // check any pending interrupts are now ready to fire
-    ChangeLevel(IntOn, IntOff);		// first, turn off interrupts
+	ChangeLevel(IntOn, IntOff);	// first, turn off interrupts
 					// (interrupt handlers run with
 					// interrupts disabled)
-    while (CheckIfDue(FALSE))		// check for pending interrupts
-	;
-    ChangeLevel(IntOff, IntOn);		// re-enable interrupts
-    if (yieldOnReturn) {		// if the timer device handler asked 
+	while (CheckIfDue(FALSE))	// check for pending interrupts
+	    ;
+	ChangeLevel(IntOff, IntOn);	// re-enable interrupts
+    }
+    if (cpu->yieldOnReturn) {		// if the timer device handler asked 
 					// for a context switch, ok to do it now
-	yieldOnReturn = FALSE;
- 	status = SystemMode;		// yield is a kernel routine
-	currentThread->Yield();
-	status = old;
+	cpu->yieldOnReturn = FALSE;
+	if (currentThread != cpu->idleThread) {
+	    cpu->status = SystemMode;	// yield is a kernel routine
+	    currentThread->Yield();
+	    currentCpu->status = old;	// (we may be on another CPU now)
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::EndRound
+// 	Multiprocessor only.  The current CPU has used up its share of
+//	this round (CpuQuantum ticks), or has nothing to do: wait until
+//	every other CPU is done with the round too.  The last one to get
+//	here ends the round (NextRound), while the others are stopped.
+//	Once the global clock has moved forward -- by CpuQuantum, so
+//	CPUs that are all busy at once cost no more simulated time than
+//	one of them would alone -- they all go on.
+//
+//	Called with interrupts disabled on this CPU, without the
+//	interrupt lock or any spin lock, so that no CPU can be left
+//	waiting for a lock held by a CPU that is waiting here.
+//----------------------------------------------------------------------
+void
+Interrupt::EndRound()
+{
+    int round;
+
+    ASSERT(currentCpu->level == IntOff && !currentCpu->holdsIntLock
+	   && currentCpu->spinDepth == 0);
+    EnterHostMonitor(roundMonitor);
+    round = roundNumber;
+    if (++numArrived < numCpus) {		// wait for the others
+	while (roundNumber == round)
+	    WaitHostMonitor(roundMonitor);
+    } else {					// we are the last
+	roundLeader = currentCpu;
+	TakeIntLock();
+	for (int i = 0; i < numCpus; i++) {	// count what the CPUs did,
+	    Cpu *cpu = cpus[i];			// even if we are halting
+	    stats->systemTicks += cpu->roundSystemTicks;
+	    stats->userTicks += cpu->roundUserTicks;
+	    cpu->roundSystemTicks = cpu->roundUserTicks = 0;
+	}
+	if (haltRequested)
+	    Halt();				// never returns
+	NextRound();
+	DropIntLock();
+	roundLeader = NULL;
+	numArrived = 0;
+	roundNumber++;
+	WakeHostMonitor(roundMonitor);
+    }
+    LeaveHostMonitor(roundMonitor);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NextRound
+// 	Multiprocessor only: called by the last CPU to finish a round,
+//	with the interrupt lock held, while every other CPU waits in
+//	EndRound.  Account for idle time, move the clock forward, and
+//	fire the interrupts that are now due.
+//
+//	If every CPU is idle, nothing can happen until the next hardware
+//	interrupt, so roll simulated time forward to it instead, as Idle
+//	does for a uniprocessor.
+//----------------------------------------------------------------------
+void
+Interrupt::NextRound()
+{
+    Cpu *cpu;
+    int i, before, idle;
+
+    for (i = 0; i < numCpus; i++)
+	if (!cpus[i]->IsIdle())
+	    break;
+    if (i == numCpus) {			// the whole machine is idle
+	before = stats->totalTicks;
+	Idle();				// (halts if nothing is pending)
+	for (i = 0; i < numCpus; i++) {
+	    cpus[i]->idleTicks += stats->totalTicks - before;
+	    cpus[i]->roundTicks = 0;
+	}
+	stats->idleTicks += (numCpus - 1) * (stats->totalTicks - before);
+	return;
+    }
+
+    for (i = 0; i < numCpus; i++) {	// the rest of the round is idle
+	cpu = cpus[i];			// for CPUs that ran out of work
+	idle = CpuQuantum - cpu->roundTicks;
+	if (idle > 0) {
+	    cpu->idleTicks += idle;
+	    stats->idleTicks += idle;
+	}
+	cpu->roundTicks = 0;
     }
+    stats->totalTicks += CpuQuantum;
+    DEBUG('i', "\n== Round ends at %d ==\n", stats->totalTicks);
+    while (CheckIfDue(FALSE))
+	;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::IdleTick
+// 	Multiprocessor only: called by the current CPU's idle thread,
+//	with interrupts disabled, when there is nothing to run.  The CPU
+//	sits out the rest of this round.
+//----------------------------------------------------------------------
+void
+Interrupt::IdleTick()
+{
+    ASSERT(currentThread == currentCpu->idleThread);
+    EndRound();
+    currentCpu->yieldOnReturn = FALSE;	// we look for work anyway
 }
 
 //----------------------------------------------------------------------
@@ -192,8 +564,8 @@ Interrupt::OneTick()
 void
 Interrupt::YieldOnReturn()
 { 
-    ASSERT(inHandler == TRUE);  
-    yieldOnReturn = TRUE; 
+    ASSERT(currentCpu->inHandler == TRUE);  
+    currentCpu->yieldOnReturn = TRUE; 
 }
 
 //----------------------------------------------------------------------
@@ -211,13 +583,13 @@ void
 Interrupt::Idle()
 {
     DEBUG('i', "Machine idling; checking for interrupts.\n");
-    status = IdleMode;
+    currentCpu->status = IdleMode;
     if (CheckIfDue(TRUE)) {		// check for any pending interrupts
     	while (CheckIfDue(FALSE))	// check for any other pending 
 	    ;				// interrupts
-        yieldOnReturn = FALSE;		// since there's nothing in the
+        currentCpu->yieldOnReturn = FALSE; // since there's nothing in the
 					// ready queue, the yield is automatic
-        status = SystemMode;
+        currentCpu->status = SystemMode;
 	return;				// return in case there's now
 					// a runnable thread
     }
@@ -236,21 +608,68 @@ Interrupt::Idle()
 //----------------------------------------------------------------------
 // Interrupt::Halt
 // 	Shut down Nachos cleanly, printing out performance statistics.
+//
+//	With several CPUs, the others must be stopped first: we wait for
+//	them to finish the round, and the last one to do so halts.
+//
+//	What the file system holds in memory is written back first, while
+//	the other threads can still run and let go of what they hold --
+//	unless we got here from Idle, when every thread is asleep; then
+//	Cleanup does it.  From here on interrupts stay off, so nothing
+//	else runs and simulated time only moves for the disk.
 //----------------------------------------------------------------------
 void
 Interrupt::Halt()
 {
+    if (currentCpu->status != IdleMode && roundLeader != currentCpu)
+	SyncFileSystem();			// (a halt requested by another
+						// CPU was synced by it)
+    if (numCpus > 1 && roundLeader != currentCpu) {
+	ChangeLevel(currentCpu->level, IntOff);
+	if (currentCpu->holdsIntLock)
+	    DropIntLock();
+	EnterHostMonitor(roundMonitor);
+	haltRequested = TRUE;
+	LeaveHostMonitor(roundMonitor);
+	EndRound();				// never returns
+	ASSERT(FALSE);
+    }
+    ChangeLevel(currentCpu->level, IntOff);
+    halting = TRUE;
     printf("Machine halting!\n\n");
+    if (tracer != NULL)
+	tracer->Dump();
     stats->Print();
+    if (lockProfiler != NULL)
+	lockProfiler->Print();
     Cleanup();     // Never returns.
 }
 
+//----------------------------------------------------------------------
+// Interrupt::WaitForInterrupt
+// 	Called once the machine is halting, by a thread that has to wait
+//	for a device (Cleanup, writing back to the disk).  It cannot
+//	sleep, since we may have halted from inside Sleep or with the
+//	other CPUs stopped, and nothing else is to run anyway; so roll
+//	simulated time forward to the next pending interrupt and fire it
+//	off, as Idle does.
+//----------------------------------------------------------------------
+void
+Interrupt::WaitForInterrupt()
+{
+    bool fired;
+
+    ASSERT(halting && currentCpu->level == IntOff);
+    fired = CheckIfDue(TRUE);
+    ASSERT(fired);			// else we would wait forever
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Schedule
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: just put it on the heap of pending interrupts.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -271,7 +690,10 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    while (TestAndSet(&pendingLock))	// other CPUs may be scheduling
+	SpinDelay();			// interrupts too; CheckIfDue only
+    pending->Insert(toOccur);		// runs while they are stopped
+    ClearWord(&pendingLock);
 }
 
 //----------------------------------------------------------------------
@@ -290,33 +712,35 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 bool
 Interrupt::CheckIfDue(bool advanceClock)
 {
-    MachineStatus old = status;
+    Cpu *cpu = currentCpu;
+    MachineStatus old = cpu->status;
     int when;
 
-    ASSERT(level == IntOff);		// interrupts need to be disabled,
+    ASSERT(cpu->level == IntOff);		// interrupts need to be disabled,
 					// to invoke an interrupt handler
     if (DebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
+    PendingInterrupt *toOccur = pending->Min();
 
     if (toOccur == NULL)		// no pending interrupts
 	return FALSE;			
 
+    when = toOccur->when;
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks) {	// not time yet, leave it
 	return FALSE;
     }
 
-// Check if there is nothing more to do, and if so, quit
-    if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+// Check if there is nothing more to do, and if so, quit -- unless
+// some thread is asleep, waiting for the timer to wake it up
+    if ((old == IdleMode) && (toOccur->type == TimerInt) 
+				&& pending->NumPending() == 1
+				&& alarmClock->NumWaiters() == 0) {
 	 return FALSE;
     }
+    (void) pending->RemoveMin();
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 			intTypeNames[toOccur->type], toOccur->when);
@@ -324,13 +748,15 @@ Interrupt::CheckIfDue(bool advanceClock)
     if (machine != NULL)
     	machine->DelayedLoad(0, 0);
 #endif
-    inHandler = TRUE;
-    status = SystemMode;			// whatever we were doing,
+    TRACE(TraceInterrupt, 0, intTypeNames[toOccur->type]);
+    cpu->inHandler = TRUE;
+    cpu->status = SystemMode;			// whatever we were doing,
 						// we are now going to be
 						// running in the kernel
     (*(toOccur->handler))(toOccur->arg);	// call the interrupt handler
-    status = old;				// restore the machine status
-    inHandler = FALSE;
+    RunTasklets();				// and whatever it deferred
+    cpu->status = old;				// restore the machine status
+    cpu->inHandler = FALSE;
     delete toOccur;
     return TRUE;
 }
@@ -360,7 +786,7 @@ void
 Interrupt::DumpState()
 {
     printf("Time: %d, interrupts %s\n", stats->totalTicks, 
-					intLevelNames[level]);
+					intLevelNames[currentCpu->level]);
     printf("Pending interrupts:\n");
     fflush(stdout);
     pending->Mapcar(PrintPending);
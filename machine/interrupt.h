@@ -20,6 +20,13 @@
 //	simulated time advances (so that it becomes time to invoke an
 //	interrupt in the hardware simulation).
 //
+//	With several CPUs (see threads/cpu.h), the interrupt level is per
+//	CPU, and turning interrupts off also takes a machine-wide lock,
+//	so that code that counts on interrupts being off for atomicity
+//	still gets it.  Time advances a round at a time, once every CPU
+//	has used up its share of the round, and interrupts are only
+//	delivered between rounds.
+//
 //	NOTE: this means that incorrectly synchronized code may work
 //	fine on this hardware simulation (even with randomized time slices),
 //	but it wouldn't work on real hardware.  (Just because we can't
@@ -38,6 +45,8 @@
 #include "copyright.h"
 #include "list.h"
 
+class Cpu;
+
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
 enum IntStatus { IntOff, IntOn };
 
@@ -67,6 +76,42 @@ class PendingInterrupt {
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    unsigned int seq;		// order of scheduling, so interrupts due
+				// at the same time fire in FIFO order
+};
+
+// The following class defines the set of interrupts scheduled to
+// occur in the future, kept as a binary min-heap ordered by "when".
+// Scheduling and removing an interrupt are O(log n); finding out
+// when the next one is due is O(1).
+
+class PendingQueue {
+  public:
+    PendingQueue();			// initialize to empty
+    ~PendingQueue();			// de-allocate the heap array
+
+    void Insert(PendingInterrupt *toOccur);
+					// Add an interrupt
+    PendingInterrupt *RemoveMin();	// Take off the earliest interrupt,
+					// NULL if there are none
+    PendingInterrupt *Min() { return (size > 0) ? heap[0] : NULL; }
+					// Peek at the earliest interrupt
+    bool IsEmpty() { return (size == 0); }
+    int NumPending() { return size; }
+
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every interrupt,
+					// in heap (not time) order
+
+  private:
+    bool Before(PendingInterrupt *a, PendingInterrupt *b);
+					// does "a" fire before "b"?
+    void SiftUp(int i);
+    void SiftDown(int i);
+
+    PendingInterrupt **heap;		// heap[0] is the earliest
+    int size;				// number of interrupts in the heap
+    int capacity;			// size of the heap array
+    unsigned int nextSeq;		// sequence number for the next Insert
 };
 
 // The following class defines the data structures for the simulation
@@ -81,22 +126,33 @@ class Interrupt {
     
     IntStatus SetLevel(IntStatus level);// Disable or enable interrupts 
 					// and return previous setting.
+    IntStatus DisableLocal();		// Disable interrupts on this CPU
+					// only, for a spin lock
+					// (re-enable with SetLevel)
 
     void Enable();			// Enable interrupts.
-    IntStatus getLevel() {return level;}// Return whether interrupts
+    IntStatus getLevel();		// Return whether interrupts
 					// are enabled or disabled
     
     void Idle(); 			// The ready queue is empty, roll 
 					// simulated time forward until the 
 					// next interrupt
+    void IdleTick();			// Multiprocessor only: this CPU
+					// has nothing to do, let the
+					// others run
 
     void Halt(); 			// quit and print out stats
+    bool IsHalting() { return halting; }	// has Halt begun?
+    void WaitForInterrupt();		// Halting only: roll simulated
+					// time forward to the next
+					// interrupt, since no thread can
+					// sleep until it comes
     
     void YieldOnReturn();		// cause a context switch on return 
 					// from an interrupt handler
 
-    MachineStatus getStatus() { return status; } // idle, kernel, user
-    void setStatus(MachineStatus st) { status = st; }
+    MachineStatus getStatus();		// idle, kernel, user
+    void setStatus(MachineStatus st);
 
     void DumpState();			// Print interrupt state
     
@@ -112,14 +168,30 @@ class Interrupt {
     
     void OneTick();       		// Advance simulated time
 
+    bool HoldsIntLock();		// Multiprocessor only: does this
+    void RestoreIntLock(bool held);	// CPU have interrupts off machine-
+					// wide?  Take or let go of the lock
+					// to match "held" (on a context
+					// switch, see Scheduler::Run)
+
   private:
-    IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
+    PendingQueue *pending;	// the interrupts scheduled
 				// to occur in the future
-    bool inHandler;		// TRUE if we are running an interrupt handler
-    bool yieldOnReturn; 	// TRUE if we are to context switch
-				// on return from the interrupt handler
-    MachineStatus status;	// idle, kernel mode, user mode
+    int pendingLock;		// keeps CPUs scheduling interrupts
+				// at the same time out of each other's way
+    int intLock;		// held by the CPU that has interrupts
+				// off machine-wide, if any
+
+    void *roundMonitor;		// where CPUs wait for a round to end
+    int numArrived;		// CPUs done with the current round
+    int roundNumber;		// how many rounds have ended
+    Cpu *roundLeader;		// the CPU ending the round, if any
+    bool haltRequested;		// halt once the round ends
+    bool halting;		// Halt has begun: nothing else will run
+
+    // the interrupt level, whether we are in a handler (and so
+    // whether to context switch on return), and the machine status
+    // are all per CPU, see Cpu
 
     // these functions are internal to the interrupt simulation code
 
@@ -128,6 +200,11 @@ class Interrupt {
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
+    void TakeIntLock();			// interrupts off machine-wide ...
+    void DropIntLock();			// ... and back on
+    void EndRound();			// Wait for the other CPUs to finish
+					// the round
+    void NextRound();			// Move the clock, fire interrupts
 };
 
 #endif // INTERRRUPT_H
@@ -54,17 +54,33 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"shared" -- the Machine of another CPU, whose main memory, page
+//		frame table and locks this one uses too; or NULL, to
+//		allocate them
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, Machine *shared)
 {
     int i;
 
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
-    mainMemory = new char[MemorySize];
-    for (i = 0; i < MemorySize; i++)
-      	mainMemory[i] = 0;
+    llBit = FALSE;
+    llAddr = 0;
+    ownsMemory = (shared == NULL);
+    if (ownsMemory) {
+	mainMemory = new char[MemorySize];
+	for (i = 0; i < MemorySize; i++)
+	    mainMemory[i] = 0;
+	accessLock = new ReadWriteLock("accessLock");
+	llLock = new SpinLock;
+	pageUsageTable = new PageUsageEntry[NumPhysPages];
+    } else {
+	mainMemory = shared->mainMemory;
+	accessLock = shared->accessLock;
+	llLock = shared->llLock;
+	pageUsageTable = shared->pageUsageTable;
+    }
 //.cqy #ifdef USE_TLB
     tlb = new TranslationEntry[TLBSize];
     for (i = 0; i < TLBSize; i++)
@@ -84,8 +100,6 @@ Machine::Machine(bool debug)
     numTLBEvict = 0;
     numTLBAccess = 0;
     //memBitMap = new BitMap(NumPhysPages);
-    accessLock = new Lock("accessLock");
-    pageUsageTable = new PageUsageEntry[NumPhysPages];
     numPageFault = 0;
     numPageHit = 0;
     numPageAccess = 0;
@@ -100,7 +114,8 @@ Machine::Machine(bool debug)
 
 Machine::~Machine()
 {
-    delete [] mainMemory;
+    if (ownsMemory)
+	delete [] mainMemory;
     if (tlb != NULL)
         delete [] tlb;
 }
@@ -268,9 +283,21 @@ void Machine::CachePageEntryInTLB(unsigned int vpn){
     // When page fault happens, we can know corresponding page is not mapped into main memory,
     // and thus the virtual addr does have a corresponding physical addr.
     if (!pageTable[vpn].valid){   // page fault
-        //printf("in valid\n");
-        machine->numPageFault += 1;
-        PageFaultExceptionHandler(vpn);
+        // Bringing the page in changes what is where in memory, which
+        // no other access, on this CPU or another, may see half done:
+        // trade our share of the access lock for all of it.  Whoever
+        // had it before us may have brought the page in already.
+        ReadWriteLock *lock = (ReadWriteLock *) accessLock;
+        if (!lock->Upgrade()) {
+            lock->AfterRead();
+            lock->BeforeWrite();
+        }
+        if (!pageTable[vpn].valid) {
+            machine->numPageFault += 1;
+            PageFaultExceptionHandler(vpn);
+        } else
+            machine->numPageHit += 1;
+        lock->Downgrade();
     } else{
         //printf("valid\n");
 
@@ -392,7 +419,7 @@ int Machine::GetReplaceTargetInMemByLRU(){
 // check if this page's page table entry is cached in TLB. If yes, invalidate it.
 bool Machine::InvalidateSwappedPageEntryInTLB(int ppn){
     for (int i = 0; i < TLBSize; ++i){
-        if (tlb[i].physicalPage == ppn){
+        if (tlb[i].valid && tlb[i].physicalPage == ppn){
             tlb[i].valid = FALSE;
             DEBUG('d', "Invalidate swapped entry TLB: %d\n", ppn);
             return TRUE;
@@ -406,7 +433,10 @@ void Machine::SwapPageToFile(int ppn){
     int vpn = pageUsageTable[ppn].vpn;
     pageUsageTable[ppn].space->ForcedSwapPageToFile(vpn);
     pageUsageTable[ppn].space = NULL;
-    InvalidateSwappedPageEntryInTLB(ppn);
+    // Any CPU may have the page in its TLB, not just this one.  None
+    // of them can be using it: we hold the access lock alone.
+    for (int i = 0; i < numCpus; i++)
+        cpus[i]->machine->InvalidateSwappedPageEntryInTLB(ppn);
     DEBUG('d', "Thread %d Leave Machine::SwapPageToFile\n", currentThread->getTid());
 
 }
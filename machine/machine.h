@@ -128,11 +128,18 @@ public:
 //
 // The procedures in this class are defined in machine.cc, mipssim.cc, and
 // translate.cc.
+//
+// With "-smp", each CPU has a Machine of its own (see cpu.h): its own
+// registers, TLB and page table register.  Main memory, the page frame
+// table and the lock that guards them belong to CPU 0's Machine, and
+// the others share them.
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
-				// for running user programs
+    Machine(bool debug, Machine *shared = NULL);
+				// Initialize the simulation of the hardware
+				// for running user programs; share the
+				// memory of "shared", if there is one
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -156,6 +163,11 @@ class Machine {
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+    bool LoadLinked(int addr, int *value);
+    bool StoreConditional(int addr, int value, bool *stored);
+				// The memory side of LL and SC: read a word
+				// and reserve it; store it only if still
+				// reserved
     
     ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
     				// Translate an address, and check for 
@@ -181,6 +193,10 @@ class Machine {
     char *mainMemory;		// physical memory to store user program,
 				// code and data, while executing
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
+    bool llBit;			// set by LL; SC only stores if it is still
+    int llAddr;			// set, for the same address.  Any context
+				// switch clears it (see RestoreUserState),
+				// and so does an SC to it on another CPU
 
 
 // NOTE: the hardware translation of virtual addresses in the user program
@@ -225,9 +241,15 @@ class Machine {
     int numTLBAccess;
     void *accessLock;   //recursive include failed, forward declaration failed, 
                         //  therefore use void *, when what to use it in .cpp file, 
-                        //  cast to (Lock *) type.
+                        //  cast to (ReadWriteLock *) type.
+                        //  Memory accesses share it; page faults, and
+                        //  anything else that changes which page is
+                        //  where, hold it alone.
+    void *llLock;       // a SpinLock, making LL and SC atomic (ditto)
     void AcquireLock();
     void ReleaseLock();
+    int BeginAccess();
+    void EndAccess(int affinity);
 
    // BitMap *memBitMap;
     PageUsageEntry *pageUsageTable;
@@ -243,6 +265,8 @@ class Machine {
     //..
 
   private:
+    bool ownsMemory;		// FALSE if "mainMemory" and the rest
+				// belong to another CPU's Machine
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
@@ -37,10 +37,13 @@ Machine::Run()
 	       currentThread->getName(), stats->totalTicks);
     interrupt->setStatus(UserMode);
     for (;;) {
-        OneInstruction(instr);
+        // "machine", not "this": between two instructions the thread
+        // may have moved to another CPU, and so to another Machine
+        machine->OneInstruction(instr);
 		interrupt->OneTick();
-		if (singleStep && (runUntilTime <= stats->totalTicks))
-			Debugger();
+		if (machine->singleStep
+			&& (machine->runUntilTime <= stats->totalTicks))
+			machine->Debugger();
     }
 }
 
@@ -118,6 +121,7 @@ Machine::OneInstruction(Instruction *instr)
     int pcAfter = registers[NextPCReg] + 4;
     int sum, diff, tmp, value;
     unsigned int rs, rt, imm;
+    bool stored;
 
     // Execute the instruction (cf. Kane's book)
     switch (instr->opCode) {
@@ -277,6 +281,20 @@ Machine::OneInstruction(Instruction *instr)
 	nextLoadValue = value;
 	break;
     	
+      case OP_LL:
+	// Load linked: like LW, but remember the address for SC.  The
+	// value is available at once -- there is no load delay to model,
+	// since the only user is the SC right after.
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    return;
+	}
+	if (!machine->LoadLinked(tmp, &value))
+	    return;
+	registers[instr->rt] = value;
+	break;
+
       case OP_LWL:	  
 	tmp = registers[instr->rs] + instr->extra;
 
@@ -468,6 +486,29 @@ Machine::OneInstruction(Instruction *instr)
 	registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
 	break;
 	
+      case OP_SC:
+	// Store conditional: store only if nothing else can have run
+	// since the LL, and tell the program whether we did.  Touch the
+	// word first: if that faults and lets another thread run, the
+	// context switch clears llBit, and the store must not happen.
+	// StoreConditional checks again, as it stores.
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    return;
+	}
+	if (!machine->ReadMem(tmp, 4, &value))
+	    return;
+	if (llBit && llAddr == tmp) {
+	    if (!machine->StoreConditional(tmp, registers[instr->rt], 
+					   &stored))
+		return;
+	    registers[instr->rt] = stored ? 1 : 0;
+	} else
+	    registers[instr->rt] = 0;
+	llBit = FALSE;
+	break;
+
       case OP_SW:
 	if (!machine->WriteMem((unsigned) 
 		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
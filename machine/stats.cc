@@ -19,9 +19,20 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
-    numDiskReads = numDiskWrites = 0;
+    numDiskReads = numDiskWrites = numDiskMerges = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numTimerInterrupts = numTimerSuppressed = 0;
+    numSameSpaceSwitches = numCrossSpaceSwitches = 0;
+    numTimedSameSpace = numTimedCrossSpace = 0;
+    sameSpaceSwitchTime = crossSpaceSwitchTime = 0.0;
+    numFutexWaits = numFutexWakeups = 0;
+    numRealTimeReleases = numDeadlineMisses = numBudgetOverruns = 0;
+    numWorkItems = numTasklets = 0;
+    numCacheHits = numCacheMisses = numCacheEvictions = numCacheWriteBacks = 0;
+    numCacheWriteRuns = numCacheFlushes = numDirtyEvictions = 0;
+    numReadAheads = numReadAheadRuns = 0;
+    numIndirectHits = numIndirectMisses = 0;
 }
 
 //----------------------------------------------------------------------
@@ -36,23 +47,71 @@ Statistics::Print()
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+    if (numDiskMerges > 0)
+	printf("Disk queue: merged requests %d\n", numDiskMerges);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+    if (timer != NULL)
+	timer->UpdateStats();
+    printf("Timer: interrupts %d, suppressed %d\n", numTimerInterrupts,
+	numTimerSuppressed);
+    printf("Context switches: same-space %d (%.3f us avg), "
+	"cross-space %d (%.3f us avg)\n", numSameSpaceSwitches,
+	numTimedSameSpace ? sameSpaceSwitchTime / numTimedSameSpace : 0.0,
+	numCrossSpaceSwitches,
+	numTimedCrossSpace ? crossSpaceSwitchTime / numTimedCrossSpace : 0.0);
+    printf("Real-time: releases %d, deadline misses %d, budget overruns %d\n",
+	numRealTimeReleases, numDeadlineMisses, numBudgetOverruns);
+    printf("Deferred work: work items %d, tasklets %d\n", numWorkItems,
+	numTasklets);
+#ifdef FILESYS
+    if (numCacheHits + numCacheMisses > 0)
+	printf("Buffer cache: hits %d, misses %d, hit ratio %.4f, "
+	    "evictions %d, dirty write-backs %d\n", numCacheHits,
+	    numCacheMisses, numCacheHits / (double) (numCacheHits + numCacheMisses),
+	    numCacheEvictions, numCacheWriteBacks);
+    if (numCacheWriteBacks > 0)
+	printf("Buffer write-back: %d sectors in %d requests, flusher passes %d, "
+	    "dirty evictions %d\n", numCacheWriteBacks, numCacheWriteRuns,
+	    numCacheFlushes, numDirtyEvictions);
+    if (numReadAheads > 0)
+	printf("Read-ahead: %d sectors in %d requests\n", numReadAheads,
+	    numReadAheadRuns);
+    if (numIndirectHits + numIndirectMisses > 0)
+	printf("Index blocks: cache hits %d, misses %d\n", numIndirectHits,
+	    numIndirectMisses);
+#endif
+    if (numCpus > 1)
+	for (int i = 0; i < numCpus; i++)
+	    cpus[i]->Print();
 
     #ifdef USER_PROGRAM
-    //int numTLBHit = machine->numTLBAccess - machine->numTLBMiss;
-    int numTLBHit = machine->numTLBHit;
-    printf("TLB: accesses %d, hits %d, misses %d, evicts %d, hit rate %.4f\n", machine->numTLBAccess,
-        numTLBHit, machine->numTLBMiss, machine->numTLBEvict, 
-        numTLBHit / (float) machine->numTLBAccess);
+    // each CPU has a TLB of its own, and counts its own accesses
+    int numTLBAccess = 0, numTLBHit = 0, numTLBMiss = 0, numTLBEvict = 0;
+    int numPageAccess = 0, numPageHit = 0, numPageFault = 0, numPageSwap = 0;
+    for (int i = 0; i < numCpus; i++) {
+        Machine *m = cpus[i]->machine;
+        numTLBAccess += m->numTLBAccess;
+        numTLBHit += m->numTLBHit;
+        numTLBMiss += m->numTLBMiss;
+        numTLBEvict += m->numTLBEvict;
+        numPageAccess += m->numPageAccess;
+        numPageHit += m->numPageHit;
+        numPageFault += m->numPageFault;
+        numPageSwap += m->numPageSwap;
+    }
+    printf("TLB: accesses %d, hits %d, misses %d, evicts %d, hit rate %.4f\n", numTLBAccess,
+        numTLBHit, numTLBMiss, numTLBEvict, 
+        numTLBHit / (float) numTLBAccess);
 
     printf("Memory: total %d, used %d (unit: page)\n", memBitMap->GetSize(), memBitMap->GetUsed());
-    ASSERT(numTLBHit + machine->numTLBMiss == machine->numTLBAccess);
-    printf("Memory access: total %d, hits %d, faults %d, swaps %d, hit rate %.4f\n", machine->numPageAccess, 
-        machine->numPageHit, machine->numPageFault, machine->numPageSwap,
-        machine->numPageHit / (float) machine->numPageAccess);
+    ASSERT(numTLBHit + numTLBMiss == numTLBAccess);
+    printf("Memory access: total %d, hits %d, faults %d, swaps %d, hit rate %.4f\n", numPageAccess, 
+        numPageHit, numPageFault, numPageSwap,
+        numPageHit / (float) numPageAccess);
+    printf("Futex: waits %d, wakeups %d\n", numFutexWaits, numFutexWakeups);
     #endif
 }
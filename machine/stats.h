@@ -30,11 +30,43 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numDiskMerges;		// requests merged into the one before
+				// them by the disk scheduler
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numTimerInterrupts;	// number of timer interrupts raised
+    int numTimerSuppressed;	// number of timer interrupts not raised
+				// because the timer was left disarmed
+    int numSameSpaceSwitches;	// context switches that kept the loaded
+				// page table (and the TLB contents)
+    int numCrossSpaceSwitches;	// context switches that had to load a
+				// different page table and flush the TLB
+    int numTimedSameSpace;	// switches of each kind that were timed
+    int numTimedCrossSpace;	// (not a new thread's first switch,
+				// which never returns through Run)
+    double sameSpaceSwitchTime;	// host microseconds spent in the
+    double crossSpaceSwitchTime; // timed switches of each kind
+    int numFutexWaits;		// user threads put to sleep by Wait
+    int numFutexWakeups;	// user threads woken up by Wake
+    int numRealTimeReleases;	// periods started by real-time threads
+    int numDeadlineMisses;	// ... that ended with work left over
+    int numBudgetOverruns;	// ... in which the thread was throttled
+    int numWorkItems;		// deferred work run by the worker thread
+    int numTasklets;		// ... and at the end of interrupts
+    int numCacheHits;		// buffer cache lookups that found the
+    int numCacheMisses;		// sector, and that did not
+    int numCacheEvictions;	// sectors dropped from the cache
+    int numCacheWriteBacks;	// dirty sectors written back to disk
+    int numCacheWriteRuns;	// ... and the disk requests it took
+    int numCacheFlushes;	// flusher passes that wrote something
+    int numDirtyEvictions;	// evictions that had to write back first
+    int numReadAheads;		// sectors read ahead into the cache...
+    int numReadAheadRuns;	// ... and the disk requests it took
+    int numIndirectHits;	// index block lookups that found the
+    int numIndirectMisses;	// block cached, and that did not
 
     Statistics(); 		// initialize everything to zero
 
@@ -35,11 +35,17 @@ extern "C" {
 #include <sys/file.h>
 #include <sys/un.h>
 #include <sys/mman.h>
-#ifdef HOST_i386
+#include <pthread.h>
+#include <sched.h>
+#if defined(HOST_i386) || defined(HOST_x86_64)
 #include <unistd.h>
 #include <sys/time.h>
 #include <errno.h>
 #endif
+#ifdef HOST_x86_64
+#include <malloc.h>
+#include <ucontext.h>
+#endif
 #ifdef HOST_SPARC
 #include <unistd.h>
 #include <fcntl.h>
@@ -56,7 +62,7 @@ extern "C" {
   //int creat(const char *name, unsigned short mode);
   //int open(const char *name, int flags, ...);
 // void signal(int sig, VoidFunctionPtr func); -- this may work now!
-#ifdef HOST_i386
+#if defined(HOST_i386) || defined(HOST_x86_64)
 int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
              struct timeval *timeout);
 #else
@@ -131,7 +137,7 @@ PollFile(int fd)
         pollTime.tv_usec = 0;                 	// no delay
 
 // poll file or socket
-#if (defined(HOST_i386) || defined(HOST_SPARC)) 
+#if (defined(HOST_i386) || defined(HOST_x86_64) || defined(HOST_SPARC)) 
     retVal = select(32, (fd_set*)&rfd, (fd_set*)&wfd, (fd_set*)&xfd, &pollTime);
 #else
     retVal = select(32, &rfd, &wfd, &xfd, &pollTime);
@@ -234,7 +240,7 @@ Lseek(int fd, int offset, int whence)
 int 
 Tell(int fd)
 {
-#ifdef HOST_i386
+#if defined(HOST_i386) || defined(HOST_x86_64)
     return lseek(fd,0,SEEK_CUR); // 386BSD doesn't have the tell() system call
 #else
     return tell(fd);
@@ -357,7 +363,7 @@ ReadFromSocket(int sockID, char *buffer, int packetSize)
     int retVal;
     //    extern int errno;	errno sometimes defined as a macro
     struct sockaddr_un uName;
-#ifdef HOST_i386
+#if defined(HOST_i386) || defined(HOST_x86_64)
     unsigned int size = sizeof(uName);
 #else
     int size = sizeof(uName);
@@ -416,6 +422,213 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the wall-clock time of the host, in microseconds.  Only
+//	meaningful as a difference between two calls; used to measure
+//	how fast the simulation itself runs.
+//----------------------------------------------------------------------
+
+double 
+HostTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec * 1000000.0 + (double) tv.tv_usec;
+}
+
+//----------------------------------------------------------------------
+// StartHostThread
+// 	Run (*func)(arg) on a new host thread, concurrently with the
+//	caller, until the whole program exits.  Used to give each
+//	simulated CPU of a multiprocessor a host processor of its own.
+//----------------------------------------------------------------------
+
+struct HostThreadStart {
+    VoidFunctionPtr func;
+    int arg;
+};
+
+static void *
+HostThreadRoot(void *p)
+{
+    HostThreadStart *start = (HostThreadStart *) p;
+    VoidFunctionPtr func = start->func;
+    int arg = start->arg;
+
+    delete start;
+    (*func)(arg);
+    return NULL;
+}
+
+void
+StartHostThread(VoidFunctionPtr func, int arg)
+{
+    HostThreadStart *start = new HostThreadStart;
+    pthread_t tid;
+
+    start->func = func;
+    start->arg = arg;
+#ifdef HOST_x86_64
+    // the host thread's own stack must be below 2GB too (see
+    // __wrap_main, below); it is never freed, like the thread.
+    pthread_attr_t attr;
+    int stackSize = 1024 * 1024;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, new char[stackSize], stackSize);
+    if (pthread_create(&tid, &attr, HostThreadRoot, start) != 0) {
+#else
+    if (pthread_create(&tid, NULL, HostThreadRoot, start) != 0) {
+#endif
+	perror("pthread_create");
+	Abort();
+    }
+    pthread_detach(tid);
+}
+
+#ifdef HOST_x86_64
+//----------------------------------------------------------------------
+// __wrap_main
+// 	Nachos stores pointers in ints throughout (thread arguments,
+//	interrupt handler arguments, list items), so on a 64-bit host
+//	every address it hands out must fit in 31 bits.  Linking with
+//	-no-pie puts the program's own data there.  The program is also
+//	linked with --wrap=main, so that the C library starts it here:
+//	this keeps the heap low, by making malloc grow the data segment
+//	rather than map memory elsewhere, and then runs Nachos's main
+//	on a stack taken from that heap, with a copy of its arguments,
+//	since it too passes the addresses of its locals around.
+//----------------------------------------------------------------------
+
+extern "C" int __real_main(int argc, char **argv);
+
+static int mainArgc, mainResult;
+static char **mainArgv;
+static ucontext_t hostContext, mainContext;
+
+static void
+MainRoot()
+{
+    mainResult = __real_main(mainArgc, mainArgv);
+}
+
+extern "C" int
+__wrap_main(int argc, char **argv)
+{
+    int stackSize = 8 * 1024 * 1024;
+
+    mallopt(M_MMAP_MAX, 0);		// no mmap for large blocks
+    mallopt(M_ARENA_MAX, 1);		// nor for host threads' arenas
+
+    mainArgc = argc;
+    mainArgv = new char *[argc + 1];
+    for (int i = 0; i < argc; i++)
+	mainArgv[i] = strdup(argv[i]);
+    mainArgv[argc] = NULL;
+
+    getcontext(&mainContext);
+    mainContext.uc_stack.ss_sp = new char[stackSize];
+    mainContext.uc_stack.ss_size = stackSize;
+    mainContext.uc_link = &hostContext;
+    makecontext(&mainContext, MainRoot, 0);
+    swapcontext(&hostContext, &mainContext);
+    return mainResult;
+}
+
+#endif
+//----------------------------------------------------------------------
+// TestAndSet, ClearWord, FetchAndAdd
+// 	Atomic operations on a word of memory shared between host
+//	threads.  TestAndSet sets *word to 1 and returns what it was;
+//	ClearWord sets it back to 0, making everything written before
+//	it visible to the next thread whose TestAndSet returns 0.
+//	FetchAndAdd adds "n" to *word and returns what it was.
+//----------------------------------------------------------------------
+
+int
+TestAndSet(int *word)
+{
+    return __sync_lock_test_and_set(word, 1);
+}
+
+void
+ClearWord(int *word)
+{
+    __sync_lock_release(word);
+}
+
+int
+FetchAndAdd(int *word, int n)
+{
+    return __sync_fetch_and_add(word, n);
+}
+
+//----------------------------------------------------------------------
+// SpinDelay
+// 	Called between tries at a word some other host thread holds:
+//	let the host run something else, in case the holder is waiting
+//	for a processor.
+//----------------------------------------------------------------------
+
+void
+SpinDelay()
+{
+    sched_yield();
+}
+
+//----------------------------------------------------------------------
+// NewHostMonitor, EnterHostMonitor, LeaveHostMonitor,
+// WaitHostMonitor, WakeHostMonitor
+// 	A host mutex and condition variable, for host threads that have
+//	to block until another one is done, rather than spin.  Wait
+//	must be called inside the monitor; it leaves it while blocked.
+//	Wake wakes up every thread waiting in it.  A monitor is never
+//	freed: threads may still be blocked in it when Nachos exits.
+//----------------------------------------------------------------------
+
+struct HostMonitor {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+void *
+NewHostMonitor()
+{
+    HostMonitor *m = new HostMonitor;
+
+    pthread_mutex_init(&m->mutex, NULL);
+    pthread_cond_init(&m->cond, NULL);
+    return m;
+}
+
+void
+EnterHostMonitor(void *monitor)
+{
+    pthread_mutex_lock(&((HostMonitor *) monitor)->mutex);
+}
+
+void
+LeaveHostMonitor(void *monitor)
+{
+    pthread_mutex_unlock(&((HostMonitor *) monitor)->mutex);
+}
+
+void
+WaitHostMonitor(void *monitor)
+{
+    HostMonitor *m = (HostMonitor *) monitor;
+
+    pthread_cond_wait(&m->cond, &m->mutex);
+}
+
+void
+WakeHostMonitor(void *monitor)
+{
+    pthread_cond_broadcast(&((HostMonitor *) monitor)->cond);
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -43,6 +43,23 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 
+// Host wall-clock time in microseconds, for timing the simulator itself
+extern double HostTime();
+
+// Host threads, one for each simulated CPU of a multiprocessor (-smp),
+// and what they need to share memory: atomic operations on a word,
+// for spin locks, and monitors, for blocking until the others are done
+extern void StartHostThread(VoidFunctionPtr func, int arg);
+extern int TestAndSet(int *word);	// set *word to 1, return old value
+extern void ClearWord(int *word);	// set it back to 0
+extern int FetchAndAdd(int *word, int n);
+extern void SpinDelay();		// back off while someone holds a word
+extern void *NewHostMonitor();
+extern void EnterHostMonitor(void *monitor);
+extern void LeaveHostMonitor(void *monitor);
+extern void WaitHostMonitor(void *monitor);
+extern void WakeHostMonitor(void *monitor);
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
 
@@ -39,19 +39,58 @@ static void TimerHandler(int arg)
 //      "callArg" is the parameter to be passed to the interrupt handler.
 //      "doRandom" -- if true, arrange for the interrupts to occur
 //		at random, instead of fixed, intervals.
+//      "doTickless" -- if true, don't interrupt again unless re-armed;
+//		the timer starts out disarmed.
 //----------------------------------------------------------------------
 
-Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom)
+Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+	     bool doTickless)
 {
     randomize = doRandom;
+    tickless = doTickless;
     handler = timerHandler;
     arg = callArg; 
+    armed = FALSE;
+    disarmedAt = stats->totalTicks;
 
     // schedule the first interrupt from the timer device
+    if (!tickless)
+	Arm();
+}
+
+//----------------------------------------------------------------------
+// Timer::Arm
+//      Schedule the next timer interrupt, unless one is already
+//	scheduled.  Any time slices that went by while the timer was
+//	off are counted as suppressed interrupts.
+//----------------------------------------------------------------------
+
+void
+Timer::Arm()
+{
+    if (armed)
+	return;
+    UpdateStats();
+    armed = TRUE;
     interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
 		TimerInt); 
 }
 
+//----------------------------------------------------------------------
+// Timer::UpdateStats
+//      Count the interrupts a periodic timer would have raised since
+//	we were disarmed.
+//----------------------------------------------------------------------
+
+void
+Timer::UpdateStats()
+{
+    if (armed)
+	return;
+    stats->numTimerSuppressed += (stats->totalTicks - disarmedAt) / TimerTicks;
+    disarmedAt += ((stats->totalTicks - disarmedAt) / TimerTicks) * TimerTicks;
+}
+
 //----------------------------------------------------------------------
 // Timer::TimerExpired
 //      Routine to simulate the interrupt generated by the hardware 
@@ -61,9 +100,14 @@ Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom)
 void 
 Timer::TimerExpired() 
 {
-    // schedule the next timer device interrupt
-    interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
-		TimerInt);
+    stats->numTimerInterrupts++;
+    armed = FALSE;
+    disarmedAt = stats->totalTicks;
+
+    // schedule the next timer device interrupt; in tickless mode
+    // the handler re-arms us if it needs another one
+    if (!tickless)
+	Arm();
 
     // invoke the Nachos interrupt handler for this device
     (*handler)(arg);
@@ -11,6 +11,11 @@
 //	In order to introduce some randomness into time-slicing, if "doRandom"
 //	is set, then the interrupt comes after a random number of ticks.
 //
+//	If "doTickless" is set, the timer is one-shot rather than periodic:
+//	it only interrupts again if the kernel re-arms it (with Arm),
+//	which the kernel does only when there is something to time-slice
+//	or someone to wake up.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -26,11 +31,19 @@
 // The following class defines a hardware timer. 
 class Timer {
   public:
-    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom);
+    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+	  bool doTickless = FALSE);
 				// Initialize the timer, to call the interrupt
 				// handler "timerHandler" every time slice.
     ~Timer() {}
 
+    void Arm();			// in tickless mode, make sure the next
+				// interrupt is scheduled
+    bool IsArmed() { return armed; }
+    bool IsTickless() { return tickless; }
+    void UpdateStats();		// account for interrupts suppressed
+				// so far into stats
+
 // Internal routines to the timer emulation -- DO NOT call these
 
     void TimerExpired();	// called internally when the hardware
@@ -41,6 +54,10 @@ class Timer {
 
   private:
     bool randomize;		// set if we need to use a random timeout delay
+    bool tickless;		// set if only armed on demand
+    bool armed;			// is an interrupt scheduled?
+    int disarmedAt;		// when the last interrupt fired without
+				// the timer being re-armed
     VoidFunctionPtr handler;	// timer interrupt handler 
     int arg;			// argument to pass to interrupt handler
 
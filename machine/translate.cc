@@ -91,15 +91,17 @@ Machine::ReadMem(int addr, int size, int *value)
     int data;
     ExceptionType exception;
     int physicalAddress;
+    int affinity;
     
     DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
     
     //.
-    AcquireLock();
+    affinity = BeginAccess();
     //..
 
     exception = Translate(addr, &physicalAddress, size, FALSE);
     if (exception != NoException) {
+	EndAccess(affinity);
 	machine->RaiseException(exception, addr);
 	return FALSE;
     }
@@ -122,7 +124,7 @@ Machine::ReadMem(int addr, int size, int *value)
       default: ASSERT(FALSE);
     }
     //.
-    ReleaseLock();
+    EndAccess(affinity);
     //..
 
     DEBUG('a', "\tvalue read = %8.8x\n", *value);
@@ -147,14 +149,16 @@ Machine::WriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
+    int affinity;
      
     DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
     //.
-    AcquireLock();
+    affinity = BeginAccess();
     //..
 
     exception = Translate(addr, &physicalAddress, size, TRUE);
     if (exception != NoException) {
+	EndAccess(affinity);
 	machine->RaiseException(exception, addr);
 	return FALSE;
     }
@@ -182,18 +186,135 @@ Machine::WriteMem(int addr, int size, int value)
 	machine->numPageAccess += 1;
 	ctrlLock->Release();*/
 	//..
-	ReleaseLock();
+	EndAccess(affinity);
 	//..
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::LoadLinked
+//      Read the word at virtual address "addr" into "value", and
+//	reserve the address for a StoreConditional.  Reading and
+//	reserving happen together, so that no SC on another CPU can
+//	store in between and leave us a reservation on a stale value.
+//
+//   	Returns FALSE if the translation step from virtual to physical memory
+//   	failed.
+//----------------------------------------------------------------------
+
+bool
+Machine::LoadLinked(int addr, int *value)
+{
+    ExceptionType exception;
+    int physicalAddress;
+    int affinity = BeginAccess();
+
+    exception = Translate(addr, &physicalAddress, 4, FALSE);
+    if (exception != NoException) {
+	EndAccess(affinity);
+	RaiseException(exception, addr);
+	return FALSE;
+    }
+    ((SpinLock *) llLock)->Lock();
+    *value = WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+    llBit = TRUE;
+    llAddr = addr;
+    ((SpinLock *) llLock)->Unlock();
+    EndAccess(affinity);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::StoreConditional
+//      Write "value" to the word at virtual address "addr", if the
+//	reservation LoadLinked made for it is still there, and set
+//	"stored" to say whether we did.  Either way the reservation is
+//	gone afterwards.
+//
+//	The reservation is only checked once the address is translated:
+//	a TLB miss or a page fault may let other threads run, and a
+//	context switch clears it (see Thread::RestoreUserState).  Then
+//	checking and storing happen together, and the store clears the
+//	reservations other CPUs hold on the same address, so only one
+//	SC of any race succeeds.  (Addresses in other address spaces may
+//	match too; their SCs fail for nothing, and try again.)
+//
+//   	Returns FALSE if the translation step from virtual to physical memory
+//   	failed.
+//----------------------------------------------------------------------
+
+bool
+Machine::StoreConditional(int addr, int value, bool *stored)
+{
+    ExceptionType exception;
+    int physicalAddress;
+    int affinity = BeginAccess();
+
+    exception = Translate(addr, &physicalAddress, 4, TRUE);
+    if (exception != NoException) {
+	EndAccess(affinity);
+	RaiseException(exception, addr);
+	return FALSE;
+    }
+    ((SpinLock *) llLock)->Lock();
+    *stored = (llBit && llAddr == addr);
+    if (*stored) {
+	*(unsigned int *) &mainMemory[physicalAddress]
+		= WordToMachine((unsigned int) value);
+	for (int i = 0; i < numCpus; i++)
+	    if (cpus[i]->machine->llAddr == addr)
+		cpus[i]->machine->llBit = FALSE;
+    }
+    llBit = FALSE;
+    ((SpinLock *) llLock)->Unlock();
+    EndAccess(affinity);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::AcquireLock, ReleaseLock
+// 	Hold the access lock alone, to change which page is where: no
+//	CPU is reading or writing user memory meanwhile.
+//----------------------------------------------------------------------
+
 void Machine::AcquireLock(){
-	Lock *ctrlLock = (Lock *)(machine->accessLock);
-	ctrlLock->Acquire();
+	ReadWriteLock *ctrlLock = (ReadWriteLock *)(machine->accessLock);
+	ctrlLock->BeforeWrite();
 }
 void Machine::ReleaseLock(){
-	Lock *ctrlLock = (Lock *)(machine->accessLock);
-	ctrlLock->Release();
+	ReadWriteLock *ctrlLock = (ReadWriteLock *)(machine->accessLock);
+	ctrlLock->AfterWrite();
+}
+
+//----------------------------------------------------------------------
+// Machine::BeginAccess, EndAccess
+// 	Bracket an access to user memory.  Take a share of the access
+//	lock, so that no page fault, on this CPU or another, moves pages
+//	around under us (see CachePageEntryInTLB); and keep the current
+//	thread on this CPU until we are done.  An access may wait for
+//	the lock or for a page, or be preempted, and if another CPU
+//	picked the thread up meanwhile, the rest of the instruction
+//	would go on with this CPU's registers and TLB.  The thread is
+//	pinned with an affinity hint (see Scheduler::PickCpu and
+//	StealWork); BeginAccess returns the old hint, for EndAccess to
+//	put back.
+//----------------------------------------------------------------------
+
+int
+Machine::BeginAccess()
+{
+    int affinity = currentThread->getAffinity();
+
+    currentThread->setAffinity(currentCpu->getId());
+    ((ReadWriteLock *) accessLock)->BeforeRead();
+    return affinity;
+}
+
+void
+Machine::EndAccess(int affinity)
+{
+    ((ReadWriteLock *) accessLock)->AfterRead();
+    currentThread->setAffinity(affinity);
 }
 //----------------------------------------------------------------------
 // Machine::Translate
@@ -141,8 +141,9 @@ MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data)
 //----------------------------------------------------------------------
 // PostalHelper, ReadAvail, WriteDone
 // 	Dummy functions because C++ can't indirectly invoke member functions
-//	The first is forked as part of the "postal worker thread; the
-//	later two are called by the network interrupt handler.
+//	The first is run on the kernel work queue, in place of the old
+//	"postal worker" thread; the later two are called by the network
+//	interrupt handler.
 //
 //	"arg" -- pointer to the Post Office managing the Network
 //----------------------------------------------------------------------
@@ -160,10 +161,11 @@ static void WriteDone(int arg)
 //	Also initialize the network device, to allow post offices
 //	on different machines to deliver messages to one another.
 //
-//      We use a separate thread "the postal worker" to wait for messages 
-//	to arrive, and deliver them to the correct mailbox.  Note that
-//	delivering messages to the mailboxes can't be done directly
-//	by the interrupt handlers, because it requires a Lock.
+//      Incoming messages are delivered to the correct mailbox by a work
+//	item on the kernel work queue, which the interrupt handler queues
+//	when a message arrives.  Note that delivering messages to the
+//	mailboxes can't be done directly by the interrupt handlers, 
+//	because it requires a Lock.
 //
 //	"addr" is this machine's network ID 
 //	"reliability" is the probability that a network packet will
@@ -176,7 +178,8 @@ static void WriteDone(int arg)
 PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
 {
 // First, initialize the synchronization with the interrupt handlers
-    messageAvailable = new Semaphore("message available", 0);
+    delivery = new WorkItem(PostalHelper, (int) this);
+    inBuffer = new char[MaxPacketSize];
     messageSent = new Semaphore("message sent", 0);
     sendLock = new Lock("message send lock");
 
@@ -187,13 +190,6 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
 
 // Third, initialize the network; tell it which interrupt handlers to call
     network = new Network(addr, reliability, ReadAvail, WriteDone, (int) this);
-
-
-// Finally, create a thread whose sole job is to wait for incoming messages,
-//   and put them in the right mailbox. 
-    Thread *t = new Thread("postal worker");
-
-    t->Fork(PostalHelper, (int) this);
 }
 
 //----------------------------------------------------------------------
@@ -205,14 +201,20 @@ PostOffice::~PostOffice()
 {
     delete network;
     delete [] boxes;
-    delete messageAvailable;
+    delete delivery;
+    delete [] inBuffer;
     delete messageSent;
     delete sendLock;
 }
 
 //----------------------------------------------------------------------
 // PostOffice::PostalDelivery
-// 	Wait for incoming messages, and put them in the right mailbox.
+// 	Put the incoming message, if any, in the right mailbox.  Run on
+//	the kernel work queue each time a message arrives.
+//
+//	The network holds only one incoming message at a time, and polls
+//	for the next one only after we take it; so we loop until there is
+//	none left, in case one more arrived while we were running.
 //
 //      Incoming messages have had the PacketHeader stripped off,
 //	but the MailHeader is still tacked on the front of the data.
@@ -223,12 +225,13 @@ PostOffice::PostalDelivery()
 {
     PacketHeader pktHdr;
     MailHeader mailHdr;
-    char *buffer = new char[MaxPacketSize];
+    char *buffer = inBuffer;
 
     for (;;) {
-        // first, wait for a message
-        messageAvailable->P();	
+        // first, take the message off the network
         pktHdr = network->Receive(buffer);
+	if (pktHdr.length == 0)		// nothing there (every message
+	    return;			// has at least a MailHeader)
 
         mailHdr = *(MailHeader *)buffer;
         if (DebugIsEnabled('n')) {
@@ -319,13 +322,13 @@ PostOffice::Receive(int box, PacketHeader *pktHdr,
 // PostOffice::IncomingPacket
 // 	Interrupt handler, called when a packet arrives from the network.
 //
-//	Signal the PostalDelivery routine that it is time to get to work!
+//	Queue the PostalDelivery routine: it is time to get to work!
 //----------------------------------------------------------------------
 
 void
 PostOffice::IncomingPacket()
 { 
-    messageAvailable->V(); 
+    workQueue->Queue(delivery); 
 }
 
 //----------------------------------------------------------------------
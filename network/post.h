@@ -30,6 +30,7 @@
 
 #include "network.h"
 #include "synchlist.h"
+#include "workqueue.h"
 
 // Mailbox address -- uniquely identifies a mailbox on a given machine.
 // A mailbox is just a place for temporary storage for messages.
@@ -117,15 +118,15 @@ class PostOffice {
     				// Retrieve a message from "box".  Wait if
 				// there is no message in the box.
 
-    void PostalDelivery();	// Wait for incoming messages, 
-				// and then put them in the correct mailbox
+    void PostalDelivery();	// Put incoming messages in the
+				// correct mailbox; run on the work queue
 
     void PacketSent();		// Interrupt handler, called when outgoing 
 				// packet has been put on network; next 
 				// packet can now be sent
     void IncomingPacket();	// Interrupt handler, called when incoming
    				// packet has arrived and can be pulled
-				// off of network (i.e., time to call 
+				// off of network (i.e., time to queue
 				// PostalDelivery)
 
   private:
@@ -133,7 +134,9 @@ class PostOffice {
     NetworkAddress netAddr;	// Network address of this machine
     MailBox *boxes;		// Table of mail boxes to hold incoming mail
     int numBoxes;		// Number of mail boxes
-    Semaphore *messageAvailable;// V'ed when message has arrived from network
+    WorkItem *delivery;		// queued when message has arrived from
+				// network
+    char *inBuffer;		// where PostalDelivery copies it to
     Semaphore *messageSent;	// V'ed when next message can be sent to network
     Lock *sendLock;		// Only one outgoing message at a time
 };
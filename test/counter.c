@@ -0,0 +1,90 @@
+/* counter.c
+ *	Test program for the user-level synchronization library.
+ *
+ *	Four threads add to a shared counter under a mutex, yielding
+ *	in the middle of the critical section so that the others pile
+ *	up on it, then meet at a barrier; the main thread then hands
+ *	items to the others through a one-slot buffer guarded by a
+ *	condition variable.  Prints 4 * NumAdds, then the sum of the
+ *	items, 1 + 2 + ... + NumItems.
+ */
+
+#include "syscall.h"
+#include "usync.h"
+
+#define NumThreads	4
+#define NumAdds		50
+#define NumItems	30
+
+Mutex lock;
+CondVar changed;
+Barrier barrier;
+int counter = 0;
+int slot = 0;			/* 0 when empty */
+int sum = 0;
+int taken = 0;
+
+void
+adder()
+{
+    int i, c;
+
+    for (i = 0; i < NumAdds; i++) {
+	MutexLock(&lock);
+	c = counter;
+	if (i % 8 == 0)
+	    Yield();
+	counter = c + 1;
+	MutexUnlock(&lock);
+    }
+    BarrierWait(&barrier);
+}
+
+void
+consumer()
+{
+    adder();
+    MutexLock(&lock);
+    while (taken < NumItems) {
+	while (slot == 0 && taken < NumItems)
+	    CondWait(&changed, &lock);
+	if (slot != 0) {
+	    sum += slot;
+	    slot = 0;
+	    taken++;
+	    CondBroadcast(&changed);
+	}
+    }
+    MutexUnlock(&lock);
+    BarrierWait(&barrier);
+    Exit(0);
+}
+
+int
+main()
+{
+    int i;
+
+    MutexInit(&lock);
+    CondInit(&changed);
+    BarrierInit(&barrier, NumThreads);
+    for (i = 1; i < NumThreads; i++)
+	Fork(consumer);
+    adder();
+    Print(counter);
+
+    MutexLock(&lock);
+    for (i = 1; i <= NumItems; i++) {
+	while (slot != 0)
+	    CondWait(&changed, &lock);
+	slot = i;
+	CondBroadcast(&changed);
+    }
+    while (taken < NumItems)
+	CondWait(&changed, &lock);
+    CondBroadcast(&changed);
+    MutexUnlock(&lock);
+    BarrierWait(&barrier);
+    Print(sum);
+    Exit(0);
+}
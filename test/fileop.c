@@ -10,6 +10,7 @@ int main(){
     wfid = Open(name);
     Print(wfid);
     Write(name, 2, wfid);
+    Fsync(wfid);
     Close(wfid);
     rfid = Open(name);
     Print(rfid);
@@ -17,5 +18,6 @@ int main(){
     Print(into[0]);
     Print(into[1]);
     Close(rfid);
+    Sync();
     Exit(0);
 }
@@ -0,0 +1,26 @@
+/* sleep.c
+ *	Simple program to test the Sleep system call.
+ *
+ *	A forked thread and the main thread each sleep for different
+ *	lengths of time, so their Prints interleave in a fixed order.
+ */
+
+#include "syscall.h"
+
+void sleeper(){
+	int i;
+	for (i = 0; i < 3; i++){
+		Sleep(1500);
+		Print(200 + i);
+	}
+	Exit(0);
+}
+int main(){
+	int i;
+	Fork(sleeper);
+	for (i = 0; i < 3; i++){
+		Sleep(1000);
+		Print(100 + i);
+	}
+	Exit(0);
+}
@@ -138,7 +138,87 @@ Print:
 	syscall
 	j	$31
 	.end Print
+
+	.globl Sleep
+	.ent	Sleep
+Sleep:
+	addiu $2,$0,SC_Sleep
+	syscall
+	j	$31
+	.end Sleep
+
+	.globl Wait
+	.ent	Wait
+Wait:
+	addiu $2,$0,SC_Wait
+	syscall
+	j	$31
+	.end Wait
+
+	.globl Wake
+	.ent	Wake
+Wake:
+	addiu $2,$0,SC_Wake
+	syscall
+	j	$31
+	.end Wake
+
+	.globl Sync
+	.ent	Sync
+Sync:
+	addiu $2,$0,SC_Sync
+	syscall
+	j	$31
+	.end Sync
+
+	.globl Fsync
+	.ent	Fsync
+Fsync:
+	addiu $2,$0,SC_Fsync
+	syscall
+	j	$31
+	.end Fsync
 //..
+
+/* -------------------------------------------------------------
+ * Atomic operations, for the synchronization library (usync.c).
+ *	Each returns the old value of the word at "addr" (r4).  A
+ *	context switch between the LL and the SC makes the SC fail,
+ *	so we just try again.
+ * -------------------------------------------------------------
+ */
+
+	.globl CompareAndSwap
+	.ent	CompareAndSwap
+CompareAndSwap:
+	ll	$2,0($4)
+	bne	$2,$5,CasDone
+	move	$8,$6
+	sc	$8,0($4)
+	beq	$8,$0,CompareAndSwap
+CasDone:
+	j	$31
+	.end CompareAndSwap
+
+	.globl AtomicSwap
+	.ent	AtomicSwap
+AtomicSwap:
+	ll	$2,0($4)
+	move	$8,$5
+	sc	$8,0($4)
+	beq	$8,$0,AtomicSwap
+	j	$31
+	.end AtomicSwap
+
+	.globl AtomicAdd
+	.ent	AtomicAdd
+AtomicAdd:
+	ll	$2,0($4)
+	addu	$8,$2,$5
+	sc	$8,0($4)
+	beq	$8,$0,AtomicAdd
+	j	$31
+	.end AtomicAdd
 	
 /* dummy function to keep gcc happy */
         .globl  __main
@@ -0,0 +1,111 @@
+/* usync.c
+ *	User-level mutexes, condition variables and barriers.  See
+ *	usync.h.
+ *
+ *	The mutex is the usual three-state futex lock: a thread that
+ *	finds it taken marks it 2 ("contended") before sleeping, and only
+ *	an unlock that sees 2 has to make the Wake system call.
+ */
+
+#include "syscall.h"
+#include "usync.h"
+
+#define WakeAll	0x7fffffff
+
+void
+MutexInit(Mutex *m)
+{
+    m->state = 0;
+}
+
+void
+MutexLock(Mutex *m)
+{
+    int c = CompareAndSwap(&m->state, 0, 1);
+
+    if (c == 0)
+	return;				/* it was free: no trap */
+    if (c != 2)
+	c = AtomicSwap(&m->state, 2);
+    while (c != 0) {
+	Wait(&m->state, 2);
+	c = AtomicSwap(&m->state, 2);
+    }
+}
+
+void
+MutexUnlock(Mutex *m)
+{
+    if (AtomicAdd(&m->state, -1) != 1) {	/* it was 2 */
+	m->state = 0;
+	Wake(&m->state, 1);
+    }
+}
+
+void
+CondInit(CondVar *c)
+{
+    c->seq = 0;
+    c->waiters = 0;
+}
+
+/* Remember "seq" before letting go of the mutex: if a Signal comes in
+ * between, "seq" has changed, and Wait returns at once.
+ */
+void
+CondWait(CondVar *c, Mutex *m)
+{
+    int seq = c->seq;
+
+    c->waiters++;
+    MutexUnlock(m);
+    Wait(&c->seq, seq);
+    MutexLock(m);
+    c->waiters--;
+}
+
+void
+CondSignal(CondVar *c)
+{
+    if (c->waiters > 0) {
+	AtomicAdd(&c->seq, 1);
+	Wake(&c->seq, 1);
+    }
+}
+
+void
+CondBroadcast(CondVar *c)
+{
+    if (c->waiters > 0) {
+	AtomicAdd(&c->seq, 1);
+	Wake(&c->seq, WakeAll);
+    }
+}
+
+void
+BarrierInit(Barrier *b, int total)
+{
+    MutexInit(&b->lock);
+    b->count = 0;
+    b->total = total;
+    b->round = 0;
+}
+
+void
+BarrierWait(Barrier *b)
+{
+    int round;
+
+    MutexLock(&b->lock);
+    round = b->round;
+    if (++b->count == b->total) {
+	b->count = 0;
+	AtomicAdd(&b->round, 1);
+	MutexUnlock(&b->lock);
+	Wake(&b->round, WakeAll);
+	return;
+    }
+    MutexUnlock(&b->lock);
+    while (b->round == round)
+	Wait(&b->round, round);
+}
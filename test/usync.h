@@ -0,0 +1,56 @@
+/* usync.h
+ *	A small synchronization library for user programs whose threads
+ *	(created by Fork) share data: mutexes, condition variables and
+ *	barriers.
+ *
+ *	All of them are built out of the atomic operations in start.c,
+ *	which run entirely in user mode, plus the Wait and Wake system
+ *	calls for when a thread really has to sleep.  Taking a free mutex,
+ *	releasing one nobody waits for, or signalling a condition nobody
+ *	waits on, never traps to the kernel.
+ */
+
+#ifndef USYNC_H
+#define USYNC_H
+
+/* Atomic operations, in start.c.  Each returns the old value. */
+int CompareAndSwap(int *addr, int oldValue, int newValue);
+int AtomicSwap(int *addr, int value);
+int AtomicAdd(int *addr, int delta);
+
+/* A mutex is 0 when free, 1 when held, and 2 when held with (maybe)
+ * some thread sleeping in Wait on it.
+ */
+typedef struct {
+    int state;
+} Mutex;
+
+void MutexInit(Mutex *m);
+void MutexLock(Mutex *m);
+void MutexUnlock(Mutex *m);
+
+/* A condition variable.  As in the kernel, Wait, Signal and Broadcast
+ * must all be called with the same mutex held.
+ */
+typedef struct {
+    int seq;			/* bumped by every Signal/Broadcast */
+    int waiters;		/* threads in CondWait; under the mutex */
+} CondVar;
+
+void CondInit(CondVar *c);
+void CondWait(CondVar *c, Mutex *m);
+void CondSignal(CondVar *c);
+void CondBroadcast(CondVar *c);
+
+/* A barrier for "total" threads; it can be used over and over. */
+typedef struct {
+    Mutex lock;
+    int count;			/* threads arrived in this round */
+    int total;
+    int round;			/* bumped when the last one arrives */
+} Barrier;
+
+void BarrierInit(Barrier *b, int total);
+void BarrierWait(Barrier *b);
+
+#endif /* USYNC_H */
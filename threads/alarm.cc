@@ -0,0 +1,179 @@
+// alarm.cc
+//	Routines to put threads to sleep for a period of simulated time,
+//	using a hierarchical timing wheel driven by the timer device.
+//
+//	A thread that calls WaitUntil is put to sleep, and filed under
+//	the timer period in which it should wake up.  On every timer
+//	interrupt, CallBack advances the wheel to the current period,
+//	and puts every thread whose period has come back on the ready
+//	list.
+//
+//	Interrupts are disabled while touching the wheel; CallBack runs
+//	in the timer interrupt handler, so they are already off there.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "alarm.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Alarm::Alarm
+//	Initialize an empty timing wheel, starting at the current time.
+//----------------------------------------------------------------------
+
+Alarm::Alarm()
+{
+    now = stats->totalTicks / TimerTicks;
+    numWaiters = 0;
+}
+
+//----------------------------------------------------------------------
+// Alarm::~Alarm
+//	Nachos is halting; anyone still asleep will never wake up, so
+//	just drop them off the wheel.
+//----------------------------------------------------------------------
+
+Alarm::~Alarm()
+{
+    for (int level = 0; level < WheelLevels; level++)
+	for (int slot = 0; slot < WheelSize; slot++)
+	    while (wheel[level][slot].Remove() != NULL)
+		;
+}
+
+//----------------------------------------------------------------------
+// Alarm::Insert
+//	File a sleeping thread under its wake-up period.  A thread due
+//	within the next WheelSize periods goes in level 0; otherwise in
+//	the lowest level whose slots are coarse enough to reach it.
+//	The wake-up period must not be in the past.
+//----------------------------------------------------------------------
+
+void
+Alarm::Insert(Thread *thread)
+{
+    int when = thread->getWakeTime();
+    int delta = when - now;
+    int level = 0;
+
+    ASSERT(delta >= 0);
+    while (level < WheelLevels - 1 && delta >= (1 << ((level + 1) * WheelBits)))
+	level++;
+    if (level == WheelLevels - 1 && delta >= (1 << (WheelLevels * WheelBits)))
+	when = now + (1 << (WheelLevels * WheelBits)) - 1;  // clamp; it will
+							     // be re-filed
+    wheel[level][(when >> (level * WheelBits)) & WheelMask].Append(thread);
+}
+
+//----------------------------------------------------------------------
+// Alarm::Cascade
+//	Level "level - 1" has just wrapped around.  Take every thread in
+//	the current slot of "level" and file it again; by now each of
+//	them is due within a single turn of the level below.
+//----------------------------------------------------------------------
+
+void
+Alarm::Cascade(int level)
+{
+    ThreadQueue *slot = &wheel[level][(now >> (level * WheelBits)) & WheelMask];
+    Thread *thread;
+
+    while ((thread = slot->Remove()) != NULL)
+	Insert(thread);
+}
+
+//----------------------------------------------------------------------
+// Alarm::WaitUntil
+//	Suspend the current thread until at least "howLong" ticks of
+//	simulated time have passed.  The thread wakes up at the first
+//	timer interrupt after that.
+//
+//	"howLong" is the number of ticks to sleep
+//----------------------------------------------------------------------
+
+void
+Alarm::WaitUntil(int howLong)
+{
+    if (howLong <= 0)
+	return;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int when = stats->totalTicks + howLong;
+
+    DEBUG('t', "Thread \"%s\" sleeping until tick %d\n",
+	  currentThread->getName(), when);
+    // the slot for the current period may already have been emptied
+    currentThread->setWakeTime(max(divRoundUp(when, TimerTicks), now + 1));
+    Insert(currentThread);
+    numWaiters++;
+    timer->Arm();			// make sure someone will wake us
+    currentThread->Sleep();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Alarm::Cancel
+//	Wake up a thread that is asleep in WaitUntil now, rather than
+//	when its time is up; it returns from WaitUntil early.  Returns
+//	FALSE, and does nothing, if the thread is not asleep on the wheel
+//	-- it may have woken up already, or not gone to sleep yet.
+//
+//	"thread" is the thread to wake up
+//----------------------------------------------------------------------
+
+bool
+Alarm::Cancel(Thread *thread)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    ThreadQueue *queue = thread->getQueue();
+    bool asleep = (queue >= &wheel[0][0]
+		   && queue < &wheel[0][0] + WheelLevels * WheelSize);
+
+    if (asleep) {
+	DEBUG('t', "Waking up thread \"%s\" early, at tick %d\n",
+	      thread->getName(), stats->totalTicks);
+	queue->RemoveThread(thread);
+	numWaiters--;
+	scheduler->ReadyToRun(thread);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    return asleep;
+}
+
+//----------------------------------------------------------------------
+// Alarm::CallBack
+//	Called from the timer interrupt handler.  Advance the wheel one
+//	period at a time up to the current time (randomized time slices
+//	can skip periods), cascading the upper levels as the lower ones
+//	wrap around, and wake every thread in each level-0 slot passed.
+//----------------------------------------------------------------------
+
+void
+Alarm::CallBack()
+{
+    int target = stats->totalTicks / TimerTicks;
+    Thread *thread;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+    while (numWaiters > 0 && now < target) {
+	now++;
+	for (int level = 1; level < WheelLevels; level++) {
+	    if ((now & ((1 << (level * WheelBits)) - 1)) != 0)
+		break;
+	    Cascade(level);
+	}
+	ThreadQueue *slot = &wheel[0][now & WheelMask];
+	while ((thread = slot->Remove()) != NULL) {
+	    ASSERT(thread->getWakeTime() <= now);
+	    DEBUG('t', "Waking up thread \"%s\" at tick %d\n",
+		  thread->getName(), stats->totalTicks);
+	    numWaiters--;
+	    scheduler->ReadyToRun(thread);
+	}
+    }
+    if (numWaiters == 0)
+	now = target;		// nothing to wake; just catch up
+}
@@ -0,0 +1,59 @@
+// alarm.h
+//	Data structures for a software alarm clock.
+//
+//	Alarm::WaitUntil lets a kernel thread go to sleep for a given
+//	amount of simulated time.  Sleeping threads are kept on a
+//	hierarchical timing wheel that is advanced by the hardware
+//	timer interrupt, so a thousand sleepers cost no more per tick
+//	than one.
+//
+//	The wheel counts in timer periods (TimerTicks), so a thread
+//	wakes up on the first timer interrupt after its time is up.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include "copyright.h"
+#include "threadqueue.h"
+
+#define WheelBits	6
+#define WheelSize	(1 << WheelBits)	// slots per level
+#define WheelMask	(WheelSize - 1)
+#define WheelLevels	4			// covers 2^24 timer periods
+
+// The following class defines the alarm clock.  Level 0 of the wheel
+// has one slot per timer period; each slot of level i covers a whole
+// turn of level i-1.  When level i-1 wraps around, the next slot of
+// level i is emptied and its threads are spread back down ("cascaded").
+// Inserting a sleeper and expiring one are both O(1).
+
+class Alarm {
+  public:
+    Alarm();				// Initialize an empty wheel
+    ~Alarm();
+
+    void WaitUntil(int howLong);	// Put the current thread to sleep
+					// for at least "howLong" ticks
+    bool Cancel(Thread *thread);	// Wake up a thread sleeping in
+					// WaitUntil before its time
+    void CallBack();			// Called on every timer interrupt;
+					// wakes up threads whose time is up
+    int NumWaiters() { return numWaiters; }
+					// number of sleeping threads
+
+  private:
+    void Insert(Thread *thread);	// Put thread in the slot for its
+					// wake-up period
+    void Cascade(int level);		// Re-spread the current slot of
+					// "level" into the levels below
+
+    ThreadQueue wheel[WheelLevels][WheelSize];
+    int now;				// last timer period processed
+    int numWaiters;
+};
+
+#endif // ALARM_H
@@ -0,0 +1,178 @@
+// cpu.cc
+//	Routines to manage the simulated CPUs of a multiprocessor.
+//	See cpu.h for how the CPUs run on host threads.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "cpu.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Cpu::Cpu
+// 	Initialize a CPU with nothing to run.
+//
+//	"cpuId" is the CPU's index in the "cpus" array.
+//----------------------------------------------------------------------
+
+Cpu::Cpu(int cpuId)
+{
+    id = cpuId;
+    current = idleThread = NULL;
+    level = IntOff;			// interrupts start out disabled
+    status = SystemMode;
+    inHandler = holdsIntLock = FALSE;
+    spinDepth = 0;
+    roundTicks = roundSystemTicks = roundUserTicks = 0;
+    yieldOnReturn = FALSE;
+    rtLoad = 0;
+    busyTicks = idleTicks = 0;
+    numSteals = numMigrations = 0;
+#ifdef USER_PROGRAM
+    machine = NULL;			// see Initialize
+#endif
+}
+
+//----------------------------------------------------------------------
+// Cpu::~Cpu
+// 	Nachos may halt with threads still ready to run; they belong to
+//	whoever created them, so just forget about them.
+//----------------------------------------------------------------------
+
+Cpu::~Cpu()
+{
+    while (readyList.Remove() != NULL)
+	;
+    while (rtReadyList.Remove() != NULL)
+	;
+}
+
+//----------------------------------------------------------------------
+// CpuIdleLoop
+// 	The body of a CPU's idle thread.  Dispatch whatever becomes
+//	ready on this CPU, or that we can steal from another one; when
+//	there is nothing, sit out the rest of this round
+//	(Interrupt::IdleTick).
+//
+//	The idle thread is never on a ready list.  Scheduler::Run comes
+//	back here once the threads it dispatched have all gone to sleep
+//	(see Thread::Sleep).  It runs with interrupts off on this CPU,
+//	but never holds the machine-wide interrupt lock.
+//
+//	"arg" is the Cpu, cast to an int.
+//----------------------------------------------------------------------
+
+static void
+CpuIdleLoop(int arg)
+{
+    Cpu *cpu = (Cpu *) arg;
+    Thread *next;
+
+    (void) interrupt->DisableLocal();
+    for (;;) {
+	ASSERT(currentCpu == cpu && currentThread == cpu->idleThread);
+	scheduler->LockReadyLists();
+	next = scheduler->FindNextToRun();
+	if (next == NULL)
+	    next = scheduler->StealWork();
+	if (next != NULL) {
+	    currentThread->setStatus(BLOCKED);
+	    scheduler->Run(next);		// unlocks the ready lists
+	} else {
+	    scheduler->UnlockReadyLists();
+	    interrupt->IdleTick();
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// CpuStart
+// 	The start of the host thread of every CPU but the first (which
+//	runs on the host thread Nachos started on).  The CPU's idle thread
+//	runs on the host thread's own stack, as "main" does on CPU 0's.
+//
+//	"arg" is the Cpu, cast to an int.
+//----------------------------------------------------------------------
+
+static void
+CpuStart(int arg)
+{
+    Cpu *cpu = (Cpu *) arg;
+
+    currentCpu = cpu;
+    currentThread = cpu->idleThread;
+#ifdef USER_PROGRAM
+    machine = cpu->machine;
+#endif
+    threadToBeDestroyed = NULL;
+    CpuIdleLoop(arg);
+}
+
+//----------------------------------------------------------------------
+// Cpu::StartIdleThread
+// 	Create this CPU's idle thread.  CPU 0 is already running "main",
+//	so its idle thread gets a stack of its own and waits to be
+//	dispatched.  Every other CPU starts up now, on a new host
+//	thread, running its idle thread.
+//
+//	Only used in multiprocessor mode; a uniprocessor idles in
+//	Interrupt::Idle instead.
+//----------------------------------------------------------------------
+
+void
+Cpu::StartIdleThread()
+{
+    char *name = new char[16];
+
+    sprintf(name, "idle %d", id);
+    idleThread = createThread(name);
+    ASSERT(idleThread != NULL);
+    idleThread->setCpu(this);
+    if (current == NULL) {
+	idleThread->setStatus(RUNNING);
+	current = idleThread;
+	StartHostThread(CpuStart, (int) this);
+    } else {
+	idleThread->StackAllocate(CpuIdleLoop, (int) this);
+	idleThread->setStatus(BLOCKED);
+    }
+}
+
+//----------------------------------------------------------------------
+// Cpu::IsIdle
+// 	Return TRUE if this CPU is running its idle thread and has no
+//	threads waiting for it.
+//----------------------------------------------------------------------
+
+bool
+Cpu::IsIdle()
+{
+    return (current == idleThread && readyList.IsEmpty()
+	    && rtReadyList.IsEmpty());
+}
+
+//----------------------------------------------------------------------
+// Cpu::Load
+// 	Return the number of threads running or ready on this CPU.
+//----------------------------------------------------------------------
+
+int
+Cpu::Load()
+{
+    return readyList.NumInQueue() + rtReadyList.NumInQueue()
+	+ (current != idleThread ? 1 : 0);
+}
+
+//----------------------------------------------------------------------
+// Cpu::Print
+// 	Print this CPU's share of the work, at system shutdown.
+//----------------------------------------------------------------------
+
+void
+Cpu::Print()
+{
+    printf("CPU %d: busy %d, idle %d, steals %d, migrations %d\n", id,
+	busyTicks, idleTicks, numSteals, numMigrations);
+}
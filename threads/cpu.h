@@ -0,0 +1,113 @@
+// cpu.h
+//	Data structures for simulating a shared-memory multiprocessor.
+//
+//	With "-smp n", Nachos simulates n CPUs, each running on a host
+//	thread of its own, so that they really do run at the same time.
+//	Each CPU has its own running thread, its own ready list, its own
+//	interrupt level and its own idle thread.  Thread state that is
+//	per CPU on real hardware -- currentThread, currentCpu and
+//	threadToBeDestroyed -- is per host thread here.
+//
+//	The CPUs share the simulated clock.  Each runs for CpuQuantum
+//	ticks of its own, then waits for the others to do the same (see
+//	Interrupt::EndRound).  The last CPU to finish the round moves the
+//	clock forward by CpuQuantum and delivers the hardware interrupts
+//	that have come due, while the others wait; then they all go on.
+//	So n CPUs that are all busy get n times as much work done per
+//	tick as one, and interrupts only ever arrive between rounds.
+//
+//	Mutual exclusion no longer comes from turning interrupts off,
+//	since that only stops the current CPU.  Instead:
+//
+//	  - semaphores, locks, condition variables and reader/writer
+//	    locks each have a spin lock (see synch.h), which turns off
+//	    interrupts on this CPU and keeps the other CPUs out;
+//	  - the ready lists of all the CPUs share one spin lock, held
+//	    across each context switch (see Scheduler::Run);
+//	  - everything else that relies on turning interrupts off still
+//	    works: with several CPUs, SetLevel(IntOff) also takes a
+//	    machine-wide interrupt lock, so such code still runs atomically
+//	    with respect to every CPU, not just the one it is on.  The
+//	    interrupt lock comes before any spin lock: a CPU holding a spin
+//	    lock may not take it.
+//
+//	Each CPU also has a Machine of its own -- user registers, TLB and
+//	page table register -- so user programs run on any CPU, and
+//	"machine" is per host thread too.  Main memory, and the table of
+//	who owns each page frame, are shared by all the Machines (see
+//	Machine::Machine).
+//
+//	Without "-smp" there is exactly one CPU, no idle threads and no
+//	host threads, and everything behaves as on the original
+//	uniprocessor.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "copyright.h"
+#include "threadqueue.h"
+#include "interrupt.h"
+
+class Thread;
+class Machine;
+
+#define MaxCpus		16	// most CPUs "-smp" will simulate
+#define CpuQuantum	100	// ticks each CPU runs per round
+
+// The following class defines one simulated CPU.  As with Statistics,
+// the fields are public to make them easier to update.
+
+class Cpu {
+  public:
+    Cpu(int cpuId);			// initialize an idle CPU
+    ~Cpu();
+
+    int getId() { return id; }
+    void StartIdleThread();		// create the thread this CPU runs
+					// when it has nothing else to do
+    bool IsIdle();			// nothing running, nothing ready?
+    int Load();				// how many threads want this CPU
+    void Print();			// print per-CPU statistics
+
+    Thread *current;			// thread running on this CPU
+    Thread *idleThread;			// NULL on a uniprocessor
+    ThreadQueue readyList;		// threads ready to run on this CPU,
+					// in priority order
+    ThreadQueue rtReadyList;		// real-time threads ready to run
+					// here, earliest deadline first
+    int rtLoad;				// permille of this CPU reserved
+					// by real-time threads
+    IntStatus level;			// are interrupts on, on this CPU?
+    MachineStatus status;		// idle, kernel mode, user mode
+    bool inHandler;			// running an interrupt handler?
+    bool holdsIntLock;			// has interrupts off machine-wide
+					// (see Interrupt::SetLevel)
+    int spinDepth;			// spin locks held (see synch.h)
+#ifdef USER_PROGRAM
+    Machine *machine;			// runs user code on this CPU
+#endif
+
+    int roundTicks;			// ticks used in the current round
+    int roundSystemTicks;		// ... in the kernel, and running
+    int roundUserTicks;			// user code: added to the global
+					// statistics when the round ends
+    bool yieldOnReturn;			// context switch this CPU on return
+					// from an interrupt handler
+
+    int busyTicks;			// ticks spent running threads
+    int idleTicks;			// ticks spent with nothing to do
+    int numSteals;			// threads taken from other CPUs'
+					// ready lists
+    int numMigrations;			// threads that moved here from the
+					// CPU they last ran on (including
+					// the ones we stole)
+
+  private:
+    int id;				// 0 .. numCpus - 1
+};
+
+#endif // CPU_H
@@ -0,0 +1,165 @@
+// lockprof.cc
+//	Routines to keep and print lock contention counters.  See
+//	lockprof.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "lockprof.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// LockStats::LockStats
+// 	Initialize the counters for one name to zero.
+//----------------------------------------------------------------------
+
+LockStats::LockStats(char *debugName, char *kindName)
+{
+    name = debugName;
+    kind = kindName;
+    acquires = contended = 0;
+    totalWait = maxWait = 0;
+    totalHold = maxHold = 0;
+    next = NULL;
+    word = 0;
+}
+
+//----------------------------------------------------------------------
+// LockStats::Acquired, Released
+// 	Add one acquisition, or one release, to the counters.
+//----------------------------------------------------------------------
+
+void
+LockStats::Acquired(bool wasContended, int waitTicks)
+{
+    while (TestAndSet(&word))
+	SpinDelay();
+    acquires++;
+    if (wasContended)
+	contended++;
+    totalWait += waitTicks;
+    if (waitTicks > maxWait)
+	maxWait = waitTicks;
+    ClearWord(&word);
+}
+
+void
+LockStats::Released(int holdTicks)
+{
+    while (TestAndSet(&word))
+	SpinDelay();
+    totalHold += holdTicks;
+    if (holdTicks > maxHold)
+	maxHold = holdTicks;
+    ClearWord(&word);
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::LockProfiler
+// 	Initialize an empty table.
+//----------------------------------------------------------------------
+
+LockProfiler::LockProfiler()
+{
+    for (int i = 0; i < LockProfBuckets; i++)
+	buckets[i] = NULL;
+    numEntries = 0;
+    word = 0;
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::~LockProfiler
+// 	De-allocate the counters.  Anyone still holding a pointer to
+//	them must not use it afterwards.
+//----------------------------------------------------------------------
+
+LockProfiler::~LockProfiler()
+{
+    for (int i = 0; i < LockProfBuckets; i++)
+	while (buckets[i] != NULL) {
+	    LockStats *s = buckets[i];
+	    buckets[i] = s->next;
+	    delete s;
+	}
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::Lookup
+// 	Return the counters for the given name and kind of object,
+//	creating them if this is the first time we see that name.
+//	Each synchronization object calls this once, on first use, and
+//	keeps the pointer.
+//----------------------------------------------------------------------
+
+LockStats *
+LockProfiler::Lookup(char *name, char *kind)
+{
+    unsigned int hash = 0;
+    LockStats *s;
+
+    for (char *p = name; *p != '\0'; p++)
+	hash = hash * 31 + *p;
+    hash %= LockProfBuckets;
+
+    while (TestAndSet(&word))
+	SpinDelay();
+    for (s = buckets[hash]; s != NULL; s = s->next)
+	if (!strcmp(s->name, name) && !strcmp(s->kind, kind))
+	    break;
+    if (s == NULL) {
+	s = new LockStats(name, kind);
+	s->next = buckets[hash];
+	buckets[hash] = s;
+	numEntries++;
+    }
+    ClearWord(&word);
+    return s;
+}
+
+//----------------------------------------------------------------------
+// WaitsLonger
+// 	Sort order for Print: most total waiting first, then most
+//	contended.
+//----------------------------------------------------------------------
+
+static bool
+WaitsLonger(LockStats *x, LockStats *y)
+{
+    if (x->totalWait != y->totalWait)
+	return (x->totalWait > y->totalWait);
+    return (x->contended > y->contended);
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::Print
+// 	Print the counters as a table, at system shutdown.
+//----------------------------------------------------------------------
+
+void
+LockProfiler::Print()
+{
+    LockStats **all = new LockStats*[numEntries];
+    int n = 0;
+
+    // insertion sort -- there are only ever a few dozen names
+    for (int i = 0; i < LockProfBuckets; i++)
+	for (LockStats *s = buckets[i]; s != NULL; s = s->next) {
+	    int j;
+	    for (j = n; j > 0 && WaitsLonger(s, all[j - 1]); j--)
+		all[j] = all[j - 1];
+	    all[j] = s;
+	    n++;
+	}
+
+    printf("Lock contention (ticks):\n");
+    printf("%-28s %-9s %9s %9s %10s %8s %10s %8s\n", "name", "kind",
+	"acquires", "contended", "wait", "max", "hold", "max");
+    for (int i = 0; i < n; i++)
+	printf("%-28s %-9s %9d %9d %10d %8d %10d %8d\n", all[i]->name,
+	    all[i]->kind, all[i]->acquires, all[i]->contended,
+	    all[i]->totalWait, all[i]->maxWait, all[i]->totalHold,
+	    all[i]->maxHold);
+    delete [] all;
+}
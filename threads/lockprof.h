@@ -0,0 +1,74 @@
+// lockprof.h
+//	Data structures for profiling contention on locks, semaphores
+//	and reader/writer locks.
+//
+//	With "-lockprof", every synchronization object keeps count of
+//	how often it is acquired, how often the caller had to wait, and
+//	for how long (in simulated ticks), and -- for locks -- for how
+//	long it was held.  Objects with the same debug name share one set
+//	of counters, so, for instance, all the "list lock"s of all the
+//	SynchLists show up as a single line.  The table is printed at
+//	halt, worst offenders first.
+//
+//	Profiling is off by default.  Then "lockProfiler" is NULL, and
+//	the synchronization routines only pay for testing it.
+//
+//	With several CPUs, objects with the same name may be acquired on
+//	two CPUs at once, so each set of counters, and the table, has a
+//	word to spin on of its own (see TestAndSet in sysdep.h).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include "copyright.h"
+
+#define LockProfBuckets	64	// size of the name hash table
+
+// The counters for one debug name.  The fields are public to make them
+// easier to update.
+
+class LockStats {
+  public:
+    LockStats(char *debugName, char *kindName);
+
+    void Acquired(bool contended, int waitTicks);
+					// record an acquisition
+    void Released(int holdTicks);	// record how long it was held
+
+    char *name;				// debug name of the object(s)
+    char *kind;				// "lock", "semaphore", ...
+    int acquires;			// number of acquisitions
+    int contended;			// how many of them had to wait
+    int totalWait, maxWait;		// ticks spent waiting
+    int totalHold, maxHold;		// ticks spent holding (locks only)
+    LockStats *next;			// next in the hash bucket
+    int word;				// spun on while updating
+};
+
+// The following class defines the table of counters, keyed by
+// (name, kind).
+
+class LockProfiler {
+  public:
+    LockProfiler();
+    ~LockProfiler();
+
+    LockStats *Lookup(char *name, char *kind);
+					// find the counters for a name,
+					// creating them the first time
+    void Print();			// print the table, most total
+					// waiting first
+
+  private:
+    LockStats *buckets[LockProfBuckets];
+    int numEntries;			// counters in the table
+    int word;				// spun on while looking up
+};
+
+extern LockProfiler *lockProfiler;	// NULL unless profiling is on
+
+#endif // LOCKPROF_H
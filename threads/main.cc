@@ -8,9 +8,12 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
-//		-f -cp <unix file> <nachos file>
+// Usage: nachos -d <debugflags> -rs <random seed #> -tickless -smp <#cpus>
+//		-trace <trace file> -lockprof
+//		-s -x <nachos file> -xn <#copies> <nachos file>
+//		-c <consoleIn> <consoleOut>
+//		-f -extents -cp <unix file> <nachos file>
+//		-cacheDisk -cacheSize <#sectors> -diskTracks <#tracks>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
 //              -o <other machine id>
@@ -18,15 +21,26 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -tickless only arms the timer when there is something to time-slice
+//    -smp simulates a multiprocessor with the given number of CPUs,
+//	each run by a host thread of its own
+//    -trace records scheduling events, written to the file at halt
+//    -lockprof prints lock contention counters at halt
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
 //    -x runs a user program
+//    -xn runs several copies of one at once, and times them
 //    -c tests the console
 //
 //  FILESYS
 //    -f causes the physical disk to be formatted
+//    -extents formats it with files mapped by extents, not sector by sector
+//    -cacheDisk puts a buffer cache in front of the disk
+//    -cacheSize does too, with the given number of buffers
+//    -diskTracks sets the size of the disk, in tracks of 32 sectors;
+//	 an existing disk must be given the size it was made with
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
@@ -64,7 +78,8 @@ extern void Print(char *file), PerformanceTest(void);
 extern void StartProcess(char *file), ConsoleTest(char *in, char *out);
 extern void MailTest(int networkID);
 //.
-extern void CreatProcess(char *filename);
+extern int CreatProcess(char *filename);
+extern void ProcessBenchmark(char *filename, int copies);
 
 //..
 //----------------------------------------------------------------------
@@ -143,6 +158,10 @@ main(int argc, char **argv)
             /*printf("Second Process.x\n");
             StartProcess(*(argv + 1));*/
             argCount = 2;
+        }else if (!strcmp(*argv, "-xn")){	// time n copies of one
+	    ASSERT(argc > 2);
+            ProcessBenchmark(*(argv + 2), atoi(*(argv + 1)));
+            argCount = 3;
         }else if (!strcmp(*argv, "-xd")){
         	printf("Run Different Process.\n");
         	int num = atoi(*(argv + 1));
@@ -207,10 +226,7 @@ main(int argc, char **argv)
 #endif // NETWORK
     }
 //.
-#ifdef FILESYS
-    if (useCacheSynchDisk)
-        ((CacheSynchDisk *)synchDisk)->WriteAllBack();
-#endif
+    SyncFileSystem();
 
     currentThread->Finish();	// NOTE: if the procedure "main" 
 				// returns, then the program "nachos"
@@ -3,8 +3,9 @@
 //	that thread.
 //
 // 	These routines assume that interrupts are already disabled.
-//	If interrupts are disabled, we can assume mutual exclusion
-//	(since we are on a uniprocessor).
+//	On a uniprocessor, that is enough for mutual exclusion; with
+//	several CPUs, the ready lists also have a spin lock of their own
+//	(see LockReadyLists).
 //
 // 	NOTE: We can't use Locks to provide mutual exclusion here, since
 // 	if we needed to wait for a lock, and the lock was busy, we would 
@@ -22,30 +23,74 @@
 #include "scheduler.h"
 #include "system.h"
 
+// Bookkeeping for the context switch latency counters.  These have to
+// live outside Run's stack frame: the half of Run after SWITCH executes
+// on the new thread's stack, where the old frame's locals are not
+// visible.  The ready-list lock, held across the switch, keeps the
+// other CPUs' switches out.
+
+static double switchStartTime;		// host time when Run was entered
+static bool switchCrossSpace;		// did this switch change page tables?
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
-// 	Initialize the list of ready but not running threads to empty.
+// 	Initialize the scheduler.  The ready lists themselves belong to
+//	the CPUs (see cpu.h), and start out empty.
 //----------------------------------------------------------------------
 
 Scheduler::Scheduler()
 { 
-    readyList = new List; 
+    readyDepth = 0;
+    numRealTime = 0;
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the scheduler.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
 } 
 
+//----------------------------------------------------------------------
+// Scheduler::LockReadyLists, UnlockReadyLists
+// 	Take and free the spin lock on every CPU's ready lists, with
+//	interrupts already off.  The CPU holding the lock may lock it
+//	again -- ReadyToRun, say, is called both by threads outside the
+//	scheduler and from within Yield and Sleep -- and it is only freed
+//	when the outermost lock is undone.
+//----------------------------------------------------------------------
+
+void
+Scheduler::LockReadyLists()
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+    if (readyLock.isHeldByCurrentCpu())
+	readyDepth++;
+    else {
+	readyLock.Lock();
+	readyDepth = 1;
+    }
+}
+
+void
+Scheduler::UnlockReadyLists()
+{
+    ASSERT(readyLock.isHeldByCurrentCpu() && readyDepth > 0);
+    if (--readyDepth == 0)
+	readyLock.Unlock();
+}
+
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
+//	With several CPUs, PickCpu decides whose ready list.
+//
+//	Real-time threads go on the CPU's real-time list instead, and
+//	preempt whatever that CPU is running if their deadline makes
+//	them more urgent.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
@@ -55,16 +100,71 @@ Scheduler::ReadyToRun (Thread *thread)
 {
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
+    LockReadyLists();
+    if (thread->getStatus() == SUSPENDED_BLK) {
+	// woken up while suspended; Thread::Awake will put it on the
+	// ready list once it is resumed
+	thread->setStatus(SUSPENDED_RDY);
+	UnlockReadyLists();
+	return;
+    }
+    if (thread->getStatus() == RUNNING)	// yielding: count what it ran
+	Charge(thread);
     thread->setStatus(READY);
+    Cpu *cpu = PickCpu(thread);
+    if (thread->getCpu() != NULL && thread->getCpu() != cpu)
+	cpu->numMigrations++;
+    thread->setCpu(cpu);
     //CQY
 //    readyList->Append((void *)thread); //Append method's function has been modified.
-    readyList->SortedInsert((void *)thread, thread->getPriority());
+    if (thread->rt != NULL && !thread->rt->throttled) {
+	cpu->rtReadyList.DeadlineInsert(thread);
+	if (cpu->current != NULL && cpu->current != thread 
+		&& NeedsTimeSlice(cpu))
+	    cpu->yieldOnReturn = TRUE;
+    } else
+	cpu->readyList.SortedInsert(thread);
+
+    // a tickless timer is off while the running thread has the CPU to
+    // itself; now there may be someone to share it with
+    if (timer != NULL && timer->IsTickless() && NeedsTimeSlice(cpu))
+	timer->Arm();
+    UnlockReadyLists();
+}
 
+//----------------------------------------------------------------------
+// Scheduler::PickCpu
+// 	Choose the CPU a ready thread should wait for.  A thread with an
+//	affinity hint goes to that CPU.  Otherwise a thread that has run
+//	before goes back to the CPU it last ran on, and a new thread goes
+//	to the CPU with the least work.  (Idle CPUs even things out
+//	later by stealing; see StealWork.)
+//----------------------------------------------------------------------
+
+Cpu *
+Scheduler::PickCpu(Thread *thread)
+{
+    Cpu *best;
+    int affinity = thread->getAffinity();
+
+    if (numCpus == 1)
+	return cpus[0];
+    if (affinity >= 0 && affinity < numCpus)
+	return cpus[affinity];
+    if (thread->getCpu() != NULL)
+	return thread->getCpu();
+    best = cpus[0];
+    for (int i = 1; i < numCpus; i++)
+	if (cpus[i]->Load() < best->Load())
+	    best = cpus[i];
+    return best;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
+// 	Return the next thread to be scheduled onto the current CPU:
+//	the real-time thread with the earliest deadline, if any, else
+//	the most important ordinary one.
 //	If there are no ready threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
@@ -74,13 +174,14 @@ Thread *
 Scheduler::FindNextToRun ()
 {
 //    Print();
-    do{
-        Thread *t = (Thread *)readyList->Remove();
-        if (t == NULL)
-            return NULL;
-        if (t->getStatus() != SUSPENDED_RDY)
-            return t;
-    } while(TRUE);
+    ASSERT(readyLock.isHeldByCurrentCpu());
+    Thread *t = currentCpu->rtReadyList.Remove();
+
+    if (t == NULL)
+	t = currentCpu->readyList.Remove();
+
+    ASSERT(t == NULL || t->getStatus() == READY);
+    return t;
 }
 
 //----------------------------------------------------------------------
@@ -91,6 +192,11 @@ Scheduler::FindNextToRun ()
 //
 //      Note: we assume the state of the previously running thread has
 //	already been changed from running to blocked or ready (depending).
+//
+//	Called with the ready lists locked, once; the lock is held across
+//	the switch, and it is the thread we switch to that unlocks it
+//	(here, or in InterruptEnable if it is new).  So is the interrupt
+//	lock, on a multiprocessor: see Interrupt::RestoreIntLock.
 // Side effect:
 //	The global variable currentThread becomes nextThread.
 //
@@ -101,6 +207,23 @@ void
 Scheduler::Run (Thread *nextThread)
 {
     Thread *oldThread = currentThread;
+    bool hadIntLock = interrupt->HoldsIntLock();
+
+    ASSERT(readyLock.isHeldByCurrentCpu() && readyDepth == 1);
+    TRACE(TraceSwitch, nextThread->getTid(), NULL);
+    switchStartTime = HostTime();
+    switchCrossSpace = FALSE;
+#ifdef USER_PROGRAM
+    // Threads that share the loaded address space (and kernel threads,
+    // which have none) can run without reloading the page table or
+    // flushing the TLB; see AddrSpace::RestoreState.
+    if (nextThread->space != NULL && !nextThread->space->IsLoaded())
+	switchCrossSpace = TRUE;
+#endif
+    if (switchCrossSpace)
+	stats->numCrossSpaceSwitches++;
+    else
+	stats->numSameSpaceSwitches++;
     DEBUG('t',"Thread %d in Scheduler::Run old %d ?= next %d\n",
         currentThread->getTid(), oldThread->getTid(), nextThread->getTid());
 #ifdef USER_PROGRAM			// ignore until running user programs 
@@ -114,9 +237,14 @@ Scheduler::Run (Thread *nextThread)
     
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
+    Charge(oldThread);			    // real-time budget accounting
+    if (nextThread->rt != NULL)
+	nextThread->rt->runStart = stats->totalTicks;
 
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
+    currentCpu->current = nextThread;	    // ... on this CPU
+    nextThread->setCpu(currentCpu);
     
     DEBUG('t', "Switching from thread \"%s\" to thread \"%s\"\n",
 	  oldThread->getName(), nextThread->getName());
@@ -130,15 +258,6 @@ Scheduler::Run (Thread *nextThread)
     
     DEBUG('t', "Now in thread \"%s\"\n", currentThread->getName());
 
-    // If the old thread gave up the processor because it was finishing,
-    // we need to delete its carcass.  Note we cannot delete the thread
-    // before now (for example, in Thread::Finish()), because up to this
-    // point, we were still running on the old thread's stack!
-    if (threadToBeDestroyed != NULL) {
-        delete threadToBeDestroyed;
-	threadToBeDestroyed = NULL;
-    }
-    
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
         DEBUG('t', "Thread %d in Scheduler::Run after switch.\n",
@@ -147,6 +266,25 @@ Scheduler::Run (Thread *nextThread)
 	currentThread->space->RestoreState();
     }
 #endif
+
+    if (switchCrossSpace) {
+	stats->numTimedCrossSpace++;
+	stats->crossSpaceSwitchTime += HostTime() - switchStartTime;
+    } else {
+	stats->numTimedSameSpace++;
+	stats->sameSpaceSwitchTime += HostTime() - switchStartTime;
+    }
+    UnlockReadyLists();
+
+    // If the old thread gave up the processor because it was finishing,
+    // we need to delete its carcass.  Note we cannot delete the thread
+    // before now (for example, in Thread::Finish()), because up to this
+    // point, we were still running on the old thread's stack!
+    if (threadToBeDestroyed != NULL) {
+        delete threadToBeDestroyed;
+	threadToBeDestroyed = NULL;
+    }
+    interrupt->RestoreIntLock(hadIntLock);
 }
 
 //----------------------------------------------------------------------
@@ -157,12 +295,347 @@ Scheduler::Run (Thread *nextThread)
 void
 Scheduler::Print()
 {
-    printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
-    printf("\nReady list ends.\n");
+    IntStatus oldLevel = interrupt->DisableLocal();
+
+    LockReadyLists();
+    for (int i = 0; i < numCpus; i++) {
+	printf("Ready list contents (CPU %d):\n", i);
+	cpus[i]->rtReadyList.Mapcar((VoidFunctionPtr) ThreadPrint);
+	cpus[i]->readyList.Mapcar((VoidFunctionPtr) ThreadPrint);
+	printf("\nReady list ends.\n");
+    }
+    UnlockReadyLists();
+    if (oldLevel == IntOn)
+	(void) interrupt->SetLevel(IntOn);
+}
+
+
+//----------------------------------------------------------------------
+// Scheduler::NeedsTimeSlice
+//	Return TRUE if a time slice could give the CPU to some other
+//	thread -- that is, if the best ready thread is at least as
+//	important as the running one (see Thread::Yield).
+//
+//	A CPU running its idle thread never needs a time slice: the
+//	idle thread looks for work by itself.
+//
+//	"cpu" is the CPU to ask about; by default, the current one.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::NeedsTimeSlice()
+{
+    return NeedsTimeSlice(currentCpu);
+}
+
+bool
+Scheduler::NeedsTimeSlice(Cpu *cpu)
+{
+    Thread *next;
+    bool needs;
+
+    LockReadyLists();
+    next = cpu->rtReadyList.First();
+    if (next == NULL)
+	next = cpu->readyList.First();
+    needs = (next != NULL && cpu->current != cpu->idleThread
+	     && RunsBefore(next, cpu->current));
+    UnlockReadyLists();
+    return needs;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RunsBefore
+//	Return TRUE if the ready thread "ready" should get the CPU rather
+//	than the running thread "running" (see Thread::Yield).
+//
+//	A real-time thread with budget left beats any ordinary thread,
+//	and between two such threads the earlier deadline wins.  Among
+//	ordinary threads -- which includes throttled real-time threads
+//	-- a thread at least as important as the running one gets a
+//	turn.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::RunsBefore(Thread *ready, Thread *running)
+{
+    bool readyRT = (ready->rt != NULL && !ready->rt->throttled);
+    bool runningRT = (running->rt != NULL && !running->rt->throttled);
+
+    if (readyRT != runningRT)
+	return readyRT;
+    if (readyRT)
+	return (ready->rt->deadline <= running->rt->deadline);
+    return (ready->getPriority() <= running->getPriority());
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RemoveFromReadyList
+//	Take "thread" off the ready list, wherever it is.  Used when a
+//	ready thread is suspended.  Does nothing if the thread is not on
+//	the ready list.
+//----------------------------------------------------------------------
+
+void
+Scheduler::RemoveFromReadyList(Thread* thread)
+{
+    Cpu *cpu;
+
+    LockReadyLists();
+    cpu = thread->getCpu();
+    if (cpu != NULL && thread->getQueue() == &cpu->readyList)
+	cpu->readyList.RemoveThread(thread);
+    else if (cpu != NULL && thread->getQueue() == &cpu->rtReadyList)
+	cpu->rtReadyList.RemoveThread(thread);
+    UnlockReadyLists();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::StealWork
+// 	Called when the current CPU has nothing of its own to run.  Take
+//	a thread off the back of the longest ready list on another CPU:
+//	the thread there that would have waited longest anyway, and the
+//	least likely to still have anything in that CPU's caches.
+//	Threads whose affinity hint names the CPU they are queued on are
+//	left alone, and so are real-time threads, which are always pinned
+//	to the CPU their share was reserved on, and user programs in the
+//	middle of an access to memory (see Machine::BeginAccess).  If
+//	every thread on the longest list is pinned there, try the next
+//	longest, and so on.
+//
+//	Return NULL if there is nothing to steal.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::StealWork()
+{
+    bool tried[MaxCpus];
+    Cpu *victim;
+    Thread *t = NULL;
+    int i;
+
+    ASSERT(readyLock.isHeldByCurrentCpu());
+    for (i = 0; i < numCpus; i++)
+	tried[i] = (cpus[i] == currentCpu);
+    while (t == NULL) {			// victims, longest list first
+	victim = NULL;
+	for (i = 0; i < numCpus; i++)
+	    if (!tried[i] && (victim == NULL || cpus[i]->readyList.NumInQueue()
+				> victim->readyList.NumInQueue()))
+		victim = cpus[i];
+	if (victim == NULL || victim->readyList.IsEmpty())
+	    return NULL;
+	tried[victim->getId()] = TRUE;
+
+	for (t = victim->readyList.Last(); t != NULL; 
+			t = victim->readyList.Prev(t))
+	    if (t->getAffinity() != victim->getId())
+		break;
+    }
+
+    DEBUG('t', "CPU %d steals thread \"%s\" from CPU %d\n",
+	  currentCpu->getId(), t->getName(), victim->getId());
+    victim->readyList.RemoveThread(t);
+    t->setCpu(currentCpu);
+    currentCpu->numSteals++;
+    currentCpu->numMigrations++;
+    ASSERT(t->getStatus() == READY);
+    return t;
 }
 
+//----------------------------------------------------------------------
+// Scheduler::SetRealTime
+// 	Move a thread into the real-time class: from now on it may run
+//	for "budget" ticks in every "period" ticks, and each period's
+//	work is due by the end of the period.  The first period starts
+//	now.
+//
+//	Admission control: the thread's share, budget / period, is
+//	reserved on the CPU with the most room left, and the thread is
+//	pinned there.  If no CPU has room under RealTimeCap, the thread
+//	is left alone and we return FALSE.
+//
+//	Can be called on a thread before forking it, or by a thread on
+//	itself.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::SetRealTime(Thread *thread, int period, int budget)
+{
+    int share = (budget * 1000 + period - 1) / period;	// rounded up
+    int affinity = thread->getAffinity();
+    Cpu *best = NULL;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(thread->rt == NULL);
+    ASSERT(period >= TimerTicks && budget > 0 && budget <= period);
+    LockReadyLists();			// the other CPUs look at rt too
+
+    for (int i = 0; i < numCpus; i++)
+	if ((affinity < 0 || affinity == i)
+		&& (best == NULL || cpus[i]->rtLoad < best->rtLoad))
+	    best = cpus[i];
+    if (best == NULL || numRealTime == MaxRealTimeThreads
+		|| best->rtLoad + share > RealTimeCap) {
+	DEBUG('t', "Real-time thread \"%s\" (%d/%d) rejected\n",
+	      thread->getName(), budget, period);
+	UnlockReadyLists();
+	(void) interrupt->SetLevel(oldLevel);
+	return FALSE;
+    }
+    best->rtLoad += share;
+    if (numCpus > 1)
+	thread->setAffinity(best->getId());
 
-void Scheduler::RemoveFromReadyList(Thread* thread){
-    //To do
+    RealTimeParams *rt = new RealTimeParams;
+    rt->period = period;
+    rt->budget = budget;
+    rt->deadline = stats->totalTicks + period;
+    rt->used = 0;
+    rt->runStart = stats->totalTicks;
+    rt->cpuId = best->getId();
+    rt->throttled = rt->waiting = FALSE;
+    rt->numMisses = 0;
+    thread->rt = rt;
+    rtThreads[numRealTime++] = thread;
+    DEBUG('t', "Real-time thread \"%s\" (%d/%d) admitted on CPU %d\n",
+	  thread->getName(), budget, period, best->getId());
+
+    if (thread->getStatus() == READY) {	// move it to the real-time list
+	RemoveFromReadyList(thread);
+	ReadyToRun(thread);
+    }
+    if (timer != NULL && timer->IsTickless())	// we need the ticks now
+	timer->Arm();
+    UnlockReadyLists();
+    (void) interrupt->SetLevel(oldLevel);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ClearRealTime
+// 	Take a thread out of the real-time class, giving back its
+//	reservation.  It carries on as an ordinary thread, at its old
+//	priority (and still pinned to the same CPU).  Thread::Finish
+//	calls this for threads that are still real-time when they exit.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ClearRealTime(Thread *thread)
+{
+    RealTimeParams *rt = thread->rt;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int i;
+
+    ASSERT(rt != NULL && !rt->waiting);
+    LockReadyLists();
+    for (i = 0; i < numRealTime && rtThreads[i] != thread; i++)
+	;
+    ASSERT(i < numRealTime);
+    rtThreads[i] = rtThreads[--numRealTime];
+    cpus[rt->cpuId]->rtLoad -= (rt->budget * 1000 + rt->period - 1) / rt->period;
+
+    bool queued = (thread->getStatus() == READY);
+    if (queued)
+	RemoveFromReadyList(thread);
+    thread->rt = NULL;
+    delete rt;
+    if (queued)
+	ReadyToRun(thread);
+    UnlockReadyLists();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::WaitNextPeriod
+// 	Called by a real-time thread when it has finished this period's
+//	work: sleep until the next period begins.  RealTimeTick wakes it
+//	up, with a fresh budget.
+//----------------------------------------------------------------------
+
+void
+Scheduler::WaitNextPeriod()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(currentThread->rt != NULL);
+    currentThread->rt->waiting = TRUE;
+    currentThread->Sleep();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Add the time since a real-time thread got the CPU to what it has
+//	used this period, and throttle it if that uses up its budget.
+//	Does nothing for ordinary threads.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Charge(Thread *thread)
+{
+    RealTimeParams *rt = thread->rt;
+
+    if (rt == NULL)
+	return;
+    rt->used += stats->totalTicks - rt->runStart;
+    rt->runStart = stats->totalTicks;
+    if (!rt->throttled && rt->used >= rt->budget) {
+	DEBUG('t', "Real-time thread \"%s\" used up its budget\n",
+	      thread->getName());
+	rt->throttled = TRUE;
+	stats->numBudgetOverruns++;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RealTimeTick
+// 	Called from the timer interrupt handler, before it decides who
+//	needs a time slice.  Charge every running real-time thread for
+//	its time, and start a new period for each thread whose deadline
+//	has come:
+//
+//	  - if the thread still wanted the CPU (it was ready or running,
+//	    rather than waiting for the next period or blocked on
+//	    something else), it has missed its deadline; it carries on
+//	    with the next period's budget;
+//	  - its budget is refilled, and it is no longer throttled;
+//	  - if it was waiting in WaitNextPeriod, it is ready again.
+//----------------------------------------------------------------------
+
+void
+Scheduler::RealTimeTick()
+{
+    int now = stats->totalTicks;
+
+    for (int i = 0; i < numRealTime; i++) {
+	Thread *thread = rtThreads[i];
+	RealTimeParams *rt = thread->rt;
+	ThreadStatus status = thread->getStatus();
+
+	if (status == RUNNING)
+	    Charge(thread);
+	if (now < rt->deadline)
+	    continue;
+
+	if (!rt->waiting && (status == READY || status == RUNNING)) {
+	    DEBUG('t', "Real-time thread \"%s\" missed its deadline %d\n",
+		  thread->getName(), rt->deadline);
+	    rt->numMisses++;
+	    stats->numDeadlineMisses++;
+	}
+	while (rt->deadline <= now)
+	    rt->deadline += rt->period;
+	rt->used = 0;
+	rt->throttled = FALSE;
+	stats->numRealTimeReleases++;
+
+	if (rt->waiting) {
+	    rt->waiting = FALSE;
+	    ReadyToRun(thread);
+	} else if (status == READY) {	// re-sort it by its new deadline,
+	    RemoveFromReadyList(thread);	// or move it back from the
+	    ReadyToRun(thread);		// ordinary list if throttled
+	}
+    }
 }
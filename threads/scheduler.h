@@ -10,30 +10,85 @@
 #define SCHEDULER_H
 
 #include "copyright.h"
-#include "list.h"
 #include "thread.h"
+#include "threadqueue.h"
+#include "cpu.h"
+#include "synch.h"
+
+#define MaxRealTimeThreads 32		// most threads in the real-time class
+#define RealTimeCap	900		// permille of each CPU the real-time
+					// class may reserve; the rest is
+					// left for everybody else
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
+// Each CPU has its own ready list; unless noted otherwise, the
+// operations below act on the current CPU's.  One spin lock protects
+// all of them; FindNextToRun, StealWork and Run must be called with it
+// held, and Run hands it over to the thread it switches to, which
+// frees it.  The other operations take it themselves.
+//
+// Besides the usual priority-scheduled threads there is a real-time
+// class, scheduled earliest deadline first.  A real-time thread asks
+// for "budget" ticks of CPU every "period" ticks; SetRealTime admits
+// it only if that still fits in RealTimeCap of some CPU, and pins it
+// there.  Ready real-time threads always run before ordinary ones,
+// which get the time that is left over.  A real-time thread that uses
+// up its budget is throttled -- it carries on as an ordinary thread --
+// until its next period begins.  Budgets, deadlines and releases are
+// checked on every timer interrupt (RealTimeTick), so they are only
+// as precise as TimerTicks.
 
 class Scheduler {
   public:
     Scheduler();			// Initialize list of ready threads 
     ~Scheduler();			// De-allocate ready list
 
+    void LockReadyLists();		// Keep the other CPUs away from
+    void UnlockReadyLists();		// the ready lists
+
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
     Thread* FindNextToRun();		// Dequeue first thread on the ready 
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+    bool NeedsTimeSlice();		// Is a ready thread as important
+					// as the running one?
+    bool NeedsTimeSlice(Cpu *cpu);	// ... on "cpu"
+    Thread* StealWork();		// Take a ready thread from some
+					// other CPU, if any, and return it
+
+    bool RunsBefore(Thread *ready, Thread *running);
+					// Should "ready" preempt "running"?
+
+    bool SetRealTime(Thread *thread, int period, int budget);
+					// Move thread into the real-time
+					// class, if there is room for it
+    void ClearRealTime(Thread *thread);	// ... and back out of it
+    void WaitNextPeriod();		// The current real-time thread is
+					// done with this period's work
+    void RealTimeTick();		// Charge, throttle and release the
+					// real-time threads
+    int NumRealTime() { return numRealTime; }
 
     //.
     void RemoveFromReadyList(Thread* thread);
+					// Take a ready thread back off
+					// the ready list
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    Cpu *PickCpu(Thread *thread);	// Whose ready list should a newly
+					// ready thread go on?
+    void Charge(Thread *thread);	// Count the CPU time a running
+					// real-time thread has used
+
+    SpinLock readyLock;			// protects every CPU's ready lists
+    int readyDepth;			// how many times the CPU holding
+					// readyLock has locked it
+
+    Thread *rtThreads[MaxRealTimeThreads]; // the real-time class
+    int numRealTime;			// how many of rtThreads are in use
 };
 
 #endif // SCHEDULER_H
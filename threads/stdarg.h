@@ -3,6 +3,12 @@
    actual type **after default promotions**.
    Thus, va_arg (..., short) is not valid.  */
 
+#ifdef __x86_64__
+/* The x86-64 passes variable arguments in registers, so only the
+   compiler's own stdarg.h knows where to find them.  */
+#include_next <stdarg.h>
+#else
+
 #ifndef _STDARG_H
 #ifndef _ANSI_STDARG_H_
 #ifndef __need___va_list
@@ -203,3 +209,5 @@ typedef __gnuc_va_list va_list;
 
 #endif /* not _ANSI_STDARG_H_ */
 #endif /* not _STDARG_H */
+
+#endif /* not x86-64 */
@@ -152,4 +152,31 @@
 #define StartupPC       %ecx
 #endif
 
+#ifdef HOST_x86_64
+
+/* the offsets of the registers from the beginning of the thread object;
+ * only the registers a call must preserve are saved, eight bytes each */
+#define _RSP     0
+#define _RBX     8
+#define _RBP     16
+#define _R12     24
+#define _R13     32
+#define _R14     40
+#define _R15     48
+#define _PC      56
+
+/* These definitions are used in Thread::AllocateStack(). */
+#define PCState         (_PC/8-1)
+#define FPState         (_RBP/8-1)
+#define InitialPCState  (_R13/8-1)
+#define InitialArgState (_R14/8-1)
+#define WhenDonePCState (_R15/8-1)
+#define StartupPCState  (_R12/8-1)
+
+#define InitialPC       %r13
+#define InitialArg      %r14
+#define WhenDonePC      %r15
+#define StartupPC       %r12
+#endif
+
 #endif // SWITCH_H
@@ -5,11 +5,11 @@
 //	are left to the reader).
 //
 // Any implementation of a synchronization routine needs some
-// primitive atomic operation.  We assume Nachos is running on
-// a uniprocessor, and thus atomicity can be provided by
-// turning off interrupts.  While interrupts are disabled, no
-// context switch can occur, and thus the current thread is guaranteed
-// to hold the CPU throughout, until interrupts are reenabled.
+// primitive atomic operation.  Here that is a spin lock: turning off
+// interrupts on this CPU, so that no context switch can occur and the
+// current thread is guaranteed to hold its CPU until interrupts are
+// reenabled, plus a lock word, set with an atomic test-and-set, to
+// keep the other CPUs out.
 //
 // Because some of these routines might be called with interrupts
 // already disabled (Semaphore::V for one), instead of turning
@@ -25,6 +25,84 @@
 #include "synch.h"
 #include "system.h"
 
+//----------------------------------------------------------------------
+// SpinLock::Acquire
+// 	Disable interrupts on the current CPU, then take the lock word.
+//	Return the previous interrupt level, for Release.
+//----------------------------------------------------------------------
+
+IntStatus
+SpinLock::Acquire()
+{
+    IntStatus oldLevel = interrupt->DisableLocal();
+
+    Lock();
+    return oldLevel;
+}
+
+//----------------------------------------------------------------------
+// SpinLock::Release
+// 	Free the lock word and restore the interrupt level saved by
+//	Acquire.
+//----------------------------------------------------------------------
+
+void
+SpinLock::Release(IntStatus oldLevel)
+{
+    Unlock();
+    if (oldLevel == IntOn)		// see Interrupt::DisableLocal
+	(void) interrupt->SetLevel(IntOn);
+}
+
+//----------------------------------------------------------------------
+// SpinLock::Sleep
+// 	Put the current thread to sleep, having already put it on some
+//	wait queue protected by this lock.  The lock word must be freed
+//	while we sleep, for whoever is going to wake us up; Thread::Sleep
+//	does that once nobody can put us back on a ready list before we
+//	are off the CPU.  Interrupts stay off throughout.
+//----------------------------------------------------------------------
+
+void
+SpinLock::Sleep()
+{
+    ASSERT(isHeldByCurrentCpu());
+    currentThread->Sleep(this);
+    Lock();
+}
+
+//----------------------------------------------------------------------
+// SpinLock::Lock, Unlock
+// 	Take the lock word, spinning until the CPU holding it lets go;
+//	and free it.  Interrupts are left as they are, so nothing in
+//	between may advance simulated time (see synch.h).
+//----------------------------------------------------------------------
+
+void
+SpinLock::Lock()
+{
+    ASSERT(holder != currentCpu);
+    while (TestAndSet(&word))
+	SpinDelay();
+    holder = currentCpu;
+    currentCpu->spinDepth++;
+}
+
+void
+SpinLock::Unlock()
+{
+    ASSERT(isHeldByCurrentCpu());
+    holder = NULL;
+    currentCpu->spinDepth--;
+    ClearWord(&word);
+}
+
+bool
+SpinLock::isHeldByCurrentCpu()
+{
+    return (holder == currentCpu);
+}
+
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
 // 	Initialize a semaphore, so that it can be used for synchronization.
@@ -37,7 +115,9 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
+    queue = new ThreadQueue;
+    profile = NULL;
+    profileKind = "semaphore";
 }
 
 //----------------------------------------------------------------------
@@ -55,33 +135,36 @@ Semaphore::~Semaphore()
 // Semaphore::P
 // 	Wait until semaphore value > 0, then decrement.  Checking the
 //	value and decrementing must be done atomically, so we
-//	need to disable interrupts before checking the value.
-//
-//	Note that Thread::Sleep assumes that interrupts are disabled
-//	when it is called.
+//	need to take the spin lock before checking the value.
 //----------------------------------------------------------------------
 
 void
 Semaphore::P()
 {
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+    IntStatus oldLevel = guard.Acquire();	// disable interrupts
+    int start = stats->totalTicks;
+    bool waited = FALSE;
     
     while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+	waited = TRUE;
+	queue->Append(currentThread);		// so go to sleep
     DEBUG('d', "Thread %d goes to sleep because of P()\n", currentThread->getTid());
-	currentThread->Sleep();
+	TRACE(TraceBlock, 0, name);
+	guard.Sleep();
     } 
     value--; 					// semaphore available, 
 						// consume its value
+    if (lockProfiler != NULL)
+	Profile()->Acquired(waited, stats->totalTicks - start);
     
-    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    guard.Release(oldLevel);			// re-enable interrupts
 }
 
 //----------------------------------------------------------------------
 // Semaphore::V
 // 	Increment semaphore value, waking up a waiter if necessary.
-//	As with P(), this operation must be atomic, so we need to disable
-//	interrupts.  Scheduler::ReadyToRun() assumes that threads
+//	As with P(), this operation must be atomic, so we need to take
+//	the spin lock.  Scheduler::ReadyToRun() assumes that interrupts
 //	are disabled when it is called.
 //----------------------------------------------------------------------
 
@@ -89,17 +172,30 @@ void
 Semaphore::V()
 {
     Thread *thread;
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
-
-    thread = (Thread *)queue->Remove();
-    if (thread != NULL){	   // make thread ready, consuming the V immediately
-        if (thread->getStatus() == BLOCKED)
-	       scheduler->ReadyToRun(thread);
-        else //SUSPEND_BLK
-            thread->setStatus(SUSPENDED_RDY);
+    IntStatus oldLevel = guard.Acquire();
+
+    thread = queue->Remove();
+    if (thread != NULL) {  // make thread ready, consuming the V immediately
+	TRACE(TraceWakeup, thread->getTid(), name);
+	scheduler->ReadyToRun(thread);	// (remembered if it is suspended)
     }
     value++;
-    (void) interrupt->SetLevel(oldLevel);
+    guard.Release(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Semaphore::Profile
+// 	Return the -lockprof counters for this semaphore, looking them
+//	up by name the first time.  Only called when profiling is on.
+//----------------------------------------------------------------------
+
+LockStats *
+Semaphore::Profile()
+{
+    ASSERT(lockProfiler != NULL);
+    if (profile == NULL)
+	profile = lockProfiler->Lookup(name, profileKind);
+    return profile;
 }
 
 // Dummy functions -- so we can compile our later assignments 
@@ -108,7 +204,9 @@ Semaphore::V()
 Lock::Lock(char* debugName) {
     name = debugName;
     semaph = new Semaphore(name, 1);
+    semaph->setProfileKind("lock");	// we are what gets profiled
     lockHolder = NULL;
+    acquiredAt = 0;
 }
 Lock::~Lock() {
     delete semaph;
@@ -116,10 +214,14 @@ Lock::~Lock() {
 void Lock::Acquire() {
     semaph->P();
     lockHolder = currentThread;
+    if (lockProfiler != NULL)
+        acquiredAt = stats->totalTicks;
 }
 void Lock::Release() {
 //    A lock Acquired by a thread does not need to be Released by the same thread.
 //    ASSERT(isHeldByCurrentThread());
+    if (lockProfiler != NULL)
+        semaph->Profile()->Released(stats->totalTicks - acquiredAt);
     lockHolder = NULL;
     semaph->V();
 }
@@ -129,7 +231,7 @@ bool Lock::isHeldByCurrentThread(){
 
 Condition::Condition(char* debugName) {
     name = debugName;
-    queue = new List;
+    queue = new ThreadQueue;
 }
 
 Condition::~Condition() { 
@@ -137,75 +239,355 @@ Condition::~Condition() {
 }
 void Condition::Wait(Lock* conditionLock) { 
     //no need to disable interrupt? I think yes if we Append currentThread to queue before Releasing the conditionLock.
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    IntStatus oldLevel = guard.Acquire();
     ASSERT(conditionLock->isHeldByCurrentThread());
     conditionLock->Release();
-    queue->Append((void *)currentThread);
+    queue->Append(currentThread);
     DEBUG('d', "Condition.Wait: Thread %d sleep.\n", currentThread->getTid());
-    currentThread->Sleep();
-    conditionLock->Acquire();
-    (void) interrupt->SetLevel(oldLevel);
+    guard.Sleep();
+    guard.Release(oldLevel);		// not held while we wait for
+    conditionLock->Acquire();		// the lock, which may sleep
 }
 void Condition::Signal(Lock* conditionLock) {
     //no need to disable interrupt? I think yes.
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    IntStatus oldLevel = guard.Acquire();
     ASSERT(conditionLock->isHeldByCurrentThread());
-    Thread* t = (Thread *)queue->Remove();
+    Thread* t = queue->Remove();
     if (t != NULL){
         scheduler->ReadyToRun(t);
     }
-    interrupt->SetLevel(oldLevel);
+    guard.Release(oldLevel);
 }
 void Condition::Broadcast(Lock* conditionLock) { 
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    IntStatus oldLevel = guard.Acquire();
     ASSERT(conditionLock->isHeldByCurrentThread());
     Thread* t = NULL;
     while (!(queue->IsEmpty())){
-        t = (Thread *)queue->Remove();
+        t = queue->Remove();
         scheduler->ReadyToRun(t);
     }
-    interrupt->SetLevel(oldLevel);
+    guard.Release(oldLevel);
 }
 
 
-ReadWriteLock::ReadWriteLock(char *lockName){
-    readerCnt = 0;
+//----------------------------------------------------------------------
+// ReadWriteLock::ReadWriteLock
+// 	Initialize a reader/writer lock to be free.
+//
+//	"lockName" is an arbitrary name, useful for debugging.
+//	"lockPolicy" says who goes first when both readers and writers
+//		are waiting (see synch.h).
+//----------------------------------------------------------------------
+
+ReadWriteLock::ReadWriteLock(char *lockName, RWPolicy lockPolicy)
+{
     name = lockName;
-    cntLock = new Lock("cnt lock");
-    writeLock = new Lock("write lock");
-    superLock = new Lock("super Lock");
-    curWritingThread = NULL;
+    policy = lockPolicy;
+    readerBatch = 0;
+    state = 0;
+    upgrader = NULL;
+    profile = NULL;
+    heldSince = 0;
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::~ReadWriteLock
+// 	De-allocate the lock.  Nobody may be holding it, and so nobody
+//	can be waiting for it either.
+//----------------------------------------------------------------------
+
+ReadWriteLock::~ReadWriteLock()
+{
+    ASSERT(state == 0);
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::BeforeRead
+// 	Get the lock for reading, waiting if a writer holds it or if
+//	anyone is already waiting for it.  If we wait, whoever wakes us
+//	up has already counted us among the readers.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::BeforeRead()
+{
+    IntStatus oldLevel = guard.Acquire();
+    int start = stats->totalTicks;
+    bool waited = FALSE;
+
+    if (ReaderMustWait()) {
+	waited = TRUE;
+	readers.Append(currentThread);
+	TRACE(TraceBlock, 0, name);
+	guard.Sleep();
+    } else {
+	if (state == 0)
+	    heldSince = stats->totalTicks;
+	state += RWOneReader;
+    }
+    Acquired(waited, start);
+    guard.Release(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::AfterRead
+// 	Give up a read lock.  The last reader to leave passes the lock
+//	on to whoever is waiting.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::AfterRead()
+{
+    IntStatus oldLevel = guard.Acquire();
+
+    ASSERT(NumReaders() > 0);
+    state -= RWOneReader;
+    if (NumReaders() == 0)
+	HandOff(FALSE);
+    guard.Release(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::BeforeWrite
+// 	Get the lock for writing, waiting if anyone else holds it.  If
+//	we wait, whoever wakes us up has already made us the writer.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::BeforeWrite()
+{
+    IntStatus oldLevel = guard.Acquire();
+    int start = stats->totalTicks;
+    bool waited = FALSE;
+
+    if (state != 0) {
+	waited = TRUE;
+	writers.Append(currentThread);
+	TRACE(TraceBlock, 0, name);
+	guard.Sleep();
+    } else {
+	state = RWWriter;
+	heldSince = stats->totalTicks;
+    }
+    Acquired(waited, start);
+    guard.Release(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::AfterWrite
+// 	Give up a write lock, passing it on to whoever is waiting.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::AfterWrite()
+{
+    IntStatus oldLevel = guard.Acquire();
+
+    ASSERT(state == RWWriter);
+    state = 0;
+    HandOff(TRUE);
+    guard.Release(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::TryRead, TryWrite
+// 	Get the lock if we can do so without waiting.  Return TRUE if
+//	we got it.
+//----------------------------------------------------------------------
+
+bool
+ReadWriteLock::TryRead()
+{
+    IntStatus oldLevel = guard.Acquire();
+    bool got = !ReaderMustWait();
+
+    if (got) {
+	if (state == 0)
+	    heldSince = stats->totalTicks;
+	state += RWOneReader;
+	Acquired(FALSE, stats->totalTicks);
+    }
+    guard.Release(oldLevel);
+    return got;
+}
+
+bool
+ReadWriteLock::TryWrite()
+{
+    IntStatus oldLevel = guard.Acquire();
+    bool got = (state == 0);
+
+    if (got) {
+	state = RWWriter;
+	heldSince = stats->totalTicks;
+	Acquired(FALSE, stats->totalTicks);
+    }
+    guard.Release(oldLevel);
+    return got;
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::Upgrade
+// 	Turn the read lock we hold into a write lock, without letting
+//	any writer in between: once we are waiting to upgrade, neither
+//	new readers nor writers can get in, and the last of the other
+//	readers hands the lock to us.
+//
+//	If some other reader is already upgrading, waiting for it would
+//	deadlock (it waits for us to leave), so return FALSE with our
+//	read lock still held.
+//----------------------------------------------------------------------
+
+bool
+ReadWriteLock::Upgrade()
+{
+    IntStatus oldLevel = guard.Acquire();
+    int start = stats->totalTicks;
+    bool waited = FALSE;
+
+    ASSERT(NumReaders() > 0);
+    if (state & RWUpgrading) {
+	guard.Release(oldLevel);
+	return FALSE;
+    }
+    state -= RWOneReader;
+    if (NumReaders() == 0)
+	state = RWWriter;
+    else {
+	waited = TRUE;
+	state |= RWUpgrading;
+	upgrader = currentThread;
+	TRACE(TraceBlock, 0, name);
+	guard.Sleep();
+    }
+    Acquired(waited, start);
+    guard.Release(oldLevel);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ReadWriteLock::Downgrade
+// 	Turn the write lock we hold into a read lock.  The readers that
+//	were waiting come in with us, unless writers go first.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::Downgrade()
+{
+    IntStatus oldLevel = guard.Acquire();
+
+    ASSERT(state == RWWriter);
+    state = RWOneReader;
+    if (policy == RWPhaseFair || writers.IsEmpty())
+	WakeReaders();
+    guard.Release(oldLevel);
 }
 
-ReadWriteLock::~ReadWriteLock(){
-    delete cntLock;
-    delete writeLock;
-    delete superLock;
+//----------------------------------------------------------------------
+// ReadWriteLock::ReaderMustWait
+// 	Return TRUE if a reader arriving now has to wait: a writer holds
+//	the lock or is waiting for it, a reader is upgrading, or other
+//	readers are already waiting (they were not let in with the
+//	current batch, and must not be overtaken).
+//----------------------------------------------------------------------
+
+bool
+ReadWriteLock::ReaderMustWait()
+{
+    return ((state & (RWWriter | RWUpgrading)) != 0
+	    || !writers.IsEmpty() || !readers.IsEmpty());
 }
 
-void ReadWriteLock::BeforeRead(){
-    cntLock->Acquire();
-    if (readerCnt <= 0)
-        writeLock->Acquire();
-    readerCnt += 1;
-    cntLock->Release();
+//----------------------------------------------------------------------
+// ReadWriteLock::WakeReaders
+// 	Let in the next batch of waiting readers, counting them as
+//	holding the lock before they even run.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::WakeReaders()
+{
+    Thread *thread;
+
+    for (int n = 0; readerBatch == 0 || n < readerBatch; n++) {
+	thread = readers.Remove();
+	if (thread == NULL)
+	    break;
+	state += RWOneReader;
+	TRACE(TraceWakeup, thread->getTid(), name);
+	scheduler->ReadyToRun(thread);
+    }
 }
-void ReadWriteLock::AfterRead(){
-    cntLock->Acquire();
-    readerCnt -= 1;
-    if (readerCnt <= 0)
-        writeLock->Release();
-    cntLock->Release();
+
+//----------------------------------------------------------------------
+// ReadWriteLock::HandOff
+// 	The last reader, or the writer, has just left.  Give the lock to
+//	the thread waiting to upgrade if there is one; otherwise to the
+//	next writer or the next batch of readers, as the policy says.
+//
+//	"fromWriter" is TRUE if a write phase has just ended.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::HandOff(bool fromWriter)
+{
+    bool readersFirst = writers.IsEmpty()
+	|| (fromWriter && policy == RWPhaseFair);
+    Thread *thread;
+
+    ASSERT(NumReaders() == 0 && !isWriteLocked());
+    Released();
+    if (upgrader != NULL) {
+	thread = upgrader;
+	upgrader = NULL;
+	state = RWWriter;
+    } else if (readersFirst && !readers.IsEmpty()) {
+	WakeReaders();
+	thread = NULL;
+    } else {
+	thread = writers.Remove();
+	if (thread != NULL)
+	    state = RWWriter;
+    }
+    if (thread != NULL) {
+	TRACE(TraceWakeup, thread->getTid(), name);
+	scheduler->ReadyToRun(thread);
+    }
+    if (state != 0)
+	heldSince = stats->totalTicks;
 }
-void ReadWriteLock::BeforeWrite(){
-    writeLock->Acquire();
+
+//----------------------------------------------------------------------
+// ReadWriteLock::Acquired, Released
+// 	Keep the -lockprof counters.  A read phase counts as a single
+//	hold, from the first reader in to the last one out.
+//----------------------------------------------------------------------
+
+void
+ReadWriteLock::Acquired(bool waited, int start)
+{
+    if (lockProfiler != NULL)
+	Profile()->Acquired(waited, stats->totalTicks - start);
 }
-void ReadWriteLock::AfterWrite(){
-    writeLock->Release();
+
+void
+ReadWriteLock::Released()
+{
+    if (lockProfiler != NULL)
+	Profile()->Released(stats->totalTicks - heldSince);
 }
-void ReadWriteLock::AcquireSuperLock(){
-    superLock->Acquire();
+
+//----------------------------------------------------------------------
+// ReadWriteLock::Profile
+// 	Return the -lockprof counters for this lock, looking them up by
+//	name the first time.  Only called when profiling is on.
+//----------------------------------------------------------------------
+
+LockStats *
+ReadWriteLock::Profile()
+{
+    ASSERT(lockProfiler != NULL);
+    if (profile == NULL)
+	profile = lockProfiler->Lookup(name, "rwlock");
+    return profile;
 }
-void ReadWriteLock::ReleaseSuperLock(){
-    superLock->Release();
-}
\ No newline at end of file
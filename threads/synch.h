@@ -19,7 +19,47 @@
 
 #include "copyright.h"
 #include "thread.h"
-#include "list.h"
+#include "threadqueue.h"
+#include "interrupt.h"
+
+class LockStats;
+
+// The following class defines a spin lock, the primitive that makes
+// the operations on semaphores and condition variables atomic.
+//
+//	Acquire -- disable interrupts on this CPU, then take the lock word,
+//		spinning while another CPU holds it
+//
+//	Release -- free the lock word, and put the interrupt level back
+//
+//	Sleep -- free the lock word and put the current thread to sleep;
+//		take it back once the thread is woken up
+//
+//	Lock, Unlock -- take and free just the lock word, leaving the
+//		interrupt level alone
+//
+// A spin lock must never be held across anything that might let
+// simulated time advance: a CPU only waits for the others at the end
+// of a round (see cpu.h), and they could be spinning on the lock.  Nor
+// may a CPU holding one turn interrupts off with SetLevel, which takes
+// the machine-wide interrupt lock (see Interrupt::SetLevel).  The lock
+// belongs to a CPU rather than a thread.
+
+class SpinLock {
+  public:
+    SpinLock() { word = 0; holder = NULL; }	// initialize to free
+
+    IntStatus Acquire();		// returns the old interrupt level,
+    void Release(IntStatus oldLevel);	// for Release to restore
+    void Sleep();			// wait, with the lock word freed
+    void Lock();
+    void Unlock();
+    bool isHeldByCurrentCpu();
+
+  private:
+    int word;				// 1 while the lock is held
+    Cpu *holder;			// CPU holding the lock, or NULL
+};
 
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
@@ -44,11 +84,18 @@ class Semaphore {
     
     void P();	 // these are the only operations on a semaphore
     void V();	 // they are both *atomic*
+
+    void setProfileKind(char *kind) { profileKind = kind; }
+    LockStats *Profile();	// counters for -lockprof, found on first use
     
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    ThreadQueue *queue; // threads waiting in P() for the value to be > 0
+    SpinLock guard;	// makes P() and V() atomic
+    LockStats *profile;	// see Profile
+    char *profileKind;	// what to list us as: "semaphore" unless
+			// we are the inside of something else
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -81,6 +128,8 @@ class Lock {
     char* name;				// for debugging
     Semaphore* semaph;
     Thread* lockHolder;
+    int acquiredAt;			// when lockHolder got the lock,
+					// if -lockprof
     // plus some other stuff you'll need to define
 };
 
@@ -133,29 +182,96 @@ class Condition {
 
   private:
     char* name;
-    List* queue;
+    ThreadQueue* queue;	// threads waiting in Wait()
+    SpinLock guard;	// protects "queue"
     // plus some other stuff you'll need to define
 };
 
+// The following class defines a "reader/writer lock".  Any number of
+// readers may hold it at once, or a single writer:
+//
+//	BeforeRead, AfterRead -- get and give up the lock for reading
+//
+//	BeforeWrite, AfterWrite -- get and give up the lock for writing
+//
+//	TryRead, TryWrite -- get the lock only if that can be done
+//		without waiting; return TRUE if we got it
+//
+//	Upgrade -- turn our read lock into a write lock, waiting for the
+//		other readers to leave.  Only one reader can be upgrading
+//		at a time; if another one already is, return FALSE and
+//		keep the read lock -- the caller must then AfterRead,
+//		BeforeWrite, and look again at whatever it read
+//
+//	Downgrade -- turn our write lock into a read lock, letting in
+//		the readers that were waiting
+//
+// The whole lock is one state word (the writer bit, the upgrade bit,
+// and the count of readers), plus a queue each of waiting readers and
+// waiting writers.  Whoever releases the lock hands it directly to
+// the thread(s) it wakes up, so a woken thread never has to compete
+// for it again.  Which side gets the lock when both are waiting is
+// up to the policy:
+//
+//	RWWriterPreferred -- writers first; readers get in when no
+//		writer is waiting.  Good when writes are rare and must
+//		not be held up by a steady stream of readers.
+//
+//	RWPhaseFair -- read and write phases alternate: a writer
+//		leaving lets in the readers that are waiting, and the
+//		last of those lets in the next writer.  Neither side
+//		can starve.
+//
+// Under both, a reader arriving while a writer is waiting waits too.
+// Waiting readers are let in as a batch, at most "readerBatch" of
+// them at a time (0 for all of them).
+
+enum RWPolicy { RWWriterPreferred, RWPhaseFair };
+
+#define RWWriter	0x1		// state: a writer holds the lock
+#define RWUpgrading	0x2		// state: a reader is upgrading
+#define RWOneReader	0x4		// state: the rest counts readers
+
 class ReadWriteLock
 {
 public:
-    ReadWriteLock(char *name);
-    ~ReadWriteLock();
+    ReadWriteLock(char *name, RWPolicy policy = RWWriterPreferred);
+    ~ReadWriteLock();			// nobody may hold the lock
+    char* getName() { return name; }
 
     void BeforeRead();
     void AfterRead();
     void BeforeWrite();
     void AfterWrite();
-    void ReleaseSuperLock();
-    void AcquireSuperLock();
-    
+    bool TryRead();
+    bool TryWrite();
+    bool Upgrade();			// read -> write, FALSE if that
+					// would deadlock
+    void Downgrade();			// write -> read
+
+    void setReaderBatch(int n) { readerBatch = n; }
+    int NumReaders() { return (state / RWOneReader); }
+    bool isWriteLocked() { return ((state & RWWriter) != 0); }
+
 private:
-    int readerCnt;
-    Lock * cntLock;
-    Lock * writeLock; 
-    Lock * superLock;
-    Thread * curWritingThread;
+    LockStats *Profile();	// counters for -lockprof
+    bool ReaderMustWait();	// would a new reader have to wait?
+    void WakeReaders();		// hand the lock to waiting readers
+    void HandOff(bool fromWriter);	// the lock is free; pass it on
+    void Acquired(bool waited, int start);
+				// update -lockprof counters
+    void Released();
+
     char * name;
+    RWPolicy policy;
+    int readerBatch;		// readers let in at a time, 0 for all
+    int state;			// see RWWriter, RWUpgrading, RWOneReader
+    ThreadQueue readers;	// threads waiting in BeforeRead
+    ThreadQueue writers;	// threads waiting in BeforeWrite
+    Thread * upgrader;		// thread waiting in Upgrade, or NULL
+    SpinLock guard;		// makes all of the above atomic
+    LockStats *profile;		// see Profile
+    int heldSince;		// when the current writer, or the first
+				// of the current readers, got in
 };
 #endif // SYNCH_H
@@ -178,3 +178,58 @@ void read_write_lock_test(){
     }
 }
 
+
+//  the same readers and writers, on a ReadWriteLock
+//
+// Everyone yields while holding the lock, so that the others pile up
+// behind it.  Thread 1010 reads, upgrades, then downgrades again.
+ReadWriteLock* rw_class_lock = NULL;
+
+void rw_class_read(int arg){
+    printf("rw_class_read: thread %d wanted to read value.\n", currentThread->getTid());
+    rw_class_lock->BeforeRead();
+    ASSERT(!rw_class_lock->TryWrite());
+    printf("rw_class_read: thread %d read value %d, current %d readers.\n",
+        currentThread->getTid(), val, rw_class_lock->NumReaders());
+    currentThread->Yield();
+    if (arg == 1010){
+        if (rw_class_lock->Upgrade()){
+            val = arg;
+            printf("rw_class_read: thread %d upgraded and wrote value %d.\n", currentThread->getTid(), val);
+            currentThread->Yield();
+            rw_class_lock->Downgrade();
+            printf("rw_class_read: thread %d downgraded, current %d readers.\n",
+                currentThread->getTid(), rw_class_lock->NumReaders());
+        }else
+            printf("rw_class_read: thread %d could not upgrade.\n", currentThread->getTid());
+    }
+    rw_class_lock->AfterRead();
+    printf("rw_class_read: thread %d finished reading value.\n", currentThread->getTid());
+}
+
+void rw_class_write(int arg){
+    printf("rw_class_write: thread %d wanted to write value.\n", currentThread->getTid());
+    rw_class_lock->BeforeWrite();
+    ASSERT(!rw_class_lock->TryRead());
+    val = arg;
+    printf("rw_class_write: thread %d wrote value %d.\n", currentThread->getTid(), val);
+    currentThread->Yield();
+    rw_class_lock->AfterWrite();
+    printf("rw_class_write: thread %d finished writing.\n", currentThread->getTid());
+}
+
+VoidFunctionPtr rw_class_readers_writers[10] = {
+    rw_class_read, rw_class_read, rw_class_read, rw_class_write, rw_class_read, 
+    rw_class_write, rw_class_read, rw_class_read, rw_class_write, rw_class_read
+};
+void rw_class_test(RWPolicy policy, int batch){
+    DEBUG('t', "Entering rw_class_test");
+    rw_class_lock = new ReadWriteLock("rw_class_lock", policy);
+    rw_class_lock->setReaderBatch(batch);
+    for (int i = 0; i < 10; ++i){
+        Thread* t = createThread("rw_class", 4);
+        if (t == NULL)
+            continue;
+        t->Fork(rw_class_readers_writers[i], 1001 + i);
+    }
+}
@@ -10,20 +10,28 @@
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
 
-Thread *currentThread;			// the thread we are running now
-Thread *threadToBeDestroyed;  		// the thread that just finished
+__thread Thread *currentThread;		// the thread we are running now
+__thread Thread *threadToBeDestroyed;	// the thread that just finished
 Scheduler *scheduler;			// the ready list
 Interrupt *interrupt;			// interrupt status
 Statistics *stats;			// performance metrics
 Timer *timer;				// the hardware timer device,
 					// for invoking context switches
+Alarm *alarmClock;			// threads sleeping in WaitUntil
+WorkQueue *workQueue;			// deferred kernel work
+int numCpus;				// how many CPUs we simulate (-smp)
+Cpu **cpus;				// the simulated CPUs
+__thread Cpu *currentCpu;		// the CPU currentThread is running on
+Tracer *tracer;				// scheduling events, if -trace
+LockProfiler *lockProfiler;		// lock contention, if -lockprof
 TidManager *tidManager;// = TidManager();
 
 #ifdef FILESYS
 FileACList *fileACList;
 SynchDisk   *synchDisk;
-bool useCacheSynchDisk = FALSE;
-//CacheSynchDisk * cacheSynchDisk;
+int cacheSize = 0;			// buffers in the buffer cache,
+					// 0 if we don't cache (-cacheSize)
+int diskTracks = DefaultNumTracks;	// size of the disk (-diskTracks)
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -31,8 +39,10 @@ FileSystem  *fileSystem;
 #endif
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
-Machine *machine;	// user program memory and registers
+__thread Machine *machine;	// user program memory and registers,
+				// of the CPU we are running on
 BitMap* memBitMap;
+FutexTable *futexTable;
 #endif
 
 #ifdef NETWORK
@@ -58,14 +68,40 @@ extern void Cleanup();
 //	if the interrupted thread called Yield at the point it is 
 //	was interrupted.
 //
+//	A yield is only requested if there is some ready thread it could
+//	switch to.  In tickless mode (-tickless), the timer is only
+//	re-armed while that is so, while threads are asleep in the
+//	alarm clock, or while there are real-time threads to keep to
+//	their budgets; otherwise a lone running thread is left alone.
+//
+//	With several CPUs, the one timer time-slices all of them: each
+//	CPU that needs it yields at its next tick.
+//
 //	"dummy" is because every interrupt handler takes one argument,
 //		whether it needs it or not.
 //----------------------------------------------------------------------
 static void
 TimerInterruptHandler(int dummy)
 {
-    if (interrupt->getStatus() != IdleMode)
-	interrupt->YieldOnReturn();
+    bool slicing = FALSE;
+
+    alarmClock->CallBack();		// wake up any sleepers that are due
+    scheduler->RealTimeTick();		// ... and real-time threads whose
+					// next period has begun
+    if (numCpus == 1) {
+	slicing = scheduler->NeedsTimeSlice();
+	if (interrupt->getStatus() != IdleMode && slicing)
+	    interrupt->YieldOnReturn();
+    } else {
+	for (int i = 0; i < numCpus; i++)
+	    if (scheduler->NeedsTimeSlice(cpus[i])) {
+		cpus[i]->yieldOnReturn = TRUE;
+		slicing = TRUE;
+	    }
+    }
+    if (timer->IsTickless() && (slicing || alarmClock->NumWaiters() > 0
+				|| scheduler->NumRealTime() > 0))
+	timer->Arm();
 }
 
 //----------------------------------------------------------------------
@@ -84,6 +120,10 @@ Initialize(int argc, char **argv)
     int argCount;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    bool tickless = FALSE;
+    int smp = 1;
+    char *traceFile = NULL;
+    bool lockProf = FALSE;
 
     int replaceAlgorithmOfTLB = 0; 
     int replaceAlgorithmOfMemPage = 0;
@@ -93,6 +133,7 @@ Initialize(int argc, char **argv)
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
+    bool extents = FALSE;	// ... with extent-mapped files
 #endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
@@ -114,6 +155,19 @@ Initialize(int argc, char **argv)
 						// number generator
 	    randomYield = TRUE;
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-tickless")) {
+	    tickless = TRUE;			// only arm the timer on demand
+	} else if (!strcmp(*argv, "-smp")) {
+	    ASSERT(argc > 1);
+	    smp = atoi(*(argv + 1));		// simulate a multiprocessor
+	    ASSERT(smp >= 1 && smp <= MaxCpus);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-trace")) {
+	    ASSERT(argc > 1);
+	    traceFile = *(argv + 1);		// record scheduling events
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-lockprof")) {
+	    lockProf = TRUE;			// count lock contention
 	}
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
@@ -149,8 +203,21 @@ Initialize(int argc, char **argv)
 #endif
 //.
 #ifdef FILESYS
-    if (!strcmp(*argv, "-cacheDisk"))
-        useCacheSynchDisk = TRUE;
+    if (!strcmp(*argv, "-extents"))
+        format = extents = TRUE;
+    else if (!strcmp(*argv, "-cacheDisk"))
+        cacheSize = DefaultCacheSize;
+    else if (!strcmp(*argv, "-cacheSize")) {
+        ASSERT(argc > 1);
+        cacheSize = atoi(*(argv + 1));
+        ASSERT(cacheSize >= MinCacheSize);
+        argCount = 2;
+    } else if (!strcmp(*argv, "-diskTracks")) {
+        ASSERT(argc > 1);
+        diskTracks = atoi(*(argv + 1));
+        ASSERT(diskTracks >= 1);
+        argCount = 2;
+    }
 #endif
 //..
 #ifdef NETWORK
@@ -168,10 +235,22 @@ Initialize(int argc, char **argv)
 
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
+    tracer = NULL;				// and maybe events
+    if (traceFile != NULL)
+	tracer = new Tracer(traceFile);
+    lockProfiler = NULL;
+    if (lockProf)
+	lockProfiler = new LockProfiler();
     interrupt = new Interrupt;			// start up interrupt handling
+    numCpus = smp;				// and the CPUs
+    cpus = new Cpu*[numCpus];
+    for (int i = 0; i < numCpus; i++)
+	cpus[i] = new Cpu(i);
+    currentCpu = cpus[0];
     scheduler = new Scheduler();		// initialize the ready queue
+    alarmClock = new Alarm();			// nobody is sleeping yet
 //if (randomYield)				// start the timer (if needed)
-	timer = new Timer(TimerInterruptHandler, 0, randomYield);
+	timer = new Timer(TimerInterruptHandler, 0, randomYield, tickless);
 
     threadToBeDestroyed = NULL;
 
@@ -184,27 +263,44 @@ Initialize(int argc, char **argv)
         return;
     }
     currentThread->setStatus(RUNNING);
+    currentThread->setCpu(currentCpu);
+    currentCpu->current = currentThread;
+#ifdef USER_PROGRAM
+    // Each CPU runs user code on a Machine of its own, sharing the first
+    // one's memory.  The CPUs other than 0 set "machine" for themselves
+    // when they start (see CpuStart), so this must come first.
+    for (int i = 0; i < numCpus; i++) {
+	cpus[i]->machine = new Machine(debugUserProg,
+				(i == 0) ? NULL : cpus[0]->machine);
+	cpus[i]->machine->replaceAlgorithmOfTLB = replaceAlgorithmOfTLB;
+	cpus[i]->machine->replaceAlgorithmOfMemPage = replaceAlgorithmOfMemPage;
+    }
+    machine = cpus[0]->machine;
+#endif
+    if (numCpus > 1)				// every CPU needs something
+	for (int i = 0; i < numCpus; i++)	// to run when it has nothing,
+	    cpus[i]->StartIdleThread();		// and CPUs other than 0 need
+						// a host thread to run it on
+    workQueue = new WorkQueue("kernel worker");
 
     interrupt->Enable();
     CallOnUserAbort(Cleanup);			// if user hits ctl-C
     
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg);	// this must come first
     memBitMap = new BitMap(NumPhysPages);
-    machine->replaceAlgorithmOfTLB = replaceAlgorithmOfTLB;
-    machine->replaceAlgorithmOfMemPage = replaceAlgorithmOfMemPage;
+    futexTable = new FutexTable();
 #endif
 
 #ifdef FILESYS
-    if (!useCacheSynchDisk)
+    if (cacheSize == 0)
         synchDisk = new SynchDisk("DISK");
     else
-        synchDisk = new CacheSynchDisk("DISK");
+        synchDisk = new BufferCache("DISK", cacheSize);
     fileACList = new FileACList;
 #endif
 
 #ifdef FILESYS_NEEDED
-    fileSystem = new FileSystem(format);
+    fileSystem = new FileSystem(format, extents);
 #endif
 
 #ifdef NETWORK
@@ -212,6 +308,22 @@ Initialize(int argc, char **argv)
 #endif
 }
 
+//----------------------------------------------------------------------
+// SyncFileSystem
+// 	Write back the headers of open files, and then the buffer cache,
+//	if there is one.  Done by main once it has run its tests, and by
+//	Halt and Cleanup (see Interrupt::Halt), so that nothing is lost
+//	however Nachos stops.
+//----------------------------------------------------------------------
+void
+SyncFileSystem()
+{
+#ifdef FILESYS
+    fileACList->WriteBackHeaders();
+    synchDisk->Sync();
+#endif
+}
+
 //----------------------------------------------------------------------
 // Cleanup
 // 	Nachos is halting.  De-allocate global data structures.
@@ -226,10 +338,17 @@ Cleanup()
 #endif
     
 #ifdef USER_PROGRAM
-    delete machine;
+    delete futexTable;
+    for (int i = numCpus - 1; i >= 0; i--)	// CPU 0's Machine last: the
+	delete cpus[i]->machine;		// others share its memory
     delete memBitMap;
 #endif
 
+#ifdef FILESYS
+    if (interrupt->IsHalting() && interrupt->getStatus() == IdleMode)
+	SyncFileSystem();		// else Halt has done it already
+#endif
+
 #ifdef FILESYS_NEEDED
     delete fileSystem;
 #endif
@@ -242,16 +361,21 @@ Cleanup()
   //  printf("****2.5\n");
     
     delete timer;
+    delete workQueue;
+    delete alarmClock;
+    delete tracer;
     delete scheduler;
+    for (int i = 0; i < numCpus; i++)
+	delete cpus[i];
+    delete [] cpus;
     delete interrupt;
+    delete lockProfiler;			// last: the rest may use locks
  //   printf("*****3\n");
     Exit(0);
 }
 
 Thread* createThread(char* name, int priorityVal){
     DEBUG('t', "in createThread\n");
-    Thread* t = new Thread(name, priorityVal);
-   // printf("pri:%d %d\n", priorityVal, t->getPriority());
 
     DEBUG('t', "bef genId in createThread\n");
     int tid = tidManager->genId();
@@ -259,6 +383,8 @@ Thread* createThread(char* name, int priorityVal){
 
     if (tid == -1)
         return NULL;
+    Thread* t = new Thread(name, priorityVal);
+   // printf("pri:%d %d\n", priorityVal, t->getPriority());
     t->setTid(tid);
     DEBUG('t', "bef add in createThread\n");
 
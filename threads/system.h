@@ -17,6 +17,11 @@
 #include "stats.h"
 #include "timer.h"
 #include "tid.h"
+#include "alarm.h"
+#include "workqueue.h"
+#include "cpu.h"
+#include "trace.h"
+#include "lockprof.h"
 #include "fileac.h"
 
 // Initialization and cleanup routines
@@ -24,26 +29,38 @@ extern void Initialize(int argc, char **argv); 	// Initialization,
 						// called before anything else
 extern void Cleanup();				// Cleanup, called when
 						// Nachos is done.
+extern void SyncFileSystem();			// write back what the file
+						// system holds in memory
 extern Thread* createThread(char* name, int priorityVal = 4);
-extern Thread *currentThread;			// the thread holding the CPU
-extern Thread *threadToBeDestroyed;  		// the thread that just finished
+extern __thread Thread *currentThread;		// the thread holding the CPU
+extern __thread Thread *threadToBeDestroyed;	// the thread that just finished
 extern Scheduler *scheduler;			// the ready list
 extern Interrupt *interrupt;			// interrupt status
 extern Statistics *stats;			// performance metrics
 extern Timer *timer;				// the hardware alarm clock
+extern Alarm *alarmClock;			// sleeping threads, woken
+						// by the timer
+extern int numCpus;				// how many CPUs we simulate
+extern Cpu **cpus;				// all of them
+extern __thread Cpu *currentCpu;		// the one we are running on
+						// (these three are per host
+						// thread, see cpu.h)
 extern TidManager *tidManager;
 #ifdef USER_PROGRAM
 #include "machine.h"
-extern Machine* machine;	// user program memory and registers
+extern __thread Machine* machine;	// user program memory and registers,
+					// of the CPU we are running on
 #include "bitmap.h"			//must be placed between "#ifdef USER_PROGRAM" and "#endif", otherwise will 
 extern BitMap* memBitMap;		// case make failure.
+#include "futex.h"
+extern FutexTable *futexTable;	// threads sleeping in Wait
 #endif
 
 #ifdef FILESYS
 #include "synchdisk.h"
-extern SynchDisk   *synchDisk;
-//extern CacheSynchDisk *cacheSynchDisk;
-extern bool useCacheSynchDisk;
+#include "bufcache.h"
+extern SynchDisk   *synchDisk;		// a BufferCache, if cacheSize > 0
+extern int cacheSize;
 #include "synchlist.h"
 extern FileACList * fileACList;
 #endif
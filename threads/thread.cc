@@ -47,8 +47,13 @@ Thread::Thread(char* threadName, int priorityVal)
     uid = getuid();
     //tid = tidManager->genId()
     priority = priorityVal;
+    wakeTime = 0;
+    cpu = NULL;
+    affinity = -1;
+    rt = NULL;
 #ifdef USER_PROGRAM
     space = NULL;
+    stackSlot = -1;
 //   uid = getuid();
 //    priority = priorityVal;
 //    printf("priorityVal:%d\n", priority);
@@ -73,13 +78,13 @@ Thread::~Thread()
     DEBUG('t', "thread id %d currentThread id %d.\n", tid, currentThread->getTid());
     DEBUG('t', "this thread %d, currentThread %d.\n ", (int)this, (int)currentThread);
     ASSERT(this != currentThread);
+    ASSERT(getQueue() == NULL);
     //CQY
     tidManager->putBack(this->getTid());
     //CQY
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
-    
-    tidManager->awakeJoinThreads(tid);
+    ASSERT(joinQueue.IsEmpty());	// woken up in Finish
 }
 
 char* Thread::getStatusName(){
@@ -187,6 +192,15 @@ Thread::Finish ()
     ASSERT(this == currentThread);
     
     DEBUG('t', "Finishing thread \"%s\"\n", getName());
+    if (rt != NULL)
+	scheduler->ClearRealTime(this);	// give back its reservation
+
+    // wake up everyone who was waiting in Join for us -- now, rather
+    // than when we are deleted, since if they are all there is, nobody
+    // else will ever run to delete us
+    Thread *joiner;
+    while ((joiner = joinQueue.Remove()) != NULL)
+	scheduler->ReadyToRun(joiner);
     
     threadToBeDestroyed = currentThread;
     Sleep();					// invokes SWITCH
@@ -203,10 +217,11 @@ Thread::Finish ()
 //	Otherwise returns when the thread eventually works its way
 //	to the front of the ready list and gets re-scheduled.
 //
-//	NOTE: we disable interrupts, so that looking at the thread
-//	on the front of the ready list, and switching to it, can be done
-//	atomically.  On return, we re-set the interrupt level to its
-//	original state, in case we are called with interrupts disabled. 
+//	NOTE: we disable interrupts and lock the ready lists, so that
+//	looking at the thread on the front of the ready list, and
+//	switching to it, can be done atomically.  On return, we re-set
+//	the interrupt level to its original state, in case we are called
+//	with interrupts disabled. 
 //
 // 	Similar to Thread::Sleep(), but a little different.
 //----------------------------------------------------------------------
@@ -215,23 +230,25 @@ void
 Thread::Yield ()
 {
     Thread *nextThread;
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    IntStatus oldLevel = interrupt->DisableLocal();
     
     ASSERT(this == currentThread);
     
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
+    scheduler->LockReadyLists();
     nextThread = scheduler->FindNextToRun();
-    if (nextThread != NULL) {
-        if (nextThread->getPriority() <= currentThread->getPriority()){
-            scheduler->ReadyToRun(this);
-            scheduler->Run(nextThread);
-        }else{
+    if (nextThread != NULL && scheduler->RunsBefore(nextThread, this)) {
+        scheduler->ReadyToRun(this);
+        scheduler->Run(nextThread);		// unlocks the ready lists
+    } else {
+        if (nextThread != NULL)
             scheduler->ReadyToRun(nextThread);
-        }
+        scheduler->UnlockReadyLists();
+    }
 //	scheduler->ReadyToRun(this);
 //	scheduler->Run(nextThread);
-    }
-    (void) interrupt->SetLevel(oldLevel);
+    if (oldLevel == IntOn)		// see Interrupt::DisableLocal
+        (void) interrupt->SetLevel(IntOn);
 }
 
 //----------------------------------------------------------------------
@@ -252,9 +269,15 @@ Thread::Yield ()
 //	disable interrupts for atomicity.   We need interrupts off 
 //	so that there can't be a time slice between pulling the first thread
 //	off the ready list, and switching to it.
+//
+//	"toFree" is the spin lock protecting the wait queue we are on,
+//	if any (see SpinLock::Sleep).  It is freed only once the ready
+//	lists are locked: whoever wakes us up then has to wait for us to
+//	be off the CPU before putting us back on a ready list, where
+//	another CPU could pick us up.
 //----------------------------------------------------------------------
 void
-Thread::Sleep ()
+Thread::Sleep (SpinLock *toFree)
 {
     Thread *nextThread;
     
@@ -263,12 +286,22 @@ Thread::Sleep ()
     
     DEBUG('t', "Sleeping thread \"%s\"\n", getName());
 
+    scheduler->LockReadyLists();
+    if (toFree != NULL)
+	toFree->Unlock();
     status = BLOCKED;
-    while ((nextThread = scheduler->FindNextToRun()) == NULL)
+    while ((nextThread = scheduler->FindNextToRun()) == NULL) {
+	if (currentCpu->idleThread != NULL) {	// multiprocessor:
+	    nextThread = scheduler->StealWork(); // look for work elsewhere,
+	    if (nextThread == NULL)		// else let this CPU's
+		nextThread = currentCpu->idleThread; // idle thread wait
+	    break;
+	}
 	interrupt->Idle();	// no one to run, wait for an interrupt
+    }
         
-    scheduler->Run(nextThread); // returns when we've been signalled
-}
+    scheduler->Run(nextThread); // returns when we've been signalled,
+}				// with the ready lists unlocked
 
 //----------------------------------------------------------------------
 // ThreadFinish, InterruptEnable, ThreadPrint
@@ -279,7 +312,20 @@ Thread::Sleep ()
 //----------------------------------------------------------------------
 
 static void ThreadFinish()    { currentThread->Finish(); }
-static void InterruptEnable() { interrupt->Enable(); }
+static void InterruptEnable()
+{
+    // A thread that is just starting up did not come back through
+    // Scheduler::Run, so do what Run would have done after switching
+    // to it: unlock the ready lists, and delete the thread that
+    // finished (if any); otherwise the next Finish would overwrite
+    // threadToBeDestroyed.
+    scheduler->UnlockReadyLists();
+    if (threadToBeDestroyed != NULL) {
+	delete threadToBeDestroyed;
+	threadToBeDestroyed = NULL;
+    }
+    interrupt->Enable();
+}
 void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 
 //----------------------------------------------------------------------
@@ -308,8 +354,14 @@ Thread::StackAllocate (VoidFunctionPtr func, int arg)
 #ifdef HOST_SPARC
     // SPARC stack must contains at least 1 activation record to start with.
     stackTop = stack + StackSize - 96;
-#else  // HOST_MIPS  || HOST_i386
+#else  // HOST_MIPS  || HOST_i386 || HOST_x86_64
     stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+#ifdef HOST_x86_64
+    // as on the 386, but the return address takes two words, and
+    // ThreadRoot must find the stack 16-byte aligned once it is popped.
+    stackTop -= 4;
+    *(long *) stackTop = (long) ThreadRoot;
+#endif
 #ifdef HOST_i386
     // the 80386 passes the return address on the stack.  In order for
     // SWITCH() to go to ThreadRoot when we switch to this thread, the
@@ -321,11 +373,11 @@ Thread::StackAllocate (VoidFunctionPtr func, int arg)
     *stack = STACK_FENCEPOST;
 #endif  // HOST_SNAKE
     
-    machineState[PCState] = (int) ThreadRoot;
-    machineState[StartupPCState] = (int) InterruptEnable;
-    machineState[InitialPCState] = (int) func;
+    machineState[PCState] = (long) ThreadRoot;
+    machineState[StartupPCState] = (long) InterruptEnable;
+    machineState[InitialPCState] = (long) func;
     machineState[InitialArgState] = arg;
-    machineState[WhenDonePCState] = (int) ThreadFinish;
+    machineState[WhenDonePCState] = (long) ThreadFinish;
 }
 
 #ifdef USER_PROGRAM
@@ -338,13 +390,16 @@ Thread::StackAllocate (VoidFunctionPtr func, int arg)
 //	Note that a user program thread has *two* sets of CPU registers -- 
 //	one for its state while executing user code, one for its state 
 //	while executing kernel code.  This routine saves the former.
+//
+//	The register file is copied as one block rather than one
+//	ReadRegister call per register.
 //----------------------------------------------------------------------
 
 void
 Thread::SaveUserState()
 {
-    for (int i = 0; i < NumTotalRegs; i++)
-	userRegisters[i] = machine->ReadRegister(i);
+    bcopy((char *) machine->registers, (char *) userRegisters,
+	  sizeof(userRegisters));
 }
 
 //----------------------------------------------------------------------
@@ -359,8 +414,10 @@ Thread::SaveUserState()
 void
 Thread::RestoreUserState()
 {
-    for (int i = 0; i < NumTotalRegs; i++)
-	machine->WriteRegister(i, userRegisters[i]);
+    bcopy((char *) userRegisters, (char *) machine->registers,
+	  sizeof(userRegisters));
+    machine->llBit = FALSE;		// someone else may have run since
+					// our LL, so our SC must fail
 }
 
 //.
@@ -372,28 +429,52 @@ bool Thread::SetUserRegister(int regId, int val){
     return FALSE;
 }
 
+//----------------------------------------------------------------------
+// Thread::Suspend
+//	Swap the thread's pages out and keep it off the CPU until Awake.
+//	A ready thread is pulled straight out of the ready list; a blocked
+//	thread stays on its wait queue, and is only marked, so that a
+//	wakeup arriving while suspended is remembered (see ReadyToRun).
+//----------------------------------------------------------------------
+
 void Thread::Suspend(){
     DEBUG('d', "Thread %d Enter Thread::Suspend\n", getTid());
 
     space->SwapAllPagesToFile();
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    scheduler->LockReadyLists();	// so we can't be dispatched now
     ASSERT(status == BLOCKED || status == READY);
     if (status == BLOCKED)
         status = SUSPENDED_BLK;
-    else if (status == READY)
+    else if (status == READY){
+        scheduler->RemoveFromReadyList(this);
         status = SUSPENDED_RDY;
+    }
+    scheduler->UnlockReadyLists();
+    (void) interrupt->SetLevel(oldLevel);
 
     DEBUG('d', "Thread %d Leave Thread::Suspend\n", getTid());
 }
 
+//----------------------------------------------------------------------
+// Thread::Awake
+//	Undo Suspend.  If the thread was woken up while it was suspended,
+//	it goes back on the ready list now.
+//----------------------------------------------------------------------
+
 void Thread::Awake(){
     DEBUG('d', "Thread %d Enter Thread::Awake\n", getTid());
     
-    ASSERT(status == BLOCKED || status == READY);
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    scheduler->LockReadyLists();	// ... or woken up
+    ASSERT(status == SUSPENDED_BLK || status == SUSPENDED_RDY);
     if (status == SUSPENDED_BLK)
         status = BLOCKED;
     else if (status == SUSPENDED_RDY){
         scheduler->ReadyToRun(this);
     }
+    scheduler->UnlockReadyLists();
+    (void) interrupt->SetLevel(oldLevel);
 
     DEBUG('d', "Thread %d Leave Thread::Awake\n", getTid());
 }
@@ -40,6 +40,10 @@
 #include <unistd.h>
 #include "copyright.h"
 #include "utility.h"
+#include "threadqueue.h"
+
+class Cpu;
+class SpinLock;
 
 #ifdef USER_PROGRAM
 #include "machine.h"
@@ -76,7 +80,11 @@ public:
 
 // Size of the thread's private execution stack.
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
+#ifdef HOST_x86_64
+#define StackSize	(8 * 1024)	// in words; 64-bit frames are twice as big
+#else
 #define StackSize	(4 * 1024)	// in words
+#endif
 
 //using namespace std;
 // Thread state
@@ -87,6 +95,25 @@ enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, SUSPENDED_BLK, SUSPEN
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);	 
 
+// The real-time parameters of a thread in the earliest-deadline-first
+// class (see Scheduler::SetRealTime).  As with Statistics, the fields
+// are public to make them easier to update.
+
+class RealTimeParams {
+  public:
+    int period;				// ticks between releases
+    int budget;				// ticks it may run per period
+    int deadline;			// end of the current period
+    int used;				// ticks run so far this period
+    int runStart;			// when it last got the CPU
+    int cpuId;				// CPU its share is reserved on
+    bool throttled;			// budget used up: runs as an
+					// ordinary thread until the next
+					// period
+    bool waiting;			// asleep in WaitNextPeriod
+    int numMisses;			// periods that ended with work left
+};
+
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
 //
@@ -103,7 +130,7 @@ class Thread {
     // NOTE: DO NOT CHANGE the order of these first two members.
     // THEY MUST be in this position for SWITCH to work.
     int* stackTop;			 // the current stack pointer
-    int machineState[MachineStateSize];  // all registers except for stackTop
+    long machineState[MachineStateSize]; // all registers except for stackTop
 
   public:
     Thread(char* debugName, int priorityVal = 4);		// initialize a Thread 
@@ -117,7 +144,7 @@ class Thread {
     void Fork(VoidFunctionPtr func, int arg); 	// Make thread run (*func)(arg)
     void Yield();  				// Relinquish the CPU if any 
 						// other thread is runnable
-    void Sleep();  				// Put the thread to sleep and 
+    void Sleep(SpinLock *toFree = NULL);	// Put the thread to sleep and 
 						// relinquish the processor
     void Finish();  				// The thread is done executing
     
@@ -135,6 +162,25 @@ class Thread {
     int getPriority(){return priority;}
     void Suspend();
     void Awake();
+
+    ThreadQueue *getQueue() { return queueLink.queue; }
+					// queue this thread is waiting on,
+					// NULL if it is not on any queue
+    ThreadQueue *getJoinQueue() { return &joinQueue; }
+					// threads waiting for us to finish
+    void setWakeTime(int when) { wakeTime = when; }
+    int getWakeTime() { return wakeTime; }
+					// timer period to wake up in,
+					// while sleeping in an Alarm
+    void setCpu(Cpu *c) { cpu = c; }
+    Cpu *getCpu() { return cpu; }	// CPU we are queued on or last
+					// ran on, NULL if we never have
+    void setAffinity(int cpuId) { affinity = cpuId; }
+    int getAffinity() { return affinity; }
+					// CPU we would rather run on,
+					// -1 (the default) if any will do
+    RealTimeParams *rt;			// NULL unless in the real-time
+					// class
   private:
     // some of the private data for this class is listed above
     
@@ -150,6 +196,15 @@ class Thread {
     					// Allocate a stack for thread.
 					// Used internally by Fork()
 
+    ThreadQueueLink queueLink;		// links for the ready list or
+					// whichever wait queue we are on
+    ThreadQueue joinQueue;		// threads blocked in Join on us
+    int wakeTime;			// see setWakeTime
+    Cpu *cpu;				// see setCpu
+    int affinity;			// see setAffinity
+    friend class ThreadQueue;
+    friend class Cpu;			// to start idle threads
+
 #ifdef USER_PROGRAM
 // A thread running a user program actually has *two* sets of CPU registers -- 
 // one for its state while executing user code, one for its state 
@@ -167,6 +222,8 @@ class Thread {
     //..
 
     AddrSpace *space;			// User code this thread is running.
+    int stackSlot;			// Which of space's Fork stacks we
+					// use, -1 for the main thread's
     //.
     int addOpenFileEntry(void * openFile);  //return fid, -1 if failed
     void *getOpenFile(int fid);
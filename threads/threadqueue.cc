@@ -0,0 +1,215 @@
+// threadqueue.cc
+//	Routines to manage intrusive queues of threads.  The links are
+//	embedded in each Thread (see ThreadQueueLink), so every operation
+//	here is a few pointer updates; none of them allocate memory.
+//
+//	All routines assume interrupts are already disabled.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "threadqueue.h"
+#include "thread.h"
+
+//----------------------------------------------------------------------
+// ThreadQueue::ThreadQueue
+//	Initialize a queue of threads to empty.
+//----------------------------------------------------------------------
+
+ThreadQueue::ThreadQueue()
+{
+    first = last = NULL;
+    count = 0;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::~ThreadQueue
+//	The threads belong to whoever created them, so there is nothing
+//	to free; just make sure nobody is left waiting on a dead queue.
+//----------------------------------------------------------------------
+
+ThreadQueue::~ThreadQueue()
+{
+    ASSERT(IsEmpty());
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::InsertAfter
+//	Link "thread" into the queue right after "prev".  If "prev" is
+//	NULL, the thread goes on the front of the queue.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::InsertAfter(Thread *prev, Thread *thread)
+{
+    ThreadQueueLink *link = &thread->queueLink;
+
+    ASSERT(link->queue == NULL);	// may only wait in one place
+
+    link->queue = this;
+    link->prev = prev;
+    if (prev == NULL) {
+	link->next = first;
+	first = thread;
+    } else {
+	link->next = prev->queueLink.next;
+	prev->queueLink.next = thread;
+    }
+    if (link->next == NULL)
+	last = thread;
+    else
+	link->next->queueLink.prev = thread;
+    count++;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Append, Prepend
+//	Put a thread on the back (Append) or front (Prepend) of the queue.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Append(Thread *thread)
+{
+    InsertAfter(last, thread);
+}
+
+void
+ThreadQueue::Prepend(Thread *thread)
+{
+    InsertAfter(NULL, thread);
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::SortedInsert
+//	Insert a thread so that the queue stays sorted by increasing
+//	priority value (smaller value = more important).  Threads of
+//	equal priority stay in FIFO order.
+//
+//	We walk backwards from the tail, since a newly readied thread
+//	usually has the same priority as the threads already waiting,
+//	and so belongs at (or near) the end.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::SortedInsert(Thread *thread)
+{
+    Thread *ptr = last;
+    int priority = thread->getPriority();
+
+    while (ptr != NULL && ptr->getPriority() > priority)
+	ptr = ptr->queueLink.prev;
+    InsertAfter(ptr, thread);
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::DeadlineInsert
+//	Insert a real-time thread so that the queue stays sorted by
+//	increasing deadline.  Threads with equal deadlines stay in FIFO
+//	order.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::DeadlineInsert(Thread *thread)
+{
+    Thread *ptr = last;
+    int deadline = thread->rt->deadline;
+
+    while (ptr != NULL && ptr->rt->deadline > deadline)
+	ptr = ptr->queueLink.prev;
+    InsertAfter(ptr, thread);
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::RemoveThread
+//	Unlink "thread" from wherever it is in the queue.  Constant time,
+//	since the thread carries its own links.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::RemoveThread(Thread *thread)
+{
+    ThreadQueueLink *link = &thread->queueLink;
+
+    ASSERT(link->queue == this);
+
+    if (link->prev == NULL)
+	first = link->next;
+    else
+	link->prev->queueLink.next = link->next;
+    if (link->next == NULL)
+	last = link->prev;
+    else
+	link->next->queueLink.prev = link->prev;
+
+    link->next = link->prev = NULL;
+    link->queue = NULL;
+    count--;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Remove, RemoveLast
+//	Take a thread off the front (Remove) or back (RemoveLast) of the
+//	queue.  Return NULL if the queue is empty.
+//----------------------------------------------------------------------
+
+Thread *
+ThreadQueue::Remove()
+{
+    Thread *thread = first;
+
+    if (thread != NULL)
+	RemoveThread(thread);
+    return thread;
+}
+
+Thread *
+ThreadQueue::RemoveLast()
+{
+    Thread *thread = last;
+
+    if (thread != NULL)
+	RemoveThread(thread);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Contains, Next, Prev
+//	Simple queries on the embedded links.
+//----------------------------------------------------------------------
+
+bool
+ThreadQueue::Contains(Thread *thread)
+{
+    return (thread->queueLink.queue == this);
+}
+
+Thread *
+ThreadQueue::Next(Thread *thread)
+{
+    ASSERT(thread->queueLink.queue == this);
+    return thread->queueLink.next;
+}
+
+Thread *
+ThreadQueue::Prev(Thread *thread)
+{
+    ASSERT(thread->queueLink.queue == this);
+    return thread->queueLink.prev;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Mapcar
+//	Apply a function to each thread on the queue, front to back,
+//	following the links embedded in the threads themselves; no
+//	list elements are involved.  "func" must not take the thread
+//	off the queue, or put it on another one.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Mapcar(VoidFunctionPtr func)
+{
+    for (Thread *ptr = first; ptr != NULL; ptr = ptr->queueLink.next)
+	(*func)((int) ptr);
+}
@@ -0,0 +1,79 @@
+// threadqueue.h
+//	Data structures for queues of waiting threads.
+//
+//	Unlike List, a ThreadQueue does not allocate anything: the
+//	links live inside the Thread control block itself, so putting
+//	a thread on a queue, taking it off, or pulling it out of the
+//	middle of a queue never calls new or delete.
+//
+//	A thread can be on at most one ThreadQueue at a time.  That
+//	is always true in Nachos: a thread is either running, on the
+//	ready list, or blocked on exactly one synchronization object.
+//
+//	As with the ready list, callers are expected to have disabled
+//	interrupts before touching a ThreadQueue.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef THREADQUEUE_H
+#define THREADQUEUE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+class Thread;
+
+// The links embedded in every Thread.  Kept as a separate class so
+// that thread.h does not need to know anything about queue internals.
+
+class ThreadQueueLink {
+  public:
+    ThreadQueueLink() { next = prev = NULL; queue = NULL; }
+
+    Thread *next;		// next thread on the queue, NULL if last
+    Thread *prev;		// previous thread on the queue, NULL if first
+    class ThreadQueue *queue;	// queue we are on, NULL if none
+};
+
+// The following class defines a doubly linked queue of threads.
+// Threads can be appended in FIFO order, or inserted in increasing
+// order of priority or of deadline (FIFO among equals).
+
+class ThreadQueue {
+  public:
+    ThreadQueue();			// initialize the queue to empty
+    ~ThreadQueue();			// queue must be empty
+
+    void Append(Thread *thread);	// Put thread at the end of the queue
+    void Prepend(Thread *thread);	// Put thread at the front
+    void SortedInsert(Thread *thread);	// Insert in priority order
+    void DeadlineInsert(Thread *thread); // Insert in deadline order
+					// (real-time threads only)
+    Thread *Remove();			// Take thread off the front,
+					// NULL if the queue is empty
+    Thread *RemoveLast();		// Take thread off the back
+    void RemoveThread(Thread *thread);	// Take thread out of the middle
+    bool Contains(Thread *thread);	// Is thread on this queue?
+
+    Thread *First() { return first; }	// Peek at the front
+    Thread *Last() { return last; }	// Peek at the back
+    Thread *Next(Thread *thread);	// Thread after "thread", or NULL
+    Thread *Prev(Thread *thread);	// Thread before "thread", or NULL
+    bool IsEmpty() { return (first == NULL); }
+    int NumInQueue() { return count; }
+
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every thread,
+					// front to back
+
+  private:
+    void InsertAfter(Thread *prev, Thread *thread);
+					// Link thread in after "prev",
+					// or at the front if prev is NULL
+    Thread *first;			// Head of the queue
+    Thread *last;			// Tail of the queue
+    int count;				// Number of threads on the queue
+};
+
+#endif // THREADQUEUE_H
@@ -141,6 +141,348 @@ void mid(){
     t2->Fork(midrun, 2);
 }
 
+//----------------------------------------------------------------------
+// ThreadTest4ForJoin
+//	Several threads join the same target, and the main thread joins
+//	them all.  Exercises the per-thread join queue.
+//----------------------------------------------------------------------
+
+void
+SimpleThread4Joiner(int target){
+    printf("*** thread %d waits for thread %d\n", currentThread->getTid(), target);
+    bool ok = tidManager->join(target);
+    printf("*** thread %d: join on thread %d %s\n", currentThread->getTid(), target, ok ? "returned" : "failed");
+}
+void
+ThreadTest4ForJoin(){
+    DEBUG('t', "Entering ThreadTest4ForJoin");
+    int tids[4];
+    Thread *target = createThread("target");
+    if (target == NULL)
+        return;
+    target->Fork(SimpleThread, target->getTid());
+    tids[0] = target->getTid();
+    for (int i = 1; i < 4; ++i){
+        Thread *t = createThread("joiner");
+        if (t == NULL)
+            return;
+        tids[i] = t->getTid();
+        t->Fork(SimpleThread4Joiner, tids[0]);
+    }
+    for (int i = 3; i >= 0; --i)
+        tidManager->join(tids[i]);
+    printf("*** main thread joined all %d threads\n", 4);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest5ForManyThreads
+//	Benchmark the thread id table: create and join NumBenchThreads
+//	threads, BenchBatchSize of them alive at a time, and report the
+//	host time spent per create and per join.
+//----------------------------------------------------------------------
+
+#define NumBenchThreads 50000
+#define BenchBatchSize 5000
+
+static void
+EmptyThread(int which){
+}
+void
+ThreadTest5ForManyThreads(){
+    DEBUG('t', "Entering ThreadTest5ForManyThreads");
+    int *tids = new int[BenchBatchSize];
+    double createTime = 0, joinTime = 0, start;
+    int startTicks = stats->totalTicks;
+    int done = 0;
+
+    while (done < NumBenchThreads){
+        int n = min(BenchBatchSize, NumBenchThreads - done);
+        start = HostTime();
+        for (int i = 0; i < n; ++i){
+            Thread *t = createThread("bench");
+            ASSERT(t != NULL);
+            tids[i] = t->getTid();
+            t->Fork(EmptyThread, i);
+        }
+        createTime += HostTime() - start;
+        start = HostTime();
+        for (int i = 0; i < n; ++i)
+            tidManager->join(tids[i]);
+        joinTime += HostTime() - start;
+        done += n;
+    }
+    delete [] tids;
+    printf("*** %d threads (%d live at a time): %.3f us/create, %.3f us/join, %d ticks\n",
+        done, BenchBatchSize, createTime / done, joinTime / done,
+        stats->totalTicks - startTicks);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest6ForAlarm
+//	NumSleepers threads each sleep for a pseudo-random time, and
+//	check on wake-up that at least that much time has passed.
+//----------------------------------------------------------------------
+
+#define NumSleepers 1000
+
+static int numLateWakeups, numEarlyWakeups;
+
+void
+SleepingThread(int howLong){
+    int start = stats->totalTicks;
+    alarmClock->WaitUntil(howLong);
+    int slept = stats->totalTicks - start;
+    if (slept < howLong)
+        numEarlyWakeups++;
+    else if (slept > howLong + 2 * TimerTicks)
+        numLateWakeups++;
+}
+void
+ThreadTest6ForAlarm(){
+    DEBUG('t', "Entering ThreadTest6ForAlarm");
+    int tids[NumSleepers];
+    numLateWakeups = numEarlyWakeups = 0;
+    for (int i = 0; i < NumSleepers; ++i){
+        Thread *t = createThread("sleeper");
+        ASSERT(t != NULL);
+        tids[i] = t->getTid();
+        t->Fork(SleepingThread, 1 + (i * 7919) % 200000);
+    }
+    for (int i = 0; i < NumSleepers; ++i)
+        tidManager->join(tids[i]);
+    printf("*** %d sleepers done at tick %d: %d woke early, %d woke late\n",
+        NumSleepers, stats->totalTicks, numEarlyWakeups, numLateWakeups);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest7ForSmp
+//	NumSmpWorkers threads each burn SmpWorkUnits ticks of kernel
+//	time, with SmpHostWork steps of real computation in each.  Run
+//	with "-smp n" for n from 1 up: the simulated time taken should
+//	drop as CPUs are added, down to 1/n of the serial time while
+//	there are at least n workers -- and so should the host time, as
+//	far as the host has processors for the CPUs' host threads.
+//----------------------------------------------------------------------
+
+#define NumSmpWorkers 8
+#define SmpWorkUnits 2000
+#define SmpHostWork 1000
+
+unsigned int smpResults[NumSmpWorkers];	// (not static, so the work
+					// isn't optimized away)
+
+static void
+BusyThread(int which){
+    unsigned int x = which + 1;
+
+    for (int i = 0; i < SmpWorkUnits; ++i){
+        for (int j = 0; j < SmpHostWork; ++j){  // xorshift
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+        interrupt->DisableLocal();          // each time interrupts come
+        interrupt->SetLevel(IntOn);         // back on costs SystemTick
+    }
+    smpResults[which] = x;
+}
+void
+ThreadTest7ForSmp(){
+    DEBUG('t', "Entering ThreadTest7ForSmp");
+    int tids[NumSmpWorkers];
+    int startTicks = stats->totalTicks;
+    double start = HostTime();
+    for (int i = 0; i < NumSmpWorkers; ++i){
+        Thread *t = createThread("busy");
+        ASSERT(t != NULL);
+        tids[i] = t->getTid();
+        t->Fork(BusyThread, i);
+    }
+    for (int i = 0; i < NumSmpWorkers; ++i)
+        tidManager->join(tids[i]);
+    int elapsed = stats->totalTicks - startTicks;
+    int serial = NumSmpWorkers * SmpWorkUnits * SystemTick;
+    printf("*** %d workers on %d CPUs: %d ticks (%.2fx of serial), %.3f ms host\n",
+        NumSmpWorkers, numCpus, elapsed, serial / (double) elapsed,
+        (HostTime() - start) / 1000.0);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest8ForStealing
+//	Like ThreadTest7ForSmp, but worker i does i + 1 shares of the
+//	work, so the CPUs that got the light workers run dry early and
+//	have to steal to stay busy.  Reports the steals it took.
+//----------------------------------------------------------------------
+
+static void
+UnevenThread(int which){
+    for (int i = 0; i < (which + 1) * SmpWorkUnits / 4; ++i){
+        interrupt->DisableLocal();
+        interrupt->SetLevel(IntOn);
+    }
+}
+void
+ThreadTest8ForStealing(){
+    DEBUG('t', "Entering ThreadTest8ForStealing");
+    int tids[NumSmpWorkers];
+    int startTicks = stats->totalTicks;
+    int steals = 0, work = 0;
+    for (int i = 0; i < NumSmpWorkers; ++i){
+        Thread *t = createThread("uneven");
+        ASSERT(t != NULL);
+        tids[i] = t->getTid();
+        t->Fork(UnevenThread, i);
+        work += (i + 1) * SmpWorkUnits / 4 * SystemTick;
+    }
+    for (int i = 0; i < NumSmpWorkers; ++i)
+        tidManager->join(tids[i]);
+    for (int i = 0; i < numCpus; ++i)
+        steals += cpus[i]->numSteals;
+    printf("*** %d uneven workers on %d CPUs: %d ticks (%.2fx of serial), %d steals\n",
+        NumSmpWorkers, numCpus, stats->totalTicks - startTicks,
+        work / (double) (stats->totalTicks - startTicks), steals);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest9ForRealTime
+//	Three periodic real-time threads share the CPU with a batch
+//	thread that never blocks.  Two of them stay within their
+//	budgets and should never miss a deadline, however busy the
+//	batch thread keeps the CPU; the third does three times the work
+//	it asked for, gets throttled, and misses -- without making the
+//	others miss.  A fourth real-time thread asks for more than is
+//	left, and should be turned away.
+//----------------------------------------------------------------------
+
+#define NumRTJobs 20
+
+class PeriodicTask {
+  public:
+    char *name;
+    int period, budget, work;		// work per job, in ticks
+    int worstResponse;			// longest release-to-done time
+};
+
+static PeriodicTask periodicTasks[] = {
+    { "rt fast", 1000, 300, 200, 0 },
+    { "rt slow", 2000, 500, 400, 0 },
+    { "rt overrun", 1000, 100, 300, 0 },
+};
+#define NumPeriodicTasks (sizeof(periodicTasks) / sizeof(PeriodicTask))
+
+static void
+PeriodicThread(int which)
+{
+    PeriodicTask *task = &periodicTasks[which];
+
+    for (int job = 0; job < NumRTJobs; ++job){
+        int release = currentThread->rt->deadline - task->period;
+        for (int i = 0; i < task->work / SystemTick; ++i){
+            interrupt->SetLevel(IntOff);
+            interrupt->SetLevel(IntOn);
+        }
+        if (stats->totalTicks - release > task->worstResponse)
+            task->worstResponse = stats->totalTicks - release;
+        scheduler->WaitNextPeriod();
+    }
+    printf("*** %s (%d/%d, %d of work): %d deadline misses, worst response %d\n",
+        task->name, task->budget, task->period, task->work,
+        currentThread->rt->numMisses, task->worstResponse);
+}
+static void
+BatchThread(int dummy)
+{
+    int loops = 0;
+    while (stats->totalTicks < NumRTJobs * 2000){
+        interrupt->SetLevel(IntOff);
+        interrupt->SetLevel(IntOn);
+        loops++;
+    }
+    printf("*** batch thread got %d ticks of %d\n", loops * SystemTick,
+        NumRTJobs * 2000);
+}
+void
+ThreadTest9ForRealTime(){
+    DEBUG('t', "Entering ThreadTest9ForRealTime");
+    int tids[NumPeriodicTasks + 1];
+    Thread *t;
+
+    for (unsigned int i = 0; i < NumPeriodicTasks; ++i){
+        t = createThread(periodicTasks[i].name);
+        ASSERT(t != NULL);
+        periodicTasks[i].worstResponse = 0;
+        if (!scheduler->SetRealTime(t, periodicTasks[i].period,
+                                    periodicTasks[i].budget))
+            printf("*** %s was not admitted\n", periodicTasks[i].name);
+        tids[i] = t->getTid();
+        t->Fork(PeriodicThread, i);
+    }
+    t = createThread("rt greedy");
+    ASSERT(t != NULL);
+    bool admitted = scheduler->SetRealTime(t, 1000, 500);
+    printf("*** a 500/1000 thread is %s\n", admitted ? "admitted" : "rejected");
+    if (admitted)
+        scheduler->ClearRealTime(t);
+    delete t;
+    t = createThread("batch");
+    ASSERT(t != NULL);
+    tids[NumPeriodicTasks] = t->getTid();
+    t->Fork(BatchThread, 0);
+    for (unsigned int i = 0; i <= NumPeriodicTasks; ++i)
+        tidManager->join(tids[i]);
+}
+
+//----------------------------------------------------------------------
+// ThreadTest10ForWorkQueue
+//	Submit NumWorkItems distinct work items, and the same item
+//	NumWorkItems times over, then Flush: every distinct item should
+//	have run once, and the repeated one only as often as it was
+//	submitted while not already pending.  Then schedule a tasklet,
+//	which should run at the very next interrupt.
+//----------------------------------------------------------------------
+
+#define NumWorkItems 100
+
+static int workDone, repeatDone, taskletDone;
+
+static void
+CountWork(int counter)
+{
+    (*(int *) counter)++;
+}
+void
+ThreadTest10ForWorkQueue(){
+    DEBUG('t', "Entering ThreadTest10ForWorkQueue");
+    WorkItem *items[NumWorkItems];
+    WorkItem repeat(CountWork, (int) &repeatDone);
+    WorkItem tasklet(CountWork, (int) &taskletDone);
+    int queued = 0;
+
+    workDone = repeatDone = taskletDone = 0;
+    for (int i = 0; i < NumWorkItems; ++i){
+        items[i] = new WorkItem(CountWork, (int) &workDone);
+        workQueue->Queue(items[i]);
+        if (workQueue->Queue(&repeat))
+            queued++;
+    }
+    workQueue->Flush();
+    printf("*** %d work items run, repeated item run %d times (queued %d)\n",
+        workDone, repeatDone, queued);
+    for (int i = 0; i < NumWorkItems; ++i)
+        delete items[i];
+
+    int start = stats->totalTicks;
+    ScheduleTasklet(&tasklet);
+    while (taskletDone == 0 && stats->totalTicks - start < 10 * TimerTicks){
+        interrupt->SetLevel(IntOff);        // wait for some interrupt
+        interrupt->SetLevel(IntOn);         // (under -tickless there
+    }                                       // may be none)
+    if (taskletDone)
+        printf("*** tasklet ran after %d ticks\n", stats->totalTicks - start);
+    else
+        printf("*** no interrupt came along to run the tasklet\n");
+}
+
 //in synchtest.cc
 extern int synch_test_choice;
 extern void producer_cosumer_test();
@@ -148,6 +490,7 @@ extern void barrier_test();
 extern bool synch_test_yield;
 extern bool synch_test_yield_writer;
 extern void read_write_lock_test();
+extern void rw_class_test(RWPolicy policy, int batch);
 void
 ThreadTest()
 {
@@ -161,6 +504,27 @@ ThreadTest()
     case 3:
         ThreadTest3ForTs();
         break;
+    case 4:
+        ThreadTest4ForJoin();
+        break;
+    case 5:
+        ThreadTest5ForManyThreads();
+        break;
+    case 6:
+        ThreadTest6ForAlarm();
+        break;
+    case 7:
+        ThreadTest7ForSmp();
+        break;
+    case 8:
+        ThreadTest8ForStealing();
+        break;
+    case 9:
+        ThreadTest9ForRealTime();
+        break;
+    case 10:
+        ThreadTest10ForWorkQueue();
+        break;
     case 23:
         ThreadTest23();
         break;
@@ -202,6 +566,15 @@ ThreadTest()
     case 39:
         mid();
         break;
+    case 40:
+        rw_class_test(RWWriterPreferred, 0);
+        break;
+    case 41:
+        rw_class_test(RWPhaseFair, 0);
+        break;
+    case 42:
+        rw_class_test(RWPhaseFair, 2);
+        break;
     default:
 	    printf("No thread test specified.\n");
         //printf("CQY added a test.\n");
@@ -2,82 +2,96 @@
 #include "tid.h"
 
 TidManager::TidManager(){
+    threadTable = new Thread*[MAX_NUM_THREAD];
+    freeIds = new int[MAX_NUM_THREAD];
     for (int i = 0; i < MAX_NUM_THREAD; ++i){
-        idPool.insert(i);
+        threadTable[i] = NULL;
+        freeIds[i] = i;
     }
-    ctrlLock = new Lock("TidManagerLock");
+    freeHead = 0;
+    numFree = MAX_NUM_THREAD;
+    numLive = 0;
 }
 TidManager::~TidManager(){
-    delete ctrlLock;
+    delete [] threadTable;
+    delete [] freeIds;
 }
-//if return value is -1, it means all ids are being used.
+
+//----------------------------------------------------------------------
+// TidManager::genId
+//	Take the oldest free id off the free FIFO.
+//	If return value is -1, it means all ids are being used.
+//----------------------------------------------------------------------
 
 int TidManager::genId(){
-    ctrlLock->Acquire();
-    if (idPool.size() <= 0)
-        return -1;
-    int retId = *(idPool.begin());
-    idPool.erase(retId);
-    ctrlLock->Release();
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int retId = -1;
+    if (numFree > 0){
+        retId = freeIds[freeHead];
+        freeHead = (freeHead + 1) % MAX_NUM_THREAD;
+        numFree--;
+        numLive++;
+    }
+    (void) interrupt->SetLevel(oldLevel);
     return retId;
 }
+
+//----------------------------------------------------------------------
+// TidManager::putBack
+//	Return an id to the back of the free FIFO.
+//----------------------------------------------------------------------
+
 int TidManager::putBack(int tid){
     if (tid < 0 || tid >= MAX_NUM_THREAD)
         return -1;
-    ctrlLock->Acquire();
-    allThreads.erase(tid);
-    idPool.insert(tid);
-    ctrlLock->Release();
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    threadTable[tid] = NULL;
+    freeIds[(freeHead + numFree) % MAX_NUM_THREAD] = tid;
+    numFree++;
+    numLive--;
+    (void) interrupt->SetLevel(oldLevel);
     return 0;
 }
 void TidManager::addThread(Thread * t){
-    ctrlLock->Acquire();
-    allThreads.insert(pair<int, Thread*>(t->getTid(), t));
-    ctrlLock->Release();
+    int tid = t->getTid();
+    ASSERT(tid >= 0 && tid < MAX_NUM_THREAD && threadTable[tid] == NULL);
+    threadTable[tid] = t;
+}
+Thread *TidManager::getThread(int tid){
+    if (tid < 0 || tid >= MAX_NUM_THREAD)
+        return NULL;
+    return threadTable[tid];
 }
 void TidManager::ts(){
-    ctrlLock->Acquire();
-    map<int, Thread*>::iterator itr;
     printf("Tid\tUid\tPri\tName\tStatus\n");
-    for (itr = allThreads.begin(); itr != allThreads.end(); ++itr){
-        Thread *t = itr->second;
+    for (int i = 0; i < MAX_NUM_THREAD; ++i){
+        Thread *t = threadTable[i];
+        if (t == NULL)
+            continue;
         printf("%d\t%d\t%d\t%s\t%s\n", t->getTid(), t->getUid(), t->getPriority(), t->getName(), t->getStatusName());
         
     }
-    ctrlLock->Release();
 }
-bool TidManager::addToJoinTable(int tid){
-    ctrlLock->Acquire();
-    map<int, Thread*>::iterator threadIter;
-    threadIter = allThreads.find(tid);
-    if (threadIter == allThreads.end()){
-        ctrlLock->Release();
+
+//----------------------------------------------------------------------
+// TidManager::join
+//	Block the current thread until thread "tid" has finished.  The
+//	waiter goes on the target thread's own join queue; the target
+//	wakes everyone on it in Thread::Finish.
+//
+//	Interrupts stay off from the lookup until we are asleep, so the
+//	target cannot finish in between and leave us waiting forever.
+//----------------------------------------------------------------------
+
+bool TidManager::join(int tid){
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Thread *target = getThread(tid);
+    if (target == NULL || target == currentThread){
+        (void) interrupt->SetLevel(oldLevel);
         return FALSE;
     }
-    map<int, List&>::iterator iter;
-    iter = joinThreadTable.find(tid);
-    if (iter == joinThreadTable.end()){
-        List lst;
-        lst.Append((void *)currentThread);
-        joinThreadTable.insert(pair<int, List&>(tid, lst));
-    } else {
-        List lst = iter->second;
-        lst.Append((void *)currentThread);
-    }
-    ctrlLock->Release();
+    target->getJoinQueue()->Append(currentThread);
+    currentThread->Sleep();
+    (void) interrupt->SetLevel(oldLevel);
     return TRUE;
 }
-void TidManager::awakeJoinThreads(int tid){
-    ctrlLock->Acquire();
-    map<int, List&>::iterator iter;
-    iter = joinThreadTable.find(tid);
-    if (iter != joinThreadTable.end()){
-        List lst = iter->second;
-        Thread * thread;
-        while ((thread = (Thread *)lst.Remove()) != NULL){
-            scheduler->ReadyToRun(thread);
-        }
-        joinThreadTable.erase(tid);
-    }
-    ctrlLock->Release();
-}
\ No newline at end of file
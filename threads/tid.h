@@ -7,28 +7,41 @@
 #ifndef _TID_H
 #define _TID_H
 
-#include<set>
-#include<map>
 #include "thread.h"
-#include "synch.h"
-#include "list.h"
-#define MAX_NUM_THREAD 128
-using namespace std;
+
+// Number of thread ids.  The id table is a flat array indexed by tid,
+// so this only costs one pointer per id.
+#define MAX_NUM_THREAD 65536
+
+// TidManager hands out thread ids and maps them back to threads.
+//
+// Free ids are kept in a circular FIFO, so allocating and freeing an
+// id are both O(1), and a freed id goes to the back of the line.
+// That keeps a just-finished tid from being handed out again right
+// away, which would let a late Join wait on the wrong thread.
+//
+// All operations are short and never block, so they are made atomic
+// by disabling interrupts rather than with a Lock; putBack is called
+// from the Thread destructor, inside Scheduler::Run, where sleeping
+// on a Lock is not allowed.
 class TidManager{
     private:
-        Lock *ctrlLock;
-        set<int> idPool;
-        map<int, Thread*> allThreads;
-        map<int, List&> joinThreadTable;
+        Thread **threadTable;   // threadTable[tid], NULL if tid is free
+        int *freeIds;           // circular FIFO of free ids
+        int freeHead;           // next id to hand out
+        int numFree;            // number of ids in freeIds
+        int numLive;            // number of ids in use
     public:
         TidManager();
         ~TidManager();
-        int genId();
+        int genId();            // -1 if all ids are in use
         int putBack(int tid);
         void addThread(Thread * t);
+        Thread *getThread(int tid);     // NULL if no such thread
+        int numThreads() { return numLive; }
         void ts();
-        bool addToJoinTable(int tid);
-        void awakeJoinThreads(int tid);
+        bool join(int tid);     // wait for thread tid to finish,
+                                // FALSE if there is no such thread
         
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,127 @@
+// trace.cc
+//	Routines to record scheduling events and write them out in the
+//	Chrome trace_event format.  See trace.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "trace.h"
+#include "system.h"
+
+#include <stdio.h>
+
+//----------------------------------------------------------------------
+// Tracer::Tracer
+// 	Start recording events.
+//
+//	"fileName" is the host file to write them to at halt.
+//----------------------------------------------------------------------
+
+Tracer::Tracer(char *fileName)
+{
+    file = fileName;
+    events = new TraceEvent[TraceBufferSize];
+    numRecorded = 0;
+}
+
+//----------------------------------------------------------------------
+// Tracer::~Tracer
+// 	Throw away the recorded events.
+//----------------------------------------------------------------------
+
+Tracer::~Tracer()
+{
+    delete [] events;
+}
+
+//----------------------------------------------------------------------
+// Tracer::Record
+// 	Record an event for the current thread, overwriting the oldest
+//	one if the buffer is full.  Called through the TRACE macro.
+//	CPUs recording at the same time each claim a slot of their own.
+//
+//	"type" is the kind of event
+//	"arg", "name" are event-specific details (see trace.h)
+//----------------------------------------------------------------------
+
+void
+Tracer::Record(TraceEventType type, int arg, char *name)
+{
+    TraceEvent *e = &events[FetchAndAdd(&numRecorded, 1) % TraceBufferSize];
+
+    e->type = type;
+    e->cpu = (currentCpu != NULL) ? currentCpu->getId() : 0;
+    e->tid = (currentThread != NULL) ? currentThread->getTid() : -1;
+    e->ticks = stats->totalTicks;
+    e->hostTime = HostTime();
+    e->arg = arg;
+    e->name = name;
+}
+
+//----------------------------------------------------------------------
+// Tracer::Dump
+// 	Write the events still in the buffer, oldest first, as a Chrome
+//	trace_event JSON file.
+//
+//	A context switch ends a "running" slice on the old thread and
+//	begins one on the new thread; everything else is an instant
+//	event on the thread it happened to.
+//----------------------------------------------------------------------
+
+void
+Tracer::Dump()
+{
+    FILE *fp = fopen(file, "w");
+    int count = (numRecorded < TraceBufferSize) ? numRecorded : TraceBufferSize;
+    int first = (numRecorded < TraceBufferSize) ? 0
+					: numRecorded % TraceBufferSize;
+    char *sep = "";
+
+    if (fp == NULL) {
+	printf("Could not write trace file %s\n", file);
+	return;
+    }
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (int i = 0; i < count; i++) {
+	TraceEvent *e = &events[(first + i) % TraceBufferSize];
+
+	switch (e->type) {
+	  case TraceSwitch:
+	    fprintf(fp, "%s{\"name\":\"running\",\"ph\":\"E\",\"pid\":%d,"
+		"\"tid\":%d,\"ts\":%d}", sep, e->cpu, e->tid, e->ticks);
+	    sep = ",\n";
+	    fprintf(fp, "%s{\"name\":\"running\",\"ph\":\"B\",\"pid\":%d,"
+		"\"tid\":%d,\"ts\":%d,\"args\":{\"host_us\":%.0f}}", sep,
+		e->cpu, e->arg, e->ticks, e->hostTime);
+	    break;
+	  case TraceBlock:
+	    fprintf(fp, "%s{\"name\":\"block %s\",\"ph\":\"i\",\"s\":\"t\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%d,\"args\":{\"host_us\":%.0f}}",
+		sep, e->name, e->cpu, e->tid, e->ticks, e->hostTime);
+	    break;
+	  case TraceWakeup:
+	    fprintf(fp, "%s{\"name\":\"wakeup %s\",\"ph\":\"i\",\"s\":\"t\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%d,\"args\":{\"woken\":%d,"
+		"\"host_us\":%.0f}}", sep, e->name, e->cpu, e->tid, e->ticks,
+		e->arg, e->hostTime);
+	    break;
+	  case TraceInterrupt:
+	    fprintf(fp, "%s{\"name\":\"%s interrupt\",\"ph\":\"i\",\"s\":\"p\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%d,\"args\":{\"host_us\":%.0f}}",
+		sep, e->name, e->cpu, e->tid, e->ticks, e->hostTime);
+	    break;
+	  case TraceSyscall:
+	    fprintf(fp, "%s{\"name\":\"%s %d\",\"ph\":\"i\",\"s\":\"t\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%d,\"args\":{\"host_us\":%.0f}}",
+		sep, e->name, e->arg, e->cpu, e->tid, e->ticks, e->hostTime);
+	    break;
+	}
+	sep = ",\n";
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    printf("Trace: %d events recorded, %d written to %s\n", numRecorded,
+	count, file);
+}
@@ -0,0 +1,85 @@
+// trace.h
+//	Data structures for recording scheduling events.
+//
+//	With "-trace <file>", context switches, threads blocking on and
+//	being woken from semaphores, interrupts and system calls are
+//	recorded in an in-memory ring buffer, and written to <file> when
+//	Nachos halts, in the Chrome trace_event JSON format (load it in
+//	chrome://tracing or Perfetto).  Each simulated CPU shows up as a
+//	process, and each Nachos thread as a thread in it.
+//
+//	Events are time-stamped with the simulated clock (one tick is
+//	shown as one microsecond), and carry the host time as well.
+//
+//	Tracing is off by default.  Then "tracer" is NULL, and the TRACE
+//	macro costs a single test of it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "copyright.h"
+
+#define TraceBufferSize	65536	// events kept; older ones are overwritten
+
+// The kinds of events we record.  What "arg" and "name" mean depends
+// on the kind.
+
+enum TraceEventType {
+    TraceSwitch,		// arg: thread switched to
+    TraceBlock,			// name: semaphore waited on
+    TraceWakeup,		// arg: thread woken, name: semaphore
+    TraceInterrupt,		// name: device that interrupted
+    TraceSyscall		// arg: system call or exception number,
+				// name: "syscall" or "exception"
+};
+
+// One recorded event.
+
+class TraceEvent {
+  public:
+    TraceEventType type;
+    int cpu;			// CPU it happened on
+    int tid;			// thread it happened to
+    int ticks;			// simulated time
+    double hostTime;		// host time, in microseconds
+    int arg;
+    char *name;			// must outlive the tracer; always a
+				// constant or an object's debug name
+};
+
+// The following class defines the ring buffer of events.
+
+class Tracer {
+  public:
+    Tracer(char *fileName);		// start recording
+    ~Tracer();
+
+    void Record(TraceEventType type, int arg, char *name);
+					// record an event for the
+					// current thread
+    void Dump();			// write the events out
+
+  private:
+    char *file;				// where Dump writes
+    TraceEvent *events;			// the ring buffer
+    int numRecorded;			// events recorded in all, including
+					// the ones since overwritten; the
+					// next one goes in slot numRecorded
+					// % TraceBufferSize
+};
+
+extern Tracer *tracer;			// NULL unless tracing is on
+
+// Record an event if, and only if, tracing is on.
+
+#define TRACE(type, arg, name)						\
+    do {								\
+	if (tracer != NULL)						\
+	    tracer->Record(type, arg, name);				\
+    } while (0)
+
+#endif // TRACE_H
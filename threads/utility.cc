@@ -21,7 +21,7 @@
 #endif
 #endif
 
-static char *enableFlags = NULL; // controls which DEBUG messages are printed 
+unsigned int debugMask = 0;	// controls which DEBUG messages are printed 
 
 //----------------------------------------------------------------------
 // DebugInit
@@ -30,6 +30,9 @@ static char *enableFlags = NULL; // controls which DEBUG messages are printed
 //
 //	If the flag is "+", we enable all DEBUG messages.
 //
+//	The flags are turned into a bit mask once, here, so that the
+//	DEBUG macro only has to test a bit.
+//
 // 	"flagList" is a string of characters for whose DEBUG messages are 
 //		to be enabled.
 //----------------------------------------------------------------------
@@ -37,39 +40,29 @@ static char *enableFlags = NULL; // controls which DEBUG messages are printed
 void
 DebugInit(char *flagList)
 {
-    enableFlags = flagList;
-}
-
-//----------------------------------------------------------------------
-// DebugIsEnabled
-//      Return TRUE if DEBUG messages with "flag" are to be printed.
-//----------------------------------------------------------------------
-
-bool
-DebugIsEnabled(char flag)
-{
-    if (enableFlags != NULL)
-       return (strchr(enableFlags, flag) != 0) 
-		|| (strchr(enableFlags, '+') != 0);
-    else
-      return FALSE;
+    debugMask = 0;
+    for (char *p = flagList; *p != '\0'; p++)
+	if (*p == '+')
+	    debugMask = ~0u;
+	else
+	    debugMask |= DebugBit(*p);
 }
 
 //----------------------------------------------------------------------
-// DEBUG
-//      Print a debug message, if flag is enabled.  Like printf,
-//	only with an extra argument on the front.
+// DebugPrint
+//      Print a debug message.  Like printf.  Only called, through the
+//	DEBUG macro, once it has checked that the message's flag is
+//	enabled -- so the formatting cost is only paid for messages that
+//	are actually printed.
 //----------------------------------------------------------------------
 
 void 
-DEBUG(char flag, char *format, ...)
+DebugPrint(char *format, ...)
 {
-    if (DebugIsEnabled(flag)) {
-	va_list ap;
-	// You will get an unused variable message here -- ignore it.
-	va_start(ap, format);
-	vfprintf(stdout, format, ap);
-	va_end(ap);
-	fflush(stdout);
-    }
+    va_list ap;
+    // You will get an unused variable message here -- ignore it.
+    va_start(ap, format);
+    vfprintf(stdout, format, ap);
+    va_end(ap);
+    fflush(stdout);
 }
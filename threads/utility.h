@@ -16,6 +16,16 @@
 //   	'a' -- address spaces (USER_PROGRAM)
 //   	'n' -- network emulation (NETWORK)
 //
+//	Flags are letters, and case does not matter.
+//
+//	Checking whether a flag is on is a single test of a bit mask,
+//	and the arguments of a DEBUG message are not even evaluated
+//	unless it is, so DEBUG can be left in the hottest paths.  A
+//	build can also compile some or all of them out completely, by
+//	defining DEBUG_CATEGORIES to the string of flags to keep (see
+//	the "release" target in Makefile.common); then "-d" can only turn
+//	on those.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -60,10 +70,41 @@ typedef void (*VoidNoArgFunctionPtr)();
 
 extern void DebugInit(char* flags);	// enable printing debug messages
 
-extern bool DebugIsEnabled(char flag); 	// Is this debug flag enabled?
-
-extern void DEBUG (char flag, char* format, ...);  	// Print debug message 
-							// if flag is enabled
+extern unsigned int debugMask;		// DebugBit of every enabled flag
+
+extern void DebugPrint(char* format, ...); // Print a debug message;
+					// called through DEBUG
+
+#define DebugBit(flag)	(1u << ((flag) & 31))
+
+// Is this flag compiled in?  Every flag is, unless DEBUG_CATEGORIES
+// says otherwise.  With a constant flag, as DEBUG always has, an
+// optimizing compiler works this out at compile time.
+
+#ifdef DEBUG_CATEGORIES
+static inline bool
+DebugIsCompiledIn(char flag)
+{
+    for (const char *p = DEBUG_CATEGORIES; *p != '\0'; p++)
+	if (*p == flag || *p == '+')
+	    return TRUE;
+    return FALSE;
+}
+#else
+#define DebugIsCompiledIn(flag)	TRUE
+#endif
+
+// Is this debug flag enabled?
+#define DebugIsEnabled(flag)						\
+    (DebugIsCompiledIn(flag) && (debugMask & DebugBit(flag)) != 0)
+
+// Print debug message if flag is enabled.  Like printf, only with an
+// extra argument on the front.
+#define DEBUG(flag, ...)						\
+    do {								\
+	if (DebugIsEnabled(flag))					\
+	    DebugPrint(__VA_ARGS__);					\
+    } while (0)
 
 //----------------------------------------------------------------------
 // ASSERT
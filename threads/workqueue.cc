@@ -0,0 +1,222 @@
+// workqueue.cc
+//	Routines to run deferred kernel work, either in a worker thread
+//	or as tasklets at the end of an interrupt.  See workqueue.h.
+//
+//	Interrupts are disabled while touching the queues, since items
+//	are submitted from interrupt handlers.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "workqueue.h"
+#include "synch.h"
+#include "system.h"
+
+// the tasklets scheduled, and not yet run, in order
+static WorkItem *taskletFirst = NULL, *taskletLast = NULL;
+
+//----------------------------------------------------------------------
+// WorkItem::WorkItem
+// 	Initialize a piece of work, not yet submitted.
+//
+//	"workFunc" is the procedure to call, with "workArg" as its
+//	argument, each time the item is run.
+//----------------------------------------------------------------------
+
+WorkItem::WorkItem(VoidFunctionPtr workFunc, int workArg)
+{
+    func = workFunc;
+    arg = workArg;
+    pending = FALSE;
+    next = NULL;
+}
+
+//----------------------------------------------------------------------
+// WorkerThread
+// 	Dummy function because C++ can't indirectly invoke member
+//	functions.  Forked as the worker thread.
+//
+//	"arg" is the WorkQueue, cast to an int.
+//----------------------------------------------------------------------
+
+static void
+WorkerThread(int arg)
+{
+    ((WorkQueue *) arg)->Worker();
+}
+
+//----------------------------------------------------------------------
+// WorkQueue::WorkQueue
+// 	Initialize an empty work queue, and fork its worker thread, which
+//	goes to sleep until there is something to do.
+//
+//	"debugName" is an arbitrary name, useful for debugging; it is
+//	also the worker thread's name.
+//----------------------------------------------------------------------
+
+WorkQueue::WorkQueue(char *debugName)
+{
+    name = debugName;
+    first = last = NULL;
+    workerIdle = FALSE;
+    worker = createThread(debugName, WorkerPriority);
+    ASSERT(worker != NULL);
+    worker->Fork(WorkerThread, (int) this);
+}
+
+//----------------------------------------------------------------------
+// WorkQueue::~WorkQueue
+// 	Nachos is halting; anything still queued will never run, so just
+//	forget about it.  The worker thread is asleep, and stays so.
+//----------------------------------------------------------------------
+
+WorkQueue::~WorkQueue()
+{
+    while (first != NULL) {
+	first->pending = FALSE;
+	first = first->next;
+    }
+}
+
+//----------------------------------------------------------------------
+// WorkQueue::Queue
+// 	Arrange for (*item->func)(item->arg) to be called by the worker
+//	thread, after everything already queued.  Can be called from an
+//	interrupt handler.
+//
+//	Returns FALSE, and does nothing, if the item is already waiting
+//	to run -- on this queue or as a tasklet.
+//----------------------------------------------------------------------
+
+bool
+WorkQueue::Queue(WorkItem *item)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (item->pending) {
+	(void) interrupt->SetLevel(oldLevel);
+	return FALSE;
+    }
+    item->pending = TRUE;
+    item->next = NULL;
+    if (last == NULL)
+	first = item;
+    else
+	last->next = item;
+    last = item;
+    if (workerIdle) {			// wake the worker up
+	workerIdle = FALSE;
+	scheduler->ReadyToRun(worker);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// WorkQueue::Worker
+// 	Run queued items, oldest first, forever; sleep while there are
+//	none.  Each item is taken off the queue before it runs, so it
+//	can be queued again -- by itself, or by an interrupt -- while it
+//	is running.
+//----------------------------------------------------------------------
+
+void
+WorkQueue::Worker()
+{
+    WorkItem *item;
+
+    for (;;) {
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+	while (first == NULL) {
+	    workerIdle = TRUE;
+	    currentThread->Sleep();
+	}
+	item = first;
+	first = item->next;
+	if (first == NULL)
+	    last = NULL;
+	item->pending = FALSE;
+	stats->numWorkItems++;
+	(void) interrupt->SetLevel(oldLevel);
+
+	DEBUG('t', "Work queue \"%s\" running item %x\n", name, (int) item);
+	(*item->func)(item->arg);
+    }
+}
+
+//----------------------------------------------------------------------
+// WorkQueue::Flush
+// 	Wait until everything queued before the call has run, by queueing
+//	an item of our own behind it and waiting for that one.  Must not
+//	be called by a work item (on the same queue), which would wait
+//	for itself.
+//----------------------------------------------------------------------
+
+static void
+FlushDone(int arg)
+{
+    ((Semaphore *) arg)->V();
+}
+
+void
+WorkQueue::Flush()
+{
+    Semaphore done("work queue flush", 0);
+    WorkItem marker(FlushDone, (int) &done);
+
+    ASSERT(currentThread != worker);
+    Queue(&marker);
+    done.P();
+}
+
+//----------------------------------------------------------------------
+// ScheduleTasklet
+// 	Arrange for (*item->func)(item->arg) to be called at the end of
+//	the current interrupt, after the handler returns, with interrupts
+//	still disabled.  Meant to be called from interrupt handlers;
+//	called from anywhere else, the tasklet runs at the next
+//	interrupt.  Does nothing if the item is already waiting to run.
+//----------------------------------------------------------------------
+
+void
+ScheduleTasklet(WorkItem *item)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (!item->pending) {
+	item->pending = TRUE;
+	item->next = NULL;
+	if (taskletLast == NULL)
+	    taskletFirst = item;
+	else
+	    taskletLast->next = item;
+	taskletLast = item;
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RunTasklets
+// 	Run every scheduled tasklet, oldest first, including any that
+//	they schedule in turn.  Called by Interrupt::CheckIfDue after
+//	each interrupt handler, with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+RunTasklets()
+{
+    WorkItem *item;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+    while ((item = taskletFirst) != NULL) {
+	taskletFirst = item->next;
+	if (taskletFirst == NULL)
+	    taskletLast = NULL;
+	item->pending = FALSE;
+	stats->numTasklets++;
+	(*item->func)(item->arg);
+    }
+}
@@ -0,0 +1,89 @@
+// workqueue.h
+//	Data structures for deferred kernel work.
+//
+//	Much of what the kernel does in the background -- delivering
+//	network packets, finishing off disk transfers -- is a short
+//	routine that has to run soon after some interrupt, but not in
+//	the interrupt handler itself.  Rather than give each such job a
+//	thread of its own (with its own stack, and a SWITCH every time it
+//	wakes up), they are queued as WorkItems:
+//
+//	  - on the work queue, "workQueue", whose one worker thread runs
+//	    them in order.  Work items run with interrupts enabled, and
+//	    may take locks and wait, but while one waits, everything
+//	    queued behind it waits too, so they should not wait for long;
+//
+//	  - as tasklets, run by the interrupt code itself, right after
+//	    the handler that scheduled them, with interrupts still
+//	    disabled.  Tasklets must never wait.
+//
+//	Both can be submitted from interrupt handlers.  A WorkItem is not
+//	allocated by the queue: it belongs to whoever submits it,
+//	usually as a member of some larger object, and can be submitted
+//	again once it has started running.  Submitting an item that is
+//	still waiting to run does nothing, so a burst of interrupts that
+//	each submit the same item costs a single run.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+class Thread;
+
+#define WorkerPriority	1		// ahead of ordinary threads, which
+					// are usually waiting for the work
+
+// One piece of deferred work: call (*func)(arg).
+
+class WorkItem {
+  public:
+    WorkItem(VoidFunctionPtr workFunc, int workArg);
+
+    bool IsPending() { return pending; }
+
+  private:
+    VoidFunctionPtr func;		// what to call
+    int arg;				// ... and with what
+    bool pending;			// queued, and not started yet?
+    WorkItem *next;			// next on the same queue
+    friend class WorkQueue;
+    friend void ScheduleTasklet(WorkItem *item);
+    friend void RunTasklets();
+};
+
+// The following class defines a queue of work items, served by one
+// worker thread.
+
+class WorkQueue {
+  public:
+    WorkQueue(char *debugName);		// start the worker thread
+    ~WorkQueue();
+
+    bool Queue(WorkItem *item);		// run item soon; FALSE if it was
+					// already waiting to run
+    void Flush();			// wait until everything queued
+					// so far has run
+    void Worker();			// body of the worker thread
+
+  private:
+    char *name;
+    Thread *worker;			// the thread that runs the items
+    bool workerIdle;			// is it asleep, waiting for work?
+    WorkItem *first, *last;		// the items waiting to run, in order
+};
+
+extern void ScheduleTasklet(WorkItem *item);
+					// run item at the end of the
+					// current interrupt
+extern void RunTasklets();		// run the tasklets scheduled so far;
+					// called by the interrupt code
+
+extern WorkQueue *workQueue;		// the kernel's shared work queue
+
+#endif // WORKQUEUE_H
@@ -19,6 +19,8 @@
 #include "system.h"
 #include "addrspace.h"
 #include "noff.h"
+#include "filehdr.h"		// for MaxFileSize, the most a swap
+				// file can hold
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
@@ -75,6 +77,16 @@ AddrSpace::AddrSpace(OpenFile *executable, int tid)
     size = noffH.code.size + noffH.initData.size + noffH.uninitData.size 
 			+ UserStackSize;	// we need to increase the size
 						// to leave room for the stack
+    // and for the stacks of threads the program may Fork, as many as
+    // will fit in the swap file
+    numStacks = (MaxFileSize - divRoundUp(size, PageSize) * PageSize)
+			/ UserStackSize;
+    if (numStacks > MaxForkStacks)
+	numStacks = MaxForkStacks;
+    if (numStacks < 0)
+	numStacks = 0;
+    stacksInUse = 0;
+    size += numStacks * UserStackSize;
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
 
@@ -149,33 +161,6 @@ AddrSpace::AddrSpace(OpenFile *executable, int tid)
    // DumpPageTable();
 }
 
-//. for Fork syscall
-AddrSpace::AddrSpace(int tid, void * fatherSpace_){
-    AddrSpace * fatherSpace = (AddrSpace *)fatherSpace_;
-    numPages = fatherSpace->numPages;
-    pageTable = new TranslationEntry[numPages];                    // for now!
-    for (int i = 0; i < numPages; i++) {
-        pageTable[i].virtualPage = i;   
-        pageTable[i].physicalPage = -1; // not the judge.
-        pageTable[i].valid = FALSE;    // as the judge of whether this page entry is useful
-        pageTable[i].use = FALSE;      //      
-        pageTable[i].dirty = FALSE;
-        pageTable[i].readOnly = FALSE; 
-    }
-    swapFileName = new char[10];
-    swapFileName = my_itoa(tid, swapFileName);
-    //   CreateSwapFile when using fork
-    fileSystem->Copy(fatherSpace->swapFileName, numPages * PageSize, swapFileName);
-    OpenFile * fileHandler = fileSystem->Open(swapFileName);
-    for (int vpn = 0; vpn < numPages; ++vpn){
-        if (fatherSpace->pageTable[vpn].dirty){
-            int fatherppn = fatherSpace->pageTable[vpn].physicalPage;
-            fileHandler->WriteAt(&(machine->mainMemory[fatherppn * PageSize]),
-                PageSize, vpn * PageSize);
-        }
-    }
-    delete fileHandler;
-}
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
 // 	Dealloate an address space.  Nothing for now!
@@ -183,9 +168,18 @@ AddrSpace::AddrSpace(int tid, void * fatherSpace_){
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
    //.
    machine->AcquireLock();
+   for (int i = 0; i < numCpus; i++) {
+        // Don't leave any CPU's machine translating through a dead
+        // page table; its next RestoreState must reload and flush.
+        Machine *m = cpus[i]->machine;
+        if (m->pageTable == pageTable) {
+            m->InvalidAllEntryInTLB();
+            m->pageTable = NULL;
+            m->pageTableSize = 0;
+        }
+   }
    fileSystem->Remove(swapFileName);
    for (int i = 0; i < numPages; ++i){
         if (pageTable[i].valid){
@@ -197,6 +191,7 @@ AddrSpace::~AddrSpace()
         }
    }
    machine->ReleaseLock();
+   delete [] pageTable;
    delete swapFileName;
    //..
 }
@@ -250,12 +245,21 @@ void AddrSpace::SaveState()
 //	this address space can run.
 //
 //      For now, tell the machine where to find the page table.
+//
+//	If this space is already the one loaded (we are switching
+//	between two threads that share it, or back to the only user
+//	thread after running kernel threads), the TLB still holds
+//	valid translations for it, so there is nothing to flush.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
     //DEBUG('d', "AddrSpace::RestoreState\n");
     DEBUG('v', "AddrSpace::RestoreState\n");
+    if (IsLoaded()) {
+        DEBUG('v', "AddrSpace::RestoreState: already loaded\n");
+        return;
+    }
     //***********************//
     machine->InvalidAllEntryInTLB();    //cose me so much time!!!!!!!
                                         // must invalid all before update pageTable.
@@ -267,6 +271,70 @@ void AddrSpace::RestoreState()
     DEBUG('v', "leave AddrSpace::RestoreState\n");
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::IsLoaded
+// 	Return TRUE if the machine of the CPU we are running on is
+//	currently translating through this address space's page table.
+//----------------------------------------------------------------------
+
+bool AddrSpace::IsLoaded()
+{
+    return (machine->pageTable == pageTable 
+        && machine->pageTableSize == (unsigned int) numPages);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocateStack
+// 	Find a free stack for a new thread that is to share this address
+//	space (see the Fork system call).  Return its slot number, or -1
+//	if all are taken.
+//
+//	The stacks sit right below the main thread's, at the top of the
+//	address space:
+//
+//	    code, data | ... | stack 1 | stack 0 | main thread's stack
+//----------------------------------------------------------------------
+
+int AddrSpace::AllocateStack()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int slot;
+
+    for (slot = 0; slot < numStacks; slot++)
+        if (!(stacksInUse & (1 << slot))) {
+            stacksInUse |= (1 << slot);
+            break;
+        }
+    (void) interrupt->SetLevel(oldLevel);
+    return (slot < numStacks) ? slot : -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::StackTop
+// 	Return the initial stack pointer for a thread using stack "slot";
+//	as in InitRegisters, leave a bit of room at the top.
+//----------------------------------------------------------------------
+
+int AddrSpace::StackTop(int slot)
+{
+    ASSERT(slot >= 0 && slot < numStacks);
+    return numPages * PageSize - (slot + 1) * UserStackSize - 16;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FreeStack
+// 	The thread using stack "slot" has exited; let another one have it.
+//----------------------------------------------------------------------
+
+void AddrSpace::FreeStack(int slot)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(stacksInUse & (1 << slot));
+    stacksInUse &= ~(1 << slot);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 //only responsible for calculating PAddr.
 // If addr space is not allocated at the beginning, pageTable[vpn] may be -1(NA).
 int AddrSpace::VAddr2PAddr(int vAddr){
@@ -340,18 +408,12 @@ void AddrSpace::ForcedLoadPageToMemory(int vpn, int ppn){
     DEBUG('d', "Leave AddrSpace::ForcedLoadPageToMemory\n");
 }
 
-// base = 10;
-// val < 1000
+// base = 10, at least 3 digits, zero padded;
+// 0 <= val < 100000
 char* AddrSpace::my_itoa(int val, char * str){
-    ASSERT(val < 1000);
-    int a[3];
-    a[0] = val / 100;
-    a[1] = (val % 100) / 10;
-    a[2] = (val % 10);
-    for (int i = 0; i < 3; ++i){
-        str[i] = (char)(a[i] + '0');
-    }
-    str[3] = '\0';
+    ASSERT(val >= 0 && val < 100000);   // at most 5 digits, so the name
+                                        // fits in FileNameMaxLen
+    sprintf(str, "%03d", val);
     return str;
 }
 
@@ -17,13 +17,12 @@
 #include "filesys.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxForkStacks		4	// extra stacks, for threads created
+					// by Fork, at most
 
 class AddrSpace {
   public:
     AddrSpace(OpenFile *executable, int tid);	// Create an address space,
-    //.
-    AddrSpace(int tid, void * fatherSpace_);
-    //..
 					// initializing it with the program
 					// stored in the file "executable"
     ~AddrSpace();			// De-allocate an address space
@@ -33,6 +32,13 @@ class AddrSpace {
 
     void SaveState();			// Save/restore address space-specific
     void RestoreState();		// info on a context switch 
+    bool IsLoaded();			// Is this the page table the
+					// machine is using right now?
+
+    int AllocateStack();		// Find a free stack for a thread
+					// created by Fork; -1 if none
+    int StackTop(int slot);		// Initial stack pointer for it
+    void FreeStack(int slot);		// The thread has exited
 
     //.
     int VAddr2PAddr(int vAddr);
@@ -42,7 +48,7 @@ class AddrSpace {
     void CreateSwapFile(OpenFile *executable, int fileSize);
     void ForcedSwapPageToFile(int vpn);
     void ForcedLoadPageToMemory(int vpn, int ppn);
-    char* my_itoa(int val, char * str);  //val < 1000
+    char* my_itoa(int val, char * str);  //val < 100000
     void SwapAllPagesToFile();
  //   TranslationEntry *GetPageTable(){return page}
     //..
@@ -56,6 +62,8 @@ class AddrSpace {
     //.
     char *swapFileName;
     bool codeAndDataLoaded;
+    int numStacks;			// Fork stacks below the main one
+    int stacksInUse;			// bit i set if stack i is taken
 
     //..
 };
@@ -102,6 +102,63 @@ BitMap::Find()
     return -1;
 }
 
+//----------------------------------------------------------------------
+// BitMap::FindNear
+// 	Like Find, but start looking at bit "goal" rather than at 0,
+//	going round to the start if need be.  Used to allocate disk
+//	sectors close to ones a file already has.
+//
+//	If no bits are clear, return -1.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindNear(int goal)
+{
+    goal = (goal < 0 || goal >= numBits) ? 0 : goal;
+    for (int i = 0; i < numBits; i++) {
+	int which = (goal + i) % numBits;
+
+	if (!Test(which)) {
+	    Mark(which);
+	    return which;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindRun
+// 	Return the number of the first bit of a run of "count" clear
+//	bits, looking from bit "goal" on, and then from the start.  A run
+//	does not wrap around the end.  Nothing is set.
+//
+//	If there is no such run, return -1.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindRun(int goal, int count)
+{
+    int start, length;
+
+    goal = (goal < 0 || goal >= numBits) ? 0 : goal;
+    if (count <= 0 || count > numBits)
+	return -1;
+    for (int pass = 0; pass < 2; pass++) {
+	length = 0;
+	for (int i = (pass == 0) ? goal : 0; i < numBits; i++) {
+	    if (Test(i)) {
+		length = 0;
+		continue;
+	    }
+	    if (length++ == 0)
+		start = i;
+	    if (length == count)
+		return start;
+	}
+    }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // BitMap::NumClear
 // 	Return the number of clear bits in the bitmap.
@@ -118,6 +175,22 @@ BitMap::NumClear()
     return count;
 }
 
+//----------------------------------------------------------------------
+// BitMap::NumClearIn
+// 	Return the number of clear bits among bits "first" through
+//	"first + count - 1".
+//----------------------------------------------------------------------
+
+int
+BitMap::NumClearIn(int first, int count)
+{
+    int clear = 0;
+
+    for (int i = first; i < first + count && i < numBits; i++)
+	if (!Test(i)) clear++;
+    return clear;
+}
+
 //----------------------------------------------------------------------
 // BitMap::Print
 // 	Print the contents of the bitmap, for debugging.
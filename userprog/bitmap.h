@@ -43,7 +43,15 @@ class BitMap {
     int Find();            	// Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
+    int FindNear(int goal);	// Like Find, but the first clear bit at
+				// or after "goal", wrapping around
+    int FindRun(int goal, int count);
+				// Return the # of the first of "count"
+				// clear bits in a row, at or after "goal";
+				// no side effect.  -1 if there are none
     int NumClear();		// Return the number of clear bits
+    int NumClearIn(int first, int count);
+				// ... among bits first to first+count-1
 
     void Print();		// Print contents of bitmap
     
@@ -56,6 +56,11 @@ void SysCallForkHandler();
 void SysCallYieldHandler();   
 void SysCallExecHandler();
 void SysCallJoinHandler();   
+void SysCallSleepHandler();
+void SysCallWaitHandler();
+void SysCallWakeHandler();
+void SysCallSyncHandler();
+void SysCallFsyncHandler();
 
 //----------------------------------------------------------------------
 // ExceptionHandler
@@ -84,6 +89,10 @@ void
 ExceptionHandler(ExceptionType which)
 {
 		int type = machine->ReadRegister(2);
+		if (which == SyscallException)
+			TRACE(TraceSyscall, type, "syscall");
+		else
+			TRACE(TraceSyscall, which, "exception");
 	 /* if ((which == SyscallException) && (type == SC_Halt)) {
 	DEBUG('a', "Shutdown, initiated by user program.\n");
 	 	interrupt->Halt();
@@ -103,6 +112,8 @@ ExceptionHandler(ExceptionType which)
 	 					break;
 	 				case SC_Exit:
 	 					DEBUG('a', "Exit in ExceptionHandler.\n");
+	 					if (currentThread->stackSlot >= 0)
+	 						currentThread->space->FreeStack(currentThread->stackSlot);
 	 					currentThread->Finish();
 	 					break;
 					case SC_Print:
@@ -137,6 +148,21 @@ ExceptionHandler(ExceptionType which)
             break;
           case SC_Yield:
             SysCallYieldHandler();
+            break;
+          case SC_Sleep:
+            SysCallSleepHandler();
+            break;
+          case SC_Wait:
+            SysCallWaitHandler();
+            break;
+          case SC_Wake:
+            SysCallWakeHandler();
+            break;
+          case SC_Sync:
+            SysCallSyncHandler();
+            break;
+          case SC_Fsync:
+            SysCallFsyncHandler();
             break;
 	 				default:
 	 					break;
@@ -190,6 +216,7 @@ void TriggerProcess(int arg){
   switch(arg){
     case IS_FORK:
       currentThread->RestoreUserState();
+      currentThread->space->RestoreState();
       break;
     case IS_EXEC:
       if (currentThread->space != NULL){
@@ -260,23 +287,61 @@ void SysCallCloseHandler(){
     delete openFile;
   }
 }
+// The new thread runs in the *same* address space, on a stack of its
+// own, so that the two can share data (and Wait and Wake on it).
 void SysCallForkHandler(){
   DEBUG('t', "in SysCallForkHandler.\n");
+  int slot = currentThread->space->AllocateStack();
+  if (slot < 0){
+    DEBUG('t', "SysCallForkHandler: no stack left.\n");
+    return;
+  }
   Thread * t = createThread("Forked", currentThread->getPriority());
-  if (t == NULL)
+  if (t == NULL){
+    currentThread->space->FreeStack(slot);
     return;
-  AddrSpace *space = new AddrSpace(t->getTid(), currentThread->space);
-  t->space = space;
+  }
+  t->space = currentThread->space;
+  t->stackSlot = slot;
   int userFunc = (int) machine->ReadRegister(4);
   // Copy machine registers of current thread to new thread
   t->SaveUserState(); 
   t->SetUserRegister(PCReg, userFunc);
   t->SetUserRegister(NextPCReg, userFunc + 4);
+  t->SetUserRegister(StackReg, t->space->StackTop(slot));
   t->Fork(TriggerProcess, IS_FORK);
 }
 void SysCallYieldHandler(){
   currentThread->Yield();
 }   
+void SysCallSleepHandler(){
+  int ticks = (int) machine->ReadRegister(4);
+  DEBUG('s', "Thread %d sleeps for %d ticks.\n", currentThread->getTid(), ticks);
+  alarmClock->WaitUntil(ticks);
+}
+void SysCallWaitHandler(){
+  int addr = (int) machine->ReadRegister(4);
+  int expected = (int) machine->ReadRegister(5);
+  machine->WriteRegister(2, futexTable->Wait(addr, expected));
+}
+void SysCallWakeHandler(){
+  int addr = (int) machine->ReadRegister(4);
+  int count = (int) machine->ReadRegister(5);
+  machine->WriteRegister(2, futexTable->Wake(addr, count));
+}
+void SysCallSyncHandler(){
+  DEBUG('f', "Thread %d syncs the file system.\n", currentThread->getTid());
+#ifdef FILESYS
+  fileACList->WriteBackHeaders();
+  synchDisk->Sync();
+#endif
+}
+void SysCallFsyncHandler(){
+  OpenFileId fid = (OpenFileId) machine->ReadRegister(4);
+  OpenFile * openFile = (OpenFile *) currentThread->getOpenFile(fid);
+  if (openFile != NULL)
+    openFile->Sync();
+}
 void SysCallExecHandler(){
   DEBUG('s', "Thread %d in SysCallExecHandler.\n", currentThread->getTid());
   int startAddr = (int) machine->ReadRegister(4);
@@ -309,8 +374,5 @@ void SysCallExecHandler(){
 void SysCallJoinHandler(){
   DEBUG('s', "Thread %d in SysCallJoinHandler.\n", currentThread->getTid());
   int tid = (int) machine->ReadRegister(4);
-  if (tidManager->addToJoinTable(tid)){//join succ
-    interrupt->SetLevel(IntOff); 
-    currentThread->Sleep();
-  }
+  tidManager->join(tid);
 }   
@@ -0,0 +1,125 @@
+// futex.cc
+//	Routines to put user threads to sleep on a word of their memory,
+//	and to wake them up.  See futex.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "futex.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// FutexTable::FutexTable
+// 	Initialize an empty table.
+//----------------------------------------------------------------------
+
+FutexTable::FutexTable()
+{
+    for (int i = 0; i < FutexBuckets; i++) {
+	locks[i] = new Lock("futex bucket");
+	waiters[i] = NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// FutexTable::~FutexTable
+// 	De-allocate the table.  Threads still asleep in it at halt are
+//	simply forgotten, as with any other wait queue.
+//----------------------------------------------------------------------
+
+FutexTable::~FutexTable()
+{
+    for (int i = 0; i < FutexBuckets; i++)
+	delete locks[i];
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Hash
+// 	Return the bucket for the word at "addr" in "space".
+//----------------------------------------------------------------------
+
+int
+FutexTable::Hash(AddrSpace *space, int addr)
+{
+    unsigned int key = ((unsigned int) space >> 4) ^ ((unsigned int) addr >> 2);
+
+    return (key % FutexBuckets);
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wait
+// 	Put the current thread to sleep until someone calls Wake on
+//	"addr", provided the word there still holds "expected".  Return
+//	0 once woken up, or -1 at once if the word has already changed.
+//
+//	Reading the word may page-fault, so the bucket lock is a Lock,
+//	not a spin lock.  It is released with interrupts off, after we
+//	are on the bucket's list, so that no Wake can slip in between.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wait(int addr, int expected)
+{
+    AddrSpace *space = currentThread->space;
+    int bucket = Hash(space, addr);
+    FutexWaiter self, **last;
+    IntStatus oldLevel;
+    int value;
+
+    locks[bucket]->Acquire();
+    if (!machine->ReadMem(addr, 4, &value) || value != expected) {
+	locks[bucket]->Release();
+	return -1;
+    }
+    self.thread = currentThread;
+    self.space = space;
+    self.addr = addr;
+    self.next = NULL;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    for (last = &waiters[bucket]; *last != NULL; last = &(*last)->next)
+	;
+    *last = &self;
+    stats->numFutexWaits++;
+    locks[bucket]->Release();
+    DEBUG('s', "Thread %d waits on futex 0x%x\n", currentThread->getTid(), addr);
+    TRACE(TraceBlock, 0, "futex");
+    currentThread->Sleep();
+    (void) interrupt->SetLevel(oldLevel);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wake
+// 	Wake up to "count" of the threads sleeping on "addr", those that
+//	have waited longest first.  Return how many we woke up.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wake(int addr, int count)
+{
+    AddrSpace *space = currentThread->space;
+    int bucket = Hash(space, addr);
+    FutexWaiter **link, *w;
+    IntStatus oldLevel;
+    int woken = 0;
+
+    locks[bucket]->Acquire();
+    oldLevel = interrupt->SetLevel(IntOff);
+    link = &waiters[bucket];
+    while (woken < count && (w = *link) != NULL) {
+	if (w->space == space && w->addr == addr) {
+	    *link = w->next;		// "w" is gone once the thread runs
+	    TRACE(TraceWakeup, w->thread->getTid(), "futex");
+	    scheduler->ReadyToRun(w->thread);
+	    woken++;
+	} else
+	    link = &w->next;
+    }
+    stats->numFutexWakeups += woken;
+    (void) interrupt->SetLevel(oldLevel);
+    locks[bucket]->Release();
+    return woken;
+}
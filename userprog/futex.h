@@ -0,0 +1,68 @@
+// futex.h
+//	Data structures for the Wait and Wake system calls, out of which
+//	user programs build their own locks (see test/usync.c).
+//
+//	Wait(addr, expected) puts the calling thread to sleep, but only if
+//	the word at "addr" still holds "expected"; Wake(addr, n) wakes up
+//	to n threads sleeping on "addr".  A user program changes the word
+//	first and calls Wake after, and Wait checks the word and goes to
+//	sleep atomically with respect to Wake, so a wakeup is never lost:
+//	either the waiter sees the new value, or it is already asleep when
+//	Wake comes looking.  Everything else -- taking a free lock, say --
+//	is done in user mode with LL/SC, without trapping.
+//
+//	The sleeping threads are kept in a hash table keyed on address
+//	space and virtual address.  A physical address would not do: the
+//	page may be swapped out, and come back in a different frame, while
+//	threads sleep on it.  Threads created by Fork share their parent's
+//	address space, so the virtual address names the same word for all
+//	of them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "copyright.h"
+#include "thread.h"
+#include "synch.h"
+
+#define FutexBuckets	32	// size of the hash table
+
+// A thread sleeping in Wait.  Lives on the sleeper's own stack, so
+// that waiting never allocates anything.
+
+class FutexWaiter {
+  public:
+    Thread *thread;
+    AddrSpace *space;		// what it is waiting on
+    int addr;
+    FutexWaiter *next;		// next in the hash bucket, in the
+				// order they started waiting
+};
+
+// The following class defines the table of sleeping threads.  Each
+// bucket has its own lock, held from reading the user's word until
+// the caller is on the bucket's list.
+
+class FutexTable {
+  public:
+    FutexTable();
+    ~FutexTable();
+
+    int Wait(int addr, int expected);	// 0 once woken up, -1 at once
+					// if *addr is not "expected"
+    int Wake(int addr, int count);	// returns the number woken up
+
+  private:
+    int Hash(AddrSpace *space, int addr);
+
+    Lock *locks[FutexBuckets];
+    FutexWaiter *waiters[FutexBuckets];
+};
+
+extern FutexTable *futexTable;
+
+#endif // FUTEX_H
@@ -24,26 +24,55 @@ void FireProcess(int which)
     DEBUG('d', "In FireProcess.\n");
     machine->Run();
 }
-void CreatProcess(char *filename){
+int CreatProcess(char *filename){
     OpenFile *executable = fileSystem->Open(filename);
     AddrSpace *space;
     if (executable == NULL) {
         printf("Unable to open file %s\n", filename);
-        return;
+        return -1;
     }
     
     Thread *t = createThread("UserProg", 4);
     if (t == NULL){
-        return;
+        return -1;
     }
     space = new AddrSpace(executable, t->getTid());   
     delete executable;
 
     t->space = space;
     t->Fork(FireProcess, t->getTid());
+    return t->getTid();
 }
 //..
 
+//----------------------------------------------------------------------
+// ProcessBenchmark
+// 	Run "copies" copies of a user program at once, each a process of
+//	its own, and report how long they took, in simulated ticks and
+//	in host time.  Run with "-smp n" for n from 1 up: while there are
+//	at least n copies, the ticks should drop towards 1/n of what one
+//	CPU takes -- and so should the host time, as far as the host has
+//	processors for the CPUs' host threads.
+//----------------------------------------------------------------------
+
+void
+ProcessBenchmark(char *filename, int copies)
+{
+    int *tids = new int[copies];
+    int startTicks = stats->totalTicks;
+    double start = HostTime();
+
+    for (int i = 0; i < copies; i++)
+	tids[i] = CreatProcess(filename);
+    for (int i = 0; i < copies; i++)
+	if (tids[i] >= 0)
+	    tidManager->join(tids[i]);
+    printf("*** %d copies of %s on %d CPUs: %d ticks, %.3f ms host\n",
+	copies, filename, numCpus, stats->totalTicks - startTicks,
+	(HostTime() - start) / 1000.0);
+    delete [] tids;
+}
+
 //----------------------------------------------------------------------
 // StartProcess
 // 	Run a user program.  Open the executable, load it into
@@ -30,6 +30,11 @@
 #define SC_Fork		9
 #define SC_Yield	10
 #define SC_Print	11
+#define SC_Sleep	12
+#define SC_Wait		13
+#define SC_Wake		14
+#define SC_Sync		15
+#define SC_Fsync	16
 #ifndef IN_ASM
 
 /* The system call interface.  These are the operations the Nachos
@@ -115,7 +120,9 @@ void Close(OpenFileId id);
  */
 
 /* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
+ * as the current thread.  It gets a stack of its own; there are only a
+ * few of those (see MaxForkStacks), and Fork does nothing once they are
+ * all in use.  "func" must call Exit rather than return.
  */
 void Fork(void (*func)());
 
@@ -126,6 +133,35 @@ void Yield();
 
 void Print(int val);
 
+/* Put the calling thread to sleep for at least "ticks" ticks of
+ * simulated time.  Other threads keep running in the meantime.
+ */
+void Sleep(int ticks);
+
+/* User-level synchronization: Wait and Wake.  These are only the slow
+ * path; test/usync.c builds locks, condition variables and barriers on
+ * top of them, which only trap when a thread really has to sleep.
+ */
+
+/* Put the calling thread to sleep, if and only if the word at "addr"
+ * still holds "expected".  Return 0 once woken up by Wake, or -1 at
+ * once if the word holds something else.
+ */
+int Wait(int *addr, int expected);
+
+/* Wake up to "count" threads sleeping in Wait on "addr".  Return how
+ * many were woken up.
+ */
+int Wake(int *addr, int count);
+
+/* Writes to files go to the kernel's buffer cache, and reach the disk
+ * a little later.  Sync writes everything cached back to disk now; Fsync
+ * does the same for one open file only.  Both return once the data is
+ * on disk.
+ */
+void Sync();
+void Fsync(OpenFileId id);
+
 #endif /* IN_ASM */
 
 #endif /* SYSCALL_H */